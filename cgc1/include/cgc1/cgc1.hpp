@@ -1,6 +1,7 @@
 #pragma once
 #include "cgc1_dll.hpp"
 #include "declarations.hpp"
+#include "gc_stats.hpp"
 #include <array>
 #include <functional>
 #include <mcpputil/mcpputil/intrinsics.hpp>
@@ -27,11 +28,33 @@ namespace cgc1
    **/
   extern CGC1_DLL_PUBLIC uintptr_t cgc_hidden_malloc(size_t sz);
   extern void *cgc_malloc_atomic(::std::size_t size_in_bytes);
+  /**
+   * \brief Allocate count objects of sz bytes into out.
+   *
+   * Cheaper than count calls to cgc_malloc, out must be visible to the collector (for example on the stack or in gc memory).
+   * @return Number of objects allocated, less than count only if memory ran out.
+   **/
+  extern CGC1_DLL_PUBLIC size_t cgc_malloc_many(size_t sz, size_t count, void **out);
   extern void *cgc_malloc_uncollectable(::std::size_t size_in_bytes);
+  /**
+   * \brief Return descriptor for objects whose first num_words words are described by bitmap.
+   *
+   * Bit i % 64 of bitmap[i / 64] is set if word i holds a pointer, words past num_words hold no pointers.
+   * Descriptors stay valid until shutdown.
+   **/
+  extern CGC1_DLL_PUBLIC cgc_descriptor_t cgc_make_descriptor(const uint64_t *bitmap, size_t num_words);
+  /**
+   * \brief Allocate sz bytes that are only scanned at the pointer slots given by descriptor.
+   *
+   * Guaranteed to be 16 byte aligned.
+   **/
+  extern CGC1_DLL_PUBLIC void *cgc_malloc_typed(size_t sz, cgc_descriptor_t descriptor);
   /**
    * \brief Realloc sz bytes.
    *
    * Guaranteed to be 16 byte aligned.
+   * A null v allocates, a zero sz frees v and returns nullptr.
+   * Returns nullptr and leaves v alone if v is not the start of an object.
    **/
   extern CGC1_DLL_PUBLIC void *cgc_realloc(void *v, size_t sz);
   /**
@@ -116,10 +139,38 @@ namespace cgc1
    **/
   extern CGC1_DLL_PUBLIC bool cgc_is_enabled();
   /**
-   * \brief Return a vector of num new T's.
+   * \brief Set how much the heap may grow between automatic collections.
+   *
+   * A collection is triggered after allocating live heap / divisor bytes.
+   * Zero disables automatic collection.
    **/
-  template <typename T>
-  ::std::vector<T *, cgc_allocator_t<T>> make_cgc_many(size_t num);
+  extern CGC1_DLL_PUBLIC void cgc_set_free_space_divisor(size_t divisor);
+  /**
+   * \brief Return how much the heap may grow between automatic collections.
+   **/
+  extern CGC1_DLL_PUBLIC size_t cgc_free_space_divisor();
+  /**
+   * \brief Set how many minor collections run between full collections.
+   *
+   * A minor collection only collects bitmap objects allocated since the last collection.
+   * Zero disables minor collections.
+   **/
+  extern CGC1_DLL_PUBLIC void cgc_set_minor_collections_per_full(size_t num);
+  /**
+   * \brief Return how many minor collections run between full collections.
+   **/
+  extern CGC1_DLL_PUBLIC size_t cgc_minor_collections_per_full();
+  /**
+   * \brief Set if minor collections should keep mark bits of survivors.
+   *
+   * Objects are never moved either way.
+   * Sticky mark bits also collect objects allocated into free slots of old bitmap states and the sparse heap.
+   **/
+  extern CGC1_DLL_PUBLIC void cgc_set_sticky_mark_bits(bool sticky);
+  /**
+   * \brief Return true if minor collections keep mark bits of survivors.
+   **/
+  extern CGC1_DLL_PUBLIC bool cgc_sticky_mark_bits();
   /**
    * \brief Register a thread
    *
@@ -162,6 +213,13 @@ namespace cgc1
    * @param do_local_finalization Should local finalization be performed.
    **/
   extern CGC1_DLL_PUBLIC void cgc_force_collect(bool do_local_finalization = true);
+  /**
+   * \brief Force a minor collection.
+   *
+   * Falls back to a full collection if minor collections are disabled or unsupported.
+   * @param do_local_finalization Should local finalization be performed.
+   **/
+  extern CGC1_DLL_PUBLIC void cgc_force_minor_collect(bool do_local_finalization = true);
   /**
    * \brief Wait for collection to finish.
    **/
@@ -170,10 +228,26 @@ namespace cgc1
    * \brief Wait for finalization to finsih.
    **/
   extern CGC1_DLL_PUBLIC void cgc_wait_finalization(bool do_local_finalization = true);
+  /**
+   * \brief Stop here if a collection is waiting for this thread.
+   *
+   * Allocation polls for this as well, call it in long running loops that do not allocate.
+   **/
+  extern CGC1_DLL_PUBLIC void cgc_safepoint();
   /**
    * \brief Set if program should abort if this object is collected.
    **/
   extern CGC1_DLL_PUBLIC void cgc_set_abort_on_collect(void *addr, bool abort_on_collect);
+  /**
+   * \brief Return statistics over all collections so far.
+   **/
+  extern CGC1_DLL_PUBLIC cgc_gc_stats_t cgc_gc_stats();
+  /**
+   * \brief Return statistics of finalizer threads since startup.
+   *
+   * All zero unless finalizer threads are enabled.
+   **/
+  extern CGC1_DLL_PUBLIC cgc_finalizer_stats_t cgc_finalizer_stats();
   namespace debug
   {
     /**
@@ -203,3 +277,5 @@ namespace cgc1
 #include "cgc_root.hpp"
 #include "cgc_root_pointer.hpp"
 #include "gc_allocator.hpp"
+#include "thread_allocation_cache.hpp"
+#include "typed_allocation.hpp"
@@ -1,8 +1,13 @@
 #pragma once
+#include <cstdint>
 #include <mcpputil/mcpputil/declarations.hpp>
 namespace cgc1
 {
   static constexpr const bool c_gc_verbose_track = false;
+  /**
+   * \brief Pointer layout of a typed allocation, see cgc_make_descriptor.
+   **/
+  using cgc_descriptor_t = uintptr_t;
   template <size_t bytes = 5000>
   extern void clean_stack(size_t, size_t, size_t, size_t, size_t);
 
@@ -39,6 +39,13 @@ extern "C"
    * @param size_in_bytes Size of memory.
    **/
   CGC1_DLL_PUBLIC extern void* GC_malloc_atomic(size_t size_in_bytes);
+  /**
+   * \brief Allocate a list of objects of the same size.
+   *
+   * Objects are linked through their first word, see GC_NEXT.
+   * @param size_in_bytes Size of each object.
+   **/
+  CGC1_DLL_PUBLIC extern void* GC_malloc_many(size_t size_in_bytes);
   /**
    * \brief Allocate uncollectable memory.
    *
@@ -76,6 +83,13 @@ extern "C"
   CGC1_DLL_PUBLIC  extern int GC_get_max_retries();
   CGC1_DLL_PUBLIC  extern unsigned long GC_get_time_limit();
   CGC1_DLL_PUBLIC  extern long GC_get_free_space_divisor();
+  /**
+   * \brief Set how much the heap may grow between automatic collections.
+   *
+   * A collection is triggered after allocating live heap / divisor bytes.
+   * Zero disables automatic collection.
+   **/
+  CGC1_DLL_PUBLIC  extern void GC_set_free_space_divisor(long divisor);
   CGC1_DLL_PUBLIC  extern long GC_get_all_interior_pointers();
   CGC1_DLL_PUBLIC  extern int GC_is_visible(void* addr);
   CGC1_DLL_PUBLIC  extern void *GC_check_annotated_obj(void *);
@@ -86,6 +100,7 @@ extern "C"
 #define GC_MALLOC(sz) (GC_malloc(sz))
 #define GC_MALLOC_ATOMIC(sz) (GC_malloc_atomic(sz))
 #define GC_MALLOC_UNCOLLECTABLE(sz) (GC_malloc_uncollectable(sz))
+#define GC_NEXT(p) (*(void**)(p))
 #define GC_FREE(p) GC_free(p)
 #define GC_REALLOC(old, sz) GC_realloc(old, sz)
 #define GC_NEW(t)               ((t*)GC_MALLOC(sizeof(t)))
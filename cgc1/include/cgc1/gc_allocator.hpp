@@ -2,6 +2,7 @@
 #include "cgc1.hpp"
 #include <limits>
 #include <memory>
+#include <vector>
 namespace cgc1
 {
   template <typename T>
@@ -96,4 +97,18 @@ namespace cgc1
   {
     return make_cgc_unique<T>(::std::forward<Args>(args)...).release();
   }
+  /**
+   * \brief Return a vector of num new default constructed T's, allocated in one batch.
+   **/
+  template <typename T>
+  auto make_cgc_many(size_t num) -> ::std::vector<T *, gc_allocator_t<T *>>
+  {
+    // vector storage is gc memory, so the objects stay reachable while constructing.
+    ::std::vector<T *, gc_allocator_t<T *>> ret(num);
+    ret.resize(cgc_malloc_many(sizeof(T), num, reinterpret_cast<void **>(ret.data())));
+    for (auto t : ret) {
+      gc_allocator_t<T>().construct(t);
+    }
+    return ret;
+  }
 }
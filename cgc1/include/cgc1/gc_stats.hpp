@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+namespace cgc1
+{
+  /**
+   * \brief Latency distribution of one collection phase in seconds.
+   **/
+  struct cgc_phase_stats_t {
+    /**
+     * \brief Number of recorded samples.
+     **/
+    size_t m_count{0};
+    double m_mean{0};
+    double m_p50{0};
+    double m_p99{0};
+    double m_p999{0};
+    double m_max{0};
+  };
+  /**
+   * \brief Snapshot of garbage collector statistics since startup.
+   **/
+  struct cgc_gc_stats_t {
+    size_t m_num_collections{0};
+    /**
+     * \brief Collections that only collected the young generation, included in m_num_collections.
+     **/
+    size_t m_num_minor_collections{0};
+    double m_collections_per_second{0};
+    /**
+     * \brief Time from asking mutators to stop until all stopped, once per pause.
+     **/
+    cgc_phase_stats_t m_time_to_safepoint;
+    cgc_phase_stats_t m_clear;
+    cgc_phase_stats_t m_mark;
+    /**
+     * \brief Remark pause, only recorded for concurrent collections.
+     **/
+    cgc_phase_stats_t m_remark;
+    cgc_phase_stats_t m_sweep;
+    cgc_phase_stats_t m_notify;
+    cgc_phase_stats_t m_total;
+    /**
+     * \brief Mutator pause of each incremental mark slice.
+     **/
+    cgc_phase_stats_t m_mark_slice;
+    size_t m_bytes_marked_last{0};
+    size_t m_bytes_marked_total{0};
+    size_t m_sparse_objects_freed_last{0};
+    size_t m_sparse_objects_freed_total{0};
+    /**
+     * \brief Bitmap objects freed during the last pause, excluding lazy sweeping.
+     **/
+    size_t m_bitmap_objects_freed_last{0};
+    /**
+     * \brief Bitmap objects freed in total, including lazy sweeping.
+     **/
+    size_t m_bitmap_objects_freed_total{0};
+  };
+  /**
+   * \brief Snapshot of finalizer executor statistics since it started.
+   **/
+  struct cgc_finalizer_stats_t {
+    size_t m_num_submitted{0};
+    size_t m_num_completed{0};
+    /**
+     * \brief Tasks run by the submitting thread because the queue was full, included in m_num_completed.
+     **/
+    size_t m_num_run_inline{0};
+    /**
+     * \brief Largest number of tasks waiting in the queue at once.
+     **/
+    size_t m_peak_queue_depth{0};
+  };
+}
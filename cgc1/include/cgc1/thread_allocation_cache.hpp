@@ -0,0 +1,102 @@
+#pragma once
+#include "cgc1_dll.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mcpputil/mcpputil/intrinsics.hpp>
+namespace cgc1
+{
+  /**
+   * \brief Allocate sz bytes, declared in cgc1.hpp.
+   **/
+  extern CGC1_DLL_PUBLIC void *cgc_malloc(size_t sz);
+  namespace details
+  {
+    /**
+     * \brief Per thread stacks of ready to use small objects, one stack per size class.
+     *
+     * The whole cache is registered as a root range, so cached objects survive collections until handed out.
+     **/
+    struct thread_allocation_cache_t {
+      /**
+       * \brief Distance between size classes in bytes.
+       **/
+      static const constexpr size_t cs_size_class_granularity = 16;
+      /**
+       * \brief Number of size classes.
+       **/
+      static const constexpr size_t cs_num_size_classes = 16;
+      /**
+       * \brief Largest size served from the cache.
+       **/
+      static const constexpr size_t cs_max_size = cs_size_class_granularity * cs_num_size_classes;
+      /**
+       * \brief Number of objects cached per size class.
+       **/
+      static const constexpr size_t cs_depth = 32;
+      /**
+       * \brief Return size class for a size in (0, cs_max_size].
+       **/
+      static constexpr size_t size_class(size_t sz) noexcept
+      {
+        return (sz - 1) / cs_size_class_granularity;
+      }
+      /**
+       * \brief Return size of objects in size class.
+       **/
+      static constexpr size_t object_size(size_t size_class) noexcept
+      {
+        return (size_class + 1) * cs_size_class_granularity;
+      }
+      /**
+       * \brief Cached objects, valid ones are below the count of their size class.
+       **/
+      ::std::array<::std::array<void *, cs_depth>, cs_num_size_classes> m_objects{};
+      /**
+       * \brief Number of cached objects per size class.
+       **/
+      ::std::array<uint32_t, cs_num_size_classes> m_count{};
+      /**
+       * \brief True once the cache is registered as a root range for the current thread.
+       **/
+      bool m_registered{false};
+    };
+    /**
+     * \brief Allocation cache of this thread.
+     **/
+    inline thread_local thread_allocation_cache_t t_allocation_cache;
+    /**
+     * \brief Refill cache for size class and return a new object of that size class.
+     *
+     * Registers cache with the current thread on first use.
+     * Stops at a pending safepoint and counts the whole batch towards collection pacing,
+     * so the inline path of cgc_malloc_fast does neither.
+     **/
+    extern CGC1_DLL_PUBLIC void *refill_thread_allocation_cache(thread_allocation_cache_t &cache, size_t size_class);
+  }
+  /**
+   * \brief Allocate sz bytes, inline when a cached object is available.
+   *
+   * Same guarantees as cgc_malloc, small sizes are rounded up to their size class.
+   * Safepoints and pacing are only checked on refill, so at most cs_depth allocations pass between checks.
+   **/
+  inline void *cgc_malloc_fast(size_t sz)
+  {
+    using cache_type = details::thread_allocation_cache_t;
+    if (mcpputil_unlikely(sz - 1 >= cache_type::cs_max_size)) {
+      return cgc_malloc(sz);
+    }
+    auto &cache = details::t_allocation_cache;
+    const auto size_class = cache_type::size_class(sz);
+    auto &count = cache.m_count[size_class];
+    if (mcpputil_unlikely(count == 0)) {
+      return details::refill_thread_allocation_cache(cache, size_class);
+    }
+    --count;
+    auto &slot = cache.m_objects[size_class][count];
+    const auto ret = slot;
+    // the slot is scanned as a root, clear it so the object can die once the caller drops it.
+    slot = nullptr;
+    return ret;
+  }
+}
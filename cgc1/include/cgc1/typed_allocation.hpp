@@ -0,0 +1,88 @@
+#pragma once
+#include "declarations.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+namespace cgc1
+{
+  /**
+   * \brief Pointer layout of T used by cgc_make.
+   *
+   * Specialize with a static constexpr array cs_offsets of the byte offsets of every pointer member, or use
+   *CGC1_POINTER_LAYOUT.
+   * Types without a layout are scanned conservatively unless they are trivially pointer free.
+   **/
+  template <typename T>
+  struct cgc_pointer_layout_t {
+  };
+  namespace details
+  {
+    template <typename T, typename = void>
+    struct has_pointer_layout_t : ::std::false_type {
+    };
+    template <typename T>
+    struct has_pointer_layout_t<T, ::std::void_t<decltype(cgc_pointer_layout_t<T>::cs_offsets)>> : ::std::true_type {
+    };
+    /**
+     * \brief Return true if every pointer offset of T is a word inside T.
+     **/
+    template <typename T>
+    constexpr bool pointer_layout_is_valid()
+    {
+      for (const size_t offset : cgc_pointer_layout_t<T>::cs_offsets) {
+        if (offset % alignof(void *) != 0 || offset + sizeof(void *) > sizeof(T)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    /**
+     * \brief Return descriptor of T.
+     **/
+    template <typename T>
+    cgc_descriptor_t descriptor_for()
+    {
+      if constexpr (has_pointer_layout_t<T>::value) {
+        static_assert(pointer_layout_is_valid<T>(), "pointer offsets must be aligned words inside the type");
+        const constexpr size_t num_words = sizeof(T) / sizeof(void *);
+        ::std::array<uint64_t, (num_words + 63) / 64> bitmap{};
+        for (const size_t offset : cgc_pointer_layout_t<T>::cs_offsets) {
+          const size_t word = offset / sizeof(void *);
+          bitmap[word / 64] |= static_cast<uint64_t>(1) << (word % 64);
+        }
+        return cgc_make_descriptor(bitmap.data(), num_words);
+      } else if constexpr (::std::is_arithmetic<T>::value || ::std::is_enum<T>::value) {
+        // empty bitmap means pointer free.
+        return cgc_make_descriptor(nullptr, 0);
+      } else {
+        return 0;
+      }
+    }
+  }
+  /**
+   * \brief Allocate and construct a T that is only scanned at the pointer slots of its layout.
+   **/
+  template <typename T, typename... Args>
+  T *cgc_make(Args &&... args)
+  {
+    static const cgc_descriptor_t descriptor = details::descriptor_for<T>();
+    void *const memory = cgc_malloc_typed(sizeof(T), descriptor);
+    return new (memory) T(::std::forward<Args>(args)...);
+  }
+}
+/**
+ * \brief Declare pointer layout of T from byte offsets, use at global scope.
+ *
+ * Example: CGC1_POINTER_LAYOUT(node_t, offsetof(node_t, m_next), offsetof(node_t, m_value))
+ **/
+#define CGC1_POINTER_LAYOUT(T, ...)                                                                                            \
+  namespace cgc1                                                                                                               \
+  {                                                                                                                            \
+    template <>                                                                                                                \
+    struct cgc_pointer_layout_t<T> {                                                                                           \
+      static constexpr size_t cs_offsets[] = {__VA_ARGS__};                                                                    \
+    };                                                                                                                         \
+  }
@@ -0,0 +1,29 @@
+#pragma once
+/*
+ * Boehm GC typed allocation compatability header.
+ */
+#include "../cgc1/gc.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef uintptr_t GC_word;
+typedef GC_word GC_descr;
+#define GC_WORDSZ (8 * sizeof(GC_word))
+#define GC_get_bit(bm, index) (((bm)[(index) / GC_WORDSZ] >> ((index) % GC_WORDSZ)) & 1)
+#define GC_set_bit(bm, index) ((bm)[(index) / GC_WORDSZ] |= (GC_word)1 << ((index) % GC_WORDSZ))
+#define GC_WORD_OFFSET(t, f) (offsetof(t, f) / sizeof(GC_word))
+#define GC_WORD_LEN(t) (sizeof(t) / sizeof(GC_word))
+#define GC_BITMAP_SIZE(t) ((GC_WORD_LEN(t) + GC_WORDSZ - 1) / GC_WORDSZ)
+/**
+ * \brief Return descriptor for objects whose first len words are described by bm.
+ *
+ * Words past len hold no pointers.
+ **/
+extern CGC1_DLL_PUBLIC GC_descr GC_make_descriptor(const GC_word *bm, size_t len);
+/**
+ * \brief Allocate memory that is only scanned at the pointer slots given by d.
+ **/
+extern CGC1_DLL_PUBLIC void *GC_malloc_explicitly_typed(size_t size_in_bytes, GC_descr d);
+#ifdef __cplusplus
+}
+#endif
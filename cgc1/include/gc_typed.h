@@ -0,0 +1 @@
+#include "gc/gc_typed.h"
@@ -0,0 +1,79 @@
+#include "background_collector.hpp"
+#include "global_kernel_state.hpp"
+#include <cgc1/cgc1.hpp>
+namespace cgc1::details
+{
+  background_collector_t::~background_collector_t()
+  {
+    if (running()) {
+      shutdown();
+    }
+  }
+  void background_collector_t::start()
+  {
+    m_run = true;
+    using thread_type = decltype(m_thread);
+    m_thread = thread_type(thread_type::allocator{}, [this]() -> void * {
+      cgc_register_thread(mcpputil_builtin_current_stack());
+      _run();
+      // also destroys the internal allocator state of this thread.
+      cgc_unregister_thread();
+      return nullptr;
+    });
+  }
+  void background_collector_t::shutdown()
+  {
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_run = false;
+      m_requested.notify_all();
+      m_finished.notify_all();
+    }
+    m_thread.join();
+  }
+  bool background_collector_t::running() const noexcept
+  {
+    return m_run.load(::std::memory_order_acquire);
+  }
+  auto background_collector_t::request_collection() -> size_t
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    // merge with a collection that has not finished yet.
+    if (m_num_requested == m_num_finished.load(::std::memory_order_acquire)) {
+      ++m_num_requested;
+      m_requested.notify_all();
+    }
+    return m_num_requested;
+  }
+  void background_collector_t::wait_for_collection(size_t ticket)
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    m_finished.wait(m_mutex, [this, ticket]() -> bool {
+      return !running() || m_num_finished.load(::std::memory_order_acquire) >= ticket;
+    });
+  }
+  auto background_collector_t::num_finished() const noexcept -> size_t
+  {
+    return m_num_finished.load(::std::memory_order_acquire);
+  }
+  void background_collector_t::_run()
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    while (true) {
+      m_requested.wait(m_mutex, [this]() -> bool {
+        return !running() || m_num_requested != m_num_finished.load(::std::memory_order_acquire);
+      });
+      if (!running()) {
+        return;
+      }
+      const auto ticket = m_num_requested;
+      // do not hold mutex while collecting so mutators can keep requesting.
+      m_mutex.unlock();
+      // local finalizers must run on user threads, so leave them to the mutators.
+      g_gks->force_collect(false, g_gks->_minor_collection_due());
+      m_mutex.lock();
+      m_num_finished.store(ticket, ::std::memory_order_release);
+      m_finished.notify_all();
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "internal_allocator.hpp"
+#include <atomic>
+#include <cgc1/allocated_thread.hpp>
+#include <cgc1/cgc_internal_malloc_allocator.hpp>
+#include <mcpputil/mcpputil/concurrency.hpp>
+namespace cgc1::details
+{
+  /**
+   * \brief Thread that runs collections on behalf of mutators.
+   *
+   * Mutators request a collection without waiting for it, so stopping the world and local bookkeeping do not happen on their
+   *threads.
+   * Requests made while a collection is pending or running are merged into it.
+   **/
+  class background_collector_t
+  {
+  public:
+    background_collector_t() = default;
+    background_collector_t(const background_collector_t &) = delete;
+    background_collector_t(background_collector_t &&) = delete;
+    background_collector_t &operator=(const background_collector_t &) = delete;
+    background_collector_t &operator=(background_collector_t &&) = delete;
+    ~background_collector_t();
+    /**
+     * \brief Start collector thread.
+     *
+     * The thread registers itself with the gks, so this must not be called while holding gks locks the thread needs to finish
+     *starting.
+     **/
+    void start() REQUIRES(!m_mutex);
+    /**
+     * \brief Finish any running collection, stop collector thread, and wake up waiters.
+     **/
+    void shutdown() REQUIRES(!m_mutex);
+    /**
+     * \brief Return true if collector thread is running.
+     **/
+    bool running() const noexcept;
+    /**
+     * \brief Ask for a collection without waiting for it.
+     *
+     * @return Ticket that can be passed to wait_for_collection.
+     **/
+    auto request_collection() -> size_t REQUIRES(!m_mutex);
+    /**
+     * \brief Wait until the collection for ticket finished or the collector shut down.
+     **/
+    void wait_for_collection(size_t ticket) REQUIRES(!m_mutex);
+    /**
+     * \brief Return number of collections finished by this collector.
+     **/
+    auto num_finished() const noexcept -> size_t;
+
+  private:
+    /**
+     * \brief Main loop of collector thread.
+     **/
+    void _run() REQUIRES(!m_mutex);
+    /**
+     * \brief Mutex for condition variables and protection.
+     **/
+    ::mcpputil::mutex_t m_mutex;
+    /**
+     * \brief Variable for a new request or shutdown.
+     **/
+    condition_variable_any_t m_requested;
+    /**
+     * \brief Variable for a collection finishing or shutdown.
+     **/
+    condition_variable_any_t m_finished;
+    /**
+     * \brief Number of collections requested.
+     **/
+    size_t m_num_requested GUARDED_BY(m_mutex) = 0;
+    /**
+     * \brief Number of collections finished.
+     **/
+    ::std::atomic<size_t> m_num_finished{0};
+    /**
+     * \brief Should the collector thread keep running.
+     **/
+    ::std::atomic<bool> m_run{false};
+    /**
+     * \brief Thread that collections run in.
+     **/
+    allocated_thread_t<cgc_internal_malloc_allocator_t<void>> m_thread;
+  };
+}
@@ -1,60 +1,142 @@
+#include "bitmap_finalization.hpp"
 #include "bitmap_gc_user_data.hpp"
-#include <mcppalloc/mcppalloc_bitmap_allocator/bitmap_state.hpp>
+#include "bitmap_kernels.hpp"
 namespace cgc1
 {
   namespace details
   {
-    void finalize(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state)
+    using dynamic_bits_type = ::mcppalloc::bitmap::dynamic_bitmap_ref_t<false>::bits_type;
+    /**
+     * \brief Return words backing a bitmap made by make_dynamic_bitmap_ref_from_alloca on memory.
+     *
+     * The bitmap starts at memory rounded up to the bits type alignment.
+     **/
+    static uint64_t *alloca_bitmap_words(void *memory) noexcept
+    {
+      const auto alignment = static_cast<uintptr_t>(dynamic_bits_type::cs_alignment);
+      const auto address = (reinterpret_cast<uintptr_t>(memory) + alignment - 1) & ~(alignment - 1);
+      return reinterpret_cast<uint64_t *>(address);
+    }
+    /**
+     * \brief Return size of memory to alloca for each bitmap passed to fill_finalization_bitmaps.
+     **/
+    static size_t finalization_bitmap_alloca_size(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state) noexcept
+    {
+      return state->block_size_in_bytes() + dynamic_bits_type::cs_alignment;
+    }
+    /**
+     * \brief Fill bitmaps of objects to be freed and of finalizeable objects in state.
+     *
+     * Both memories must be alloca'd by the caller with finalization_bitmap_alloca_size bytes,
+     * use alloca_bitmap_words to get at the bits.
+     **/
+    static void fill_finalization_bitmaps(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state,
+                                          void *to_be_freed_memory,
+                                          void *finalizeable_memory,
+                                          size_t alloca_size)
     {
-      const size_t alloca_size =
-          state->block_size_in_bytes() + ::mcppalloc::bitmap::dynamic_bitmap_ref_t<false>::bits_type::cs_alignment;
-      const auto to_be_freed_memory = alloca(alloca_size);
       auto to_be_freed =
           ::mcppalloc::bitmap::make_dynamic_bitmap_ref_from_alloca(to_be_freed_memory, state->num_blocks(), alloca_size);
       to_be_freed.clear();
       state->or_with_to_be_freed(to_be_freed);
+      auto finalizeable =
+          ::mcppalloc::bitmap::make_dynamic_bitmap_ref_from_alloca(finalizeable_memory, state->num_blocks(), alloca_size);
+      finalizeable.deep_copy(state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable));
+    }
+    /**
+     * \brief Run finalizer on object, reporting exceptions.
+     **/
+    static void run_finalizer(gc_user_data_t::finalizer_type &finalizer, void *object)
+    {
+      try {
+        finalizer(object);
+      } catch (::std::exception &e) {
+        ::std::cerr << "CGC1: Finalizer exception: " << e.what();
+      } catch (...) {
+        ::std::cerr << "CGC1: Finalizer threw unknown exception: 872ed1cd-be5c-4e65-baed-9e44de0a1dc8";
+        ::std::terminate();
+      }
+    }
+    size_t finalize(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state)
+    {
+      const size_t alloca_size = finalization_bitmap_alloca_size(state);
+      const size_t num_words = state->block_size_in_bytes() / sizeof(uint64_t);
+      const auto to_be_freed_memory = alloca(alloca_size);
       const auto free_with_finalizer_memory = alloca(alloca_size);
-      auto free_with_finalizer =
-          ::mcppalloc::bitmap::make_dynamic_bitmap_ref_from_alloca(free_with_finalizer_memory, state->num_blocks(), alloca_size);
-      free_with_finalizer.deep_copy(to_be_freed);
-      free_with_finalizer &= state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable);
-      for (size_t i = 0; i < state->size(); ++i) {
-        if (!free_with_finalizer.get_bit(i)) {
-          continue;
-        }
+      fill_finalization_bitmaps(state, to_be_freed_memory, free_with_finalizer_memory, alloca_size);
+      const auto to_be_freed_words = alloca_bitmap_words(to_be_freed_memory);
+      const auto free_with_finalizer_words = alloca_bitmap_words(free_with_finalizer_memory);
+      bitmap_and(free_with_finalizer_words, to_be_freed_words, num_words);
+      bitmap_for_set_bits(free_with_finalizer_words, state->size(), [state](size_t i) {
         const auto object = state->get_object(i);
-        if (state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable).get_bit(i)) {
-          const auto ud = bitmap_allocator_user_data(object);
-          if (mcpputil_unlikely(!ud)) {
-            continue;
-          }
-          if (ud->abort_on_collect()) {
-
-            ::std::cerr << __FILE__ << " " << __LINE__ << " " << state->is_marked(i) << ::std::endl;
-            ::std::terminate();
-          }
-          state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable).set_bit(i, false);
-          state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable_arbitrary_thread).set_bit(i, false);
-          auto finalizer = ::std::move(ud->gc_user_data_ref().m_finalizer);
-          try {
-            finalizer(object);
-          } catch (::std::exception &e) {
-            ::std::cerr << "CGC1: Finalizer exception: " << e.what();
-          } catch (...) {
-            ::std::cerr << "CGC1: Finalizer threw unknown exception: 872ed1cd-be5c-4e65-baed-9e44de0a1dc8";
-            ::std::terminate();
-          }
-          ::mcpputil::secure_zero_stream(object, state->real_entry_size());
+        auto ud = g_gks->_bitmap_user_data().take(object);
+        if (ud.abort_on_collect()) {
+          ::std::cerr << __FILE__ << " " << __LINE__ << " " << state->is_marked(i) << ::std::endl;
+          ::std::terminate();
         }
-      }
+        state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable).set_bit(i, false);
+        state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable_arbitrary_thread).set_bit(i, false);
+        auto finalizer = ::std::move(ud.gc_user_data_ref().m_finalizer);
+        // entries that only carry abort on collect have no finalizer.
+        if (finalizer) {
+          run_finalizer(finalizer, object);
+        }
+        ::mcpputil::secure_zero_stream(object, state->real_entry_size());
+      });
 
-      to_be_freed &= free_with_finalizer.negate();
-      to_be_freed.for_some_contiguous_bits_flip(state->size(), [state](size_t begin, size_t end) {
+      const auto num_freed = bitmap_popcount(to_be_freed_words, num_words);
+      bitmap_andnot(to_be_freed_words, free_with_finalizer_words, num_words);
+      bitmap_for_set_runs(to_be_freed_words, state->size(), [state](size_t begin, size_t end) {
         ::mcpputil::secure_zero_stream(state->get_object(begin), state->real_entry_size() * (end - begin));
       });
-      to_be_freed.for_set_bits(
-          state->size(), [state](size_t i) { ::mcpputil::secure_zero_stream(state->get_object(i), state->real_entry_size()); });
       state->free_unmarked();
+      return num_freed;
+    }
+    bool has_unmarked_finalizable(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state)
+    {
+      const size_t alloca_size = finalization_bitmap_alloca_size(state);
+      const size_t num_words = state->block_size_in_bytes() / sizeof(uint64_t);
+      const auto to_be_freed_memory = alloca(alloca_size);
+      const auto finalizeable_memory = alloca(alloca_size);
+      fill_finalization_bitmaps(state, to_be_freed_memory, finalizeable_memory, alloca_size);
+      return bitmap_any_and(alloca_bitmap_words(to_be_freed_memory), alloca_bitmap_words(finalizeable_memory), num_words);
+    }
+    size_t defer_finalizers(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state,
+                            cgc_internal_vector_t<deferred_finalizer_t> &out)
+    {
+      const size_t alloca_size = finalization_bitmap_alloca_size(state);
+      const size_t num_words = state->block_size_in_bytes() / sizeof(uint64_t);
+      const auto to_be_freed_memory = alloca(alloca_size);
+      const auto finalizeable_memory = alloca(alloca_size);
+      fill_finalization_bitmaps(state, to_be_freed_memory, finalizeable_memory, alloca_size);
+      const auto finalizeable_words = alloca_bitmap_words(finalizeable_memory);
+      bitmap_and(finalizeable_words, alloca_bitmap_words(to_be_freed_memory), num_words);
+      const size_t num_deferred = out.size();
+      bitmap_for_set_bits(finalizeable_words, state->size(), [state, &out](size_t i) {
+        const auto object = state->get_object(i);
+        auto ud = g_gks->_bitmap_user_data().take(object);
+        if (ud.abort_on_collect()) {
+          ::std::cerr << "CGC1: Object marked abort on collect was collected ff03c3ce-e1cb-45ad-b322-051ab80df76b\n";
+          ::std::terminate();
+        }
+        state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable).set_bit(i, false);
+        state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable_arbitrary_thread).set_bit(i, false);
+        auto finalizer = ::std::move(ud.gc_user_data_ref().m_finalizer);
+        // entries that only carry abort on collect have no finalizer and are freed now.
+        if (finalizer) {
+          // the finalizer may still use the object.
+          state->set_marked(i);
+          out.push_back(
+              deferred_finalizer_t{object, ::std::move(finalizer), ud.gc_user_data_ref().allow_arbitrary_finalizer_thread()});
+        }
+      });
+      return out.size() - num_deferred;
+    }
+    void run_deferred_finalizers(::gsl::span<deferred_finalizer_t> finalizers)
+    {
+      for (auto &deferred : finalizers) {
+        run_finalizer(deferred.m_finalizer, deferred.m_object);
+      }
     }
   }
 }
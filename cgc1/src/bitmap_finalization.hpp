@@ -0,0 +1,42 @@
+#pragma once
+#include "gc_user_data.hpp"
+#include "internal_allocator.hpp"
+#include <gsl/gsl>
+#include <mcppalloc/mcppalloc_bitmap_allocator/bitmap_state.hpp>
+namespace cgc1::details
+{
+  /**
+   * \brief Finalizer of an unreachable object whose finalization was left for a finalizer thread.
+   **/
+  struct deferred_finalizer_t {
+    void *m_object;
+    gc_user_data_t::finalizer_type m_finalizer;
+    /**
+     * \brief False if the finalizer must not run on a gc thread.
+     **/
+    bool m_allow_arbitrary_thread;
+  };
+  /**
+   * \brief Run finalizers of unmarked objects in state, then free them.
+   *
+   * @return Number of objects freed.
+   **/
+  size_t finalize(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state);
+  /**
+   * \brief Return true if finalize would run a finalizer for state.
+   **/
+  bool has_unmarked_finalizable(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state);
+  /**
+   * \brief Take finalizers of unmarked objects in state instead of running them.
+   *
+   * Objects with a finalizer are marked so they survive this collection, then are collected normally.
+   * The state can then be swept without running finalizers.
+   * @return Number of finalizers appended to out.
+   **/
+  size_t defer_finalizers(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state,
+                          cgc_internal_vector_t<deferred_finalizer_t> &out);
+  /**
+   * \brief Run finalizers taken by defer_finalizers.
+   **/
+  void run_deferred_finalizers(::gsl::span<deferred_finalizer_t> finalizers);
+}
@@ -1,5 +1,5 @@
 #pragma once
-#include "gc_user_data.hpp"
+#include "bitmap_user_data_table.hpp"
 #include "global_kernel_state.hpp"
 #include <cgc1/cgc1.hpp>
 namespace cgc1
@@ -18,6 +18,10 @@ namespace cgc1
      * \brief Type code for allocations with user data.
      **/
     static const constexpr size_t cs_bitmap_allocation_type_user_data{2};
+    /**
+     * \brief Type code for typed allocations, which end in their descriptor.
+     **/
+    static const constexpr size_t cs_bitmap_allocation_type_typed{3};
     /**
      * \brief User bit index for enabling finalization.
      **/
@@ -27,44 +31,9 @@ namespace cgc1
      **/
     static const constexpr size_t cs_bitmap_allocation_user_bit_finalizeable_arbitrary_thread{1};
     /**
-     * \brief User data that can be associated with an allocation.
+     * \brief Return bitmap state of addr if it is a valid allocation that can carry user data, nullptr otherwise.
      **/
-    class alignas(::mcppalloc::details::user_data_alignment_t) bitmap_gc_user_data_t
-    {
-    public:
-      auto gc_user_data_ref() noexcept -> gc_user_data_t &
-      {
-        return m_gc_user_data;
-      }
-      auto gc_user_data_ref() const noexcept -> const gc_user_data_t &
-      {
-        return m_gc_user_data;
-      }
-
-      auto atomic() const noexcept -> bool
-      {
-        return m_atomic;
-      }
-      void set_atomic(bool atomic) noexcept
-      {
-        m_atomic = atomic;
-      }
-      auto abort_on_collect() const noexcept -> bool
-      {
-        return m_abort_on_collect;
-      }
-      void set_abort_on_collect(bool abort_on_collect) noexcept
-      {
-        m_abort_on_collect = abort_on_collect;
-      }
-
-    private:
-      gc_user_data_t m_gc_user_data;
-      bool m_atomic{false};
-      bool m_abort_on_collect{false};
-    };
-
-    inline details::bitmap_gc_user_data_t *bitmap_allocator_user_data(void *addr)
+    inline auto bitmap_user_data_state(void *addr) -> ::mcppalloc::bitmap_allocator::details::bitmap_state_t *
     {
       if (!is_bitmap_allocator(addr)) {
         return nullptr;
@@ -74,13 +43,44 @@ namespace cgc1
         assert(false);
         return nullptr;
       }
-      if (state->type_id() != 2) {
+      if (state->type_id() != cs_bitmap_allocation_type_user_data && state->type_id() != cs_bitmap_allocation_type_typed) {
+        return nullptr;
+      }
+      return state;
+    }
+    /**
+     * \brief Return address of descriptor of a typed bitmap allocation.
+     **/
+    inline auto bitmap_typed_descriptor(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state, void *object_start)
+        -> cgc_descriptor_t *
+    {
+      uint8_t *const object_end = reinterpret_cast<uint8_t *>(object_start) + state->real_entry_size();
+      return reinterpret_cast<cgc_descriptor_t *>(object_end) - 1;
+    }
+    /**
+     * \brief Return user data of bitmap allocation at addr or nullptr if it has none.
+     **/
+    inline details::bitmap_gc_user_data_t *bitmap_allocator_user_data(void *addr)
+    {
+      const auto state = bitmap_user_data_state(addr);
+      if (!state) {
+        return nullptr;
+      }
+      return g_gks->_bitmap_user_data().find(state->get_object(state->get_index(addr)));
+    }
+    /**
+     * \brief Return user data of bitmap allocation at addr, creating it if needed.
+     *
+     * Caller must set the finalizeable user bit of the object so the entry is removed when the object is swept.
+     * @return nullptr if addr can not carry user data.
+     **/
+    inline details::bitmap_gc_user_data_t *make_bitmap_allocator_user_data(void *addr)
+    {
+      const auto state = bitmap_user_data_state(addr);
+      if (!state) {
         return nullptr;
       }
-      const auto bin_sz = state->real_entry_size();
-      uint8_t *const start_of_gc_user_data =
-          ::mcpputil::unsafe_cast<uint8_t>(addr) + bin_sz - sizeof(details::bitmap_gc_user_data_t);
-      return ::mcpputil::unsafe_cast<details::bitmap_gc_user_data_t>(start_of_gc_user_data);
+      return &g_gks->_bitmap_user_data().find_or_create(state->get_object(state->get_index(addr)));
     }
   }
 }
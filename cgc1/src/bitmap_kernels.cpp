@@ -0,0 +1,172 @@
+#include "bitmap_kernels.hpp"
+#include "cpu_features.hpp"
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CGC1_BITMAP_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+namespace cgc1::details
+{
+  static void bitmap_and_scalar(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    for (size_t i = 0; i < num_words; ++i) {
+      dst[i] &= src[i];
+    }
+  }
+  static void bitmap_andnot_scalar(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    for (size_t i = 0; i < num_words; ++i) {
+      dst[i] &= ~src[i];
+    }
+  }
+  static bool bitmap_any_and_scalar(const uint64_t *a, const uint64_t *b, size_t num_words) noexcept
+  {
+    for (size_t i = 0; i < num_words; ++i) {
+      if (a[i] & b[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+  static size_t bitmap_popcount_scalar(const uint64_t *words, size_t num_words) noexcept
+  {
+    size_t ret = 0;
+    for (size_t i = 0; i < num_words; ++i) {
+#if defined(__GNUC__) || defined(__clang__)
+      ret += static_cast<size_t>(__builtin_popcountll(words[i]));
+#else
+      for (auto word = words[i]; word; word &= word - 1) {
+        ++ret;
+      }
+#endif
+    }
+    return ret;
+  }
+#ifdef CGC1_BITMAP_KERNELS_X86
+  __attribute__((target("popcnt"))) static size_t bitmap_popcount_popcnt(const uint64_t *words, size_t num_words) noexcept
+  {
+    size_t ret = 0;
+    for (size_t i = 0; i < num_words; ++i) {
+      ret += static_cast<size_t>(_mm_popcnt_u64(words[i]));
+    }
+    return ret;
+  }
+  __attribute__((target("avx2"))) static void bitmap_and_avx2(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    size_t i = 0;
+    for (; i + 4 <= num_words; i += 4) {
+      const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+      const auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_and_si256(d, s));
+    }
+    bitmap_and_scalar(dst + i, src + i, num_words - i);
+  }
+  __attribute__((target("avx2"))) static void bitmap_andnot_avx2(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    size_t i = 0;
+    for (; i + 4 <= num_words; i += 4) {
+      const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+      const auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+      // andnot negates its first operand.
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_andnot_si256(s, d));
+    }
+    bitmap_andnot_scalar(dst + i, src + i, num_words - i);
+  }
+  __attribute__((target("avx2"))) static bool bitmap_any_and_avx2(const uint64_t *a, const uint64_t *b, size_t num_words) noexcept
+  {
+    size_t i = 0;
+    for (; i + 4 <= num_words; i += 4) {
+      const auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+      const auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+      if (!_mm256_testz_si256(va, vb)) {
+        return true;
+      }
+    }
+    return bitmap_any_and_scalar(a + i, b + i, num_words - i);
+  }
+  __attribute__((target("avx512f"))) static void
+  bitmap_and_avx512(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    size_t i = 0;
+    for (; i + 8 <= num_words; i += 8) {
+      const auto d = _mm512_loadu_si512(dst + i);
+      const auto s = _mm512_loadu_si512(src + i);
+      _mm512_storeu_si512(dst + i, _mm512_and_si512(d, s));
+    }
+    bitmap_and_scalar(dst + i, src + i, num_words - i);
+  }
+  __attribute__((target("avx512f"))) static void
+  bitmap_andnot_avx512(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    size_t i = 0;
+    for (; i + 8 <= num_words; i += 8) {
+      const auto d = _mm512_loadu_si512(dst + i);
+      const auto s = _mm512_loadu_si512(src + i);
+      _mm512_storeu_si512(dst + i, _mm512_and_si512(d, _mm512_xor_si512(s, _mm512_set1_epi64(-1))));
+    }
+    bitmap_andnot_scalar(dst + i, src + i, num_words - i);
+  }
+  __attribute__((target("avx512f"))) static bool
+  bitmap_any_and_avx512(const uint64_t *a, const uint64_t *b, size_t num_words) noexcept
+  {
+    size_t i = 0;
+    for (; i + 8 <= num_words; i += 8) {
+      const auto va = _mm512_loadu_si512(a + i);
+      const auto vb = _mm512_loadu_si512(b + i);
+      if (_mm512_test_epi64_mask(va, vb)) {
+        return true;
+      }
+    }
+    return bitmap_any_and_scalar(a + i, b + i, num_words - i);
+  }
+#endif
+  /**
+   * \brief Kernels selected for the running cpu.
+   **/
+  struct bitmap_kernel_table_t {
+    void (*m_and)(uint64_t *, const uint64_t *, size_t) noexcept = &bitmap_and_scalar;
+    void (*m_andnot)(uint64_t *, const uint64_t *, size_t) noexcept = &bitmap_andnot_scalar;
+    bool (*m_any_and)(const uint64_t *, const uint64_t *, size_t) noexcept = &bitmap_any_and_scalar;
+    size_t (*m_popcount)(const uint64_t *, size_t) noexcept = &bitmap_popcount_scalar;
+  };
+  static bitmap_kernel_table_t select_bitmap_kernels() noexcept
+  {
+    bitmap_kernel_table_t ret;
+#ifdef CGC1_BITMAP_KERNELS_X86
+    const auto &features = cpu_features();
+    if (features.m_popcnt) {
+      ret.m_popcount = &bitmap_popcount_popcnt;
+    }
+    if (features.m_avx512f) {
+      ret.m_and = &bitmap_and_avx512;
+      ret.m_andnot = &bitmap_andnot_avx512;
+      ret.m_any_and = &bitmap_any_and_avx512;
+    } else if (features.m_avx2) {
+      ret.m_and = &bitmap_and_avx2;
+      ret.m_andnot = &bitmap_andnot_avx2;
+      ret.m_any_and = &bitmap_any_and_avx2;
+    }
+#endif
+    return ret;
+  }
+  static const bitmap_kernel_table_t &bitmap_kernels() noexcept
+  {
+    static const bitmap_kernel_table_t s_kernels = select_bitmap_kernels();
+    return s_kernels;
+  }
+  void bitmap_and(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    bitmap_kernels().m_and(dst, src, num_words);
+  }
+  void bitmap_andnot(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept
+  {
+    bitmap_kernels().m_andnot(dst, src, num_words);
+  }
+  bool bitmap_any_and(const uint64_t *a, const uint64_t *b, size_t num_words) noexcept
+  {
+    return bitmap_kernels().m_any_and(a, b, num_words);
+  }
+  size_t bitmap_popcount(const uint64_t *words, size_t num_words) noexcept
+  {
+    return bitmap_kernels().m_popcount(words, num_words);
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+namespace cgc1::details
+{
+  /**
+   * \brief dst &= src over num_words words.
+   **/
+  void bitmap_and(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept;
+  /**
+   * \brief dst &= ~src over num_words words.
+   **/
+  void bitmap_andnot(uint64_t *dst, const uint64_t *src, size_t num_words) noexcept;
+  /**
+   * \brief Return true if (a & b) has any bit set over num_words words.
+   **/
+  bool bitmap_any_and(const uint64_t *a, const uint64_t *b, size_t num_words) noexcept;
+  /**
+   * \brief Return number of bits set over num_words words.
+   **/
+  size_t bitmap_popcount(const uint64_t *words, size_t num_words) noexcept;
+  /**
+   * \brief Return index of lowest set bit of a non-zero word.
+   **/
+  inline size_t bitmap_lowest_set_bit(uint64_t word) noexcept
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(word));
+#else
+    size_t ret = 0;
+    while (!(word & 1)) {
+      word >>= 1;
+      ++ret;
+    }
+    return ret;
+#endif
+  }
+  /**
+   * \brief Call f(i) for every set bit i below num_bits.
+   *
+   * Skips zero words and walks set bits with count trailing zeros, so cost is in set bits rather than bits.
+   **/
+  template <typename F>
+  void bitmap_for_set_bits(const uint64_t *words, size_t num_bits, F &&f)
+  {
+    const size_t num_words = (num_bits + 63) / 64;
+    for (size_t w = 0; w < num_words; ++w) {
+      auto word = words[w];
+      while (word) {
+        const size_t i = w * 64 + bitmap_lowest_set_bit(word);
+        if (i >= num_bits) {
+          return;
+        }
+        f(i);
+        word &= word - 1;
+      }
+    }
+  }
+  /**
+   * \brief Call f(begin, end) for every maximal run of set bits [begin, end) below num_bits.
+   **/
+  template <typename F>
+  void bitmap_for_set_runs(const uint64_t *words, size_t num_bits, F &&f)
+  {
+    const size_t num_words = (num_bits + 63) / 64;
+    size_t run_begin = 0;
+    bool in_run = false;
+    for (size_t w = 0; w < num_words; ++w) {
+      auto word = words[w];
+      const size_t base = w * 64;
+      // fast path for words that do not change run state.
+      if (word == (in_run ? ~static_cast<uint64_t>(0) : 0)) {
+        continue;
+      }
+      size_t pos = 0;
+      while (pos < 64) {
+        if (in_run) {
+          // find end of run, which is the lowest clear bit.
+          const auto inverted = ~word >> pos;
+          if (!inverted) {
+            break;
+          }
+          pos += bitmap_lowest_set_bit(inverted);
+          in_run = false;
+          const size_t run_end = ::std::min(base + pos, num_bits);
+          if (run_begin < run_end) {
+            f(run_begin, run_end);
+          }
+        } else {
+          const auto remaining = word >> pos;
+          if (!remaining) {
+            break;
+          }
+          pos += bitmap_lowest_set_bit(remaining);
+          in_run = true;
+          run_begin = base + pos;
+        }
+      }
+    }
+    if (in_run) {
+      const size_t run_end = ::std::min(num_words * 64, num_bits);
+      if (run_begin < run_end) {
+        f(run_begin, run_end);
+      }
+    }
+  }
+}
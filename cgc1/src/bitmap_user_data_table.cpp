@@ -0,0 +1,46 @@
+#include "bitmap_user_data_table.hpp"
+namespace cgc1::details
+{
+  auto bitmap_user_data_table_t::find(void *object) -> user_data_type *
+  {
+    if (empty()) {
+      return nullptr;
+    }
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    const auto it = m_entries.find(object);
+    if (it == m_entries.end()) {
+      return nullptr;
+    }
+    return &it->second;
+  }
+  auto bitmap_user_data_table_t::find_or_create(void *object) -> user_data_type &
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    auto &ret = m_entries[object];
+    m_size.store(m_entries.size(), ::std::memory_order_release);
+    return ret;
+  }
+  auto bitmap_user_data_table_t::take(void *object) -> user_data_type
+  {
+    if (empty()) {
+      return user_data_type();
+    }
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    const auto it = m_entries.find(object);
+    if (it == m_entries.end()) {
+      return user_data_type();
+    }
+    auto ret = ::std::move(it->second);
+    m_entries.erase(it);
+    m_size.store(m_entries.size(), ::std::memory_order_release);
+    return ret;
+  }
+  bool bitmap_user_data_table_t::empty() const noexcept
+  {
+    return size() == 0;
+  }
+  auto bitmap_user_data_table_t::size() const noexcept -> size_t
+  {
+    return m_size.load(::std::memory_order_acquire);
+  }
+}
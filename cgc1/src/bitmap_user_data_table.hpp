@@ -0,0 +1,109 @@
+#pragma once
+#include "gc_user_data.hpp"
+#include "internal_allocator.hpp"
+#include <atomic>
+#include <functional>
+#include <mcpputil/mcpputil/concurrency.hpp>
+#include <unordered_map>
+namespace cgc1::details
+{
+  /**
+   * \brief User data that can be associated with a bitmap allocation.
+   **/
+  class bitmap_gc_user_data_t
+  {
+  public:
+    auto gc_user_data_ref() noexcept -> gc_user_data_t &
+    {
+      return m_gc_user_data;
+    }
+    auto gc_user_data_ref() const noexcept -> const gc_user_data_t &
+    {
+      return m_gc_user_data;
+    }
+
+    auto atomic() const noexcept -> bool
+    {
+      return m_atomic;
+    }
+    void set_atomic(bool atomic) noexcept
+    {
+      m_atomic = atomic;
+    }
+    auto abort_on_collect() const noexcept -> bool
+    {
+      return m_abort_on_collect;
+    }
+    void set_abort_on_collect(bool abort_on_collect) noexcept
+    {
+      m_abort_on_collect = abort_on_collect;
+    }
+
+  private:
+    gc_user_data_t m_gc_user_data;
+    bool m_atomic{false};
+    bool m_abort_on_collect{false};
+  };
+  /**
+   * \brief Side table of user data for bitmap allocations, keyed by object start.
+   *
+   * Entries only exist for objects that had a finalizer or abort on collect set, so plain objects carry no user data.
+   * Every object with an entry has its finalizeable user bit set, so sweeping finds and removes it.
+   **/
+  class bitmap_user_data_table_t
+  {
+  public:
+    using user_data_type = bitmap_gc_user_data_t;
+    bitmap_user_data_table_t() = default;
+    bitmap_user_data_table_t(const bitmap_user_data_table_t &) = delete;
+    bitmap_user_data_table_t(bitmap_user_data_table_t &&) = delete;
+    bitmap_user_data_table_t &operator=(const bitmap_user_data_table_t &) = delete;
+    bitmap_user_data_table_t &operator=(bitmap_user_data_table_t &&) = delete;
+    ~bitmap_user_data_table_t() = default;
+    /**
+     * \brief Return user data of object or nullptr if it has none.
+     *
+     * The returned pointer stays valid until the entry is erased.
+     **/
+    auto find(void *object) -> user_data_type * REQUIRES(!m_mutex);
+    /**
+     * \brief Return user data of object, creating a default entry if it has none.
+     **/
+    auto find_or_create(void *object) -> user_data_type & REQUIRES(!m_mutex);
+    /**
+     * \brief Remove user data of object and return it.
+     *
+     * @return Default user data if object had none.
+     **/
+    auto take(void *object) -> user_data_type REQUIRES(!m_mutex);
+    /**
+     * \brief Return true if no object has user data.
+     *
+     * Lets hot paths skip locking.
+     **/
+    bool empty() const noexcept;
+    /**
+     * \brief Return number of objects with user data.
+     **/
+    auto size() const noexcept -> size_t;
+
+  private:
+    using map_type = ::std::unordered_map<void *,
+                                          user_data_type,
+                                          ::std::hash<void *>,
+                                          ::std::equal_to<void *>,
+                                          cgc_internal_allocator_t<::std::pair<void *const, user_data_type>>>;
+    /**
+     * \brief Mutex protecting entries.
+     **/
+    mutable ::mcpputil::mutex_t m_mutex;
+    /**
+     * \brief User data by object start, nodes never move so pointers to values are stable.
+     **/
+    map_type m_entries GUARDED_BY(m_mutex);
+    /**
+     * \brief Number of entries, readable without the mutex.
+     **/
+    ::std::atomic<size_t> m_size{0};
+  };
+}
@@ -0,0 +1,28 @@
+#include "cpu_features.hpp"
+#include <cstdlib>
+namespace cgc1::details
+{
+  /**
+   * \brief Probe features of the running cpu.
+   **/
+  static cpu_features_t probe_cpu_features() noexcept
+  {
+    cpu_features_t ret;
+    if (::std::getenv("CGC1_DISABLE_SIMD") != nullptr) {
+      return ret;
+    }
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    ret.m_popcnt = __builtin_cpu_supports("popcnt");
+    ret.m_bmi1 = __builtin_cpu_supports("bmi");
+    ret.m_avx2 = __builtin_cpu_supports("avx2");
+    ret.m_avx512f = __builtin_cpu_supports("avx512f");
+#endif
+    return ret;
+  }
+  auto cpu_features() noexcept -> const cpu_features_t &
+  {
+    static const cpu_features_t s_features = probe_cpu_features();
+    return s_features;
+  }
+}
@@ -0,0 +1,19 @@
+#pragma once
+namespace cgc1::details
+{
+  /**
+   * \brief Instruction set extensions available on the running cpu.
+   **/
+  struct cpu_features_t {
+    bool m_popcnt{false};
+    bool m_bmi1{false};
+    bool m_avx2{false};
+    bool m_avx512f{false};
+  };
+  /**
+   * \brief Return features of the running cpu.
+   *
+   * Probed once, setting CGC1_DISABLE_SIMD in the environment reports no features.
+   **/
+  auto cpu_features() noexcept -> const cpu_features_t &;
+}
@@ -0,0 +1,128 @@
+#include "dirty_page_tracker.hpp"
+#include <algorithm>
+#include <array>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+namespace cgc1::details
+{
+#ifdef __linux__
+  /**
+   * \brief Bit set in a pagemap entry if the page was written since soft-dirty bits were cleared.
+   **/
+  static const constexpr uint64_t cs_pagemap_soft_dirty_bit = static_cast<uint64_t>(1) << 55;
+  /**
+   * \brief Clear soft-dirty bits of the whole process.
+   **/
+  static bool clear_soft_dirty() noexcept
+  {
+    const int fd = ::open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    const bool ret = ::write(fd, "4", 1) == 1;
+    ::close(fd);
+    return ret;
+  }
+  dirty_page_tracker_t::~dirty_page_tracker_t()
+  {
+    if (m_pagemap_fd >= 0) {
+      ::close(m_pagemap_fd);
+    }
+  }
+  /**
+   * \brief Return true if page containing addr is soft-dirty.
+   **/
+  static bool is_soft_dirty(int pagemap_fd, const volatile uint8_t *addr) noexcept
+  {
+    uint64_t entry = 0;
+    const auto psize = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const auto offset = static_cast<off_t>(reinterpret_cast<uintptr_t>(addr) / psize * sizeof(uint64_t));
+    if (::pread(pagemap_fd, &entry, sizeof(entry), offset) != static_cast<ssize_t>(sizeof(entry))) {
+      return false;
+    }
+    return (entry & cs_pagemap_soft_dirty_bit) != 0;
+  }
+  bool dirty_page_tracker_t::is_supported() noexcept
+  {
+    static const bool s_supported = []() {
+      const int fd = ::open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        return false;
+      }
+      // kernels without soft-dirty support accept clear_refs but never set the bit, so check a real write is seen.
+      alignas(64) static volatile uint8_t s_probe = 0;
+      s_probe = 1;
+      bool ret = clear_soft_dirty() && !is_soft_dirty(fd, &s_probe);
+      if (ret) {
+        s_probe = 2;
+        ret = is_soft_dirty(fd, &s_probe);
+      }
+      ::close(fd);
+      return ret;
+    }();
+    return s_supported;
+  }
+  size_t dirty_page_tracker_t::page_size() noexcept
+  {
+    static const size_t s_page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return s_page_size;
+  }
+  bool dirty_page_tracker_t::reset() noexcept
+  {
+    m_reset_valid = clear_soft_dirty();
+    return m_reset_valid;
+  }
+  bool dirty_page_tracker_t::collect_dirty_pages(uint8_t *begin, uint8_t *end, cgc_internal_vector_t<uint8_t *> &pages)
+  {
+    if (!m_reset_valid) {
+      return false;
+    }
+    if (m_pagemap_fd < 0) {
+      m_pagemap_fd = ::open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+      if (m_pagemap_fd < 0) {
+        return false;
+      }
+    }
+    const auto psize = page_size();
+    const auto first_page = reinterpret_cast<uintptr_t>(begin) / psize;
+    const auto last_page = (reinterpret_cast<uintptr_t>(end) + psize - 1) / psize;
+    // read pagemap in chunks to bound stack usage and syscalls.
+    ::std::array<uint64_t, 512> entries;
+    for (auto page = first_page; page < last_page;) {
+      const auto num_pages = ::std::min<uintptr_t>(entries.size(), last_page - page);
+      const auto num_bytes = static_cast<size_t>(num_pages * sizeof(uint64_t));
+      const auto offset = static_cast<off_t>(page * sizeof(uint64_t));
+      if (::pread(m_pagemap_fd, entries.data(), num_bytes, offset) != static_cast<ssize_t>(num_bytes)) {
+        return false;
+      }
+      for (size_t i = 0; i < num_pages; ++i) {
+        if (entries[i] & cs_pagemap_soft_dirty_bit) {
+          pages.push_back(reinterpret_cast<uint8_t *>((page + i) * psize));
+        }
+      }
+      page += num_pages;
+    }
+    return true;
+  }
+#else
+  dirty_page_tracker_t::~dirty_page_tracker_t() = default;
+  bool dirty_page_tracker_t::is_supported() noexcept
+  {
+    return false;
+  }
+  size_t dirty_page_tracker_t::page_size() noexcept
+  {
+    return 4096;
+  }
+  bool dirty_page_tracker_t::reset() noexcept
+  {
+    return false;
+  }
+  bool dirty_page_tracker_t::collect_dirty_pages(uint8_t *, uint8_t *, cgc_internal_vector_t<uint8_t *> &)
+  {
+    return false;
+  }
+#endif
+}
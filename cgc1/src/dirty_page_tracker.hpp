@@ -0,0 +1,55 @@
+#pragma once
+#include "internal_allocator.hpp"
+#include <cstddef>
+#include <cstdint>
+namespace cgc1::details
+{
+  /**
+   * \brief Track pages written since a point in time.
+   *
+   * On Linux this uses the kernel soft-dirty bit, so mutators need no write barrier.
+   * Elsewhere tracking is unsupported and callers must fall back to stopping the world.
+   **/
+  class dirty_page_tracker_t
+  {
+  public:
+    dirty_page_tracker_t() = default;
+    dirty_page_tracker_t(const dirty_page_tracker_t &) = delete;
+    dirty_page_tracker_t(dirty_page_tracker_t &&) = delete;
+    dirty_page_tracker_t &operator=(const dirty_page_tracker_t &) = delete;
+    dirty_page_tracker_t &operator=(dirty_page_tracker_t &&) = delete;
+    ~dirty_page_tracker_t();
+    /**
+     * \brief Return true if dirty page tracking works on this system.
+     *
+     * The result is probed once and cached.
+     **/
+    static bool is_supported() noexcept;
+    /**
+     * \brief Return size of a tracked page in bytes.
+     **/
+    static size_t page_size() noexcept;
+    /**
+     * \brief Mark every page of the process clean.
+     *
+     * @return False on failure, in which case collect_dirty_pages fails until the next successful reset.
+     **/
+    bool reset() noexcept;
+    /**
+     * \brief Append start of every page in [begin, end) written since last reset.
+     *
+     * @return False on failure, in which case the caller must assume every page is dirty.
+     **/
+    bool collect_dirty_pages(uint8_t *begin, uint8_t *end, cgc_internal_vector_t<uint8_t *> &pages);
+
+  private:
+    /**
+     * \brief Handle to /proc/self/pagemap.
+     **/
+    int m_pagemap_fd{-1};
+    /**
+     * \brief True if the last reset succeeded.
+     **/
+    bool m_reset_valid{false};
+  };
+}
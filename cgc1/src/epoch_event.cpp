@@ -0,0 +1,34 @@
+#include "epoch_event.hpp"
+#include <thread>
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+namespace cgc1::details
+{
+  static_assert(sizeof(::std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32 bit word");
+  auto epoch_event_t::epoch() const noexcept -> uint32_t
+  {
+    return m_epoch.load(::std::memory_order_acquire);
+  }
+  void epoch_event_t::wait(uint32_t epoch) const noexcept
+  {
+    while (m_epoch.load(::std::memory_order_acquire) == epoch) {
+#ifdef __linux__
+      // returns immediately if epoch already moved on, spurious and interrupted wakeups are rechecked by the loop.
+      ::syscall(SYS_futex, reinterpret_cast<const uint32_t *>(&m_epoch), FUTEX_WAIT_PRIVATE, epoch, nullptr, nullptr, 0);
+#else
+      ::std::this_thread::yield();
+#endif
+    }
+  }
+  void epoch_event_t::notify_all() noexcept
+  {
+    m_epoch.fetch_add(1, ::std::memory_order_acq_rel);
+#ifdef __linux__
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_epoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+namespace cgc1::details
+{
+  /**
+   * \brief Event that wakes every waiter at once by advancing an epoch.
+   *
+   * Waiters read the epoch before announcing they wait, so a notify can never be missed.
+   * Uses a futex on Linux, so waiting and waking do not take any locks and are safe in a signal handler.
+   **/
+  class epoch_event_t
+  {
+  public:
+    epoch_event_t() = default;
+    epoch_event_t(const epoch_event_t &) = delete;
+    epoch_event_t(epoch_event_t &&) = delete;
+    epoch_event_t &operator=(const epoch_event_t &) = delete;
+    epoch_event_t &operator=(epoch_event_t &&) = delete;
+    ~epoch_event_t() = default;
+    /**
+     * \brief Return current epoch.
+     **/
+    auto epoch() const noexcept -> uint32_t;
+    /**
+     * \brief Block until epoch is no longer the given epoch.
+     **/
+    void wait(uint32_t epoch) const noexcept;
+    /**
+     * \brief Advance epoch and wake up all waiters.
+     **/
+    void notify_all() noexcept;
+
+  private:
+    /**
+     * \brief Number of notifies, may wrap around.
+     **/
+    ::std::atomic<uint32_t> m_epoch{0};
+  };
+}
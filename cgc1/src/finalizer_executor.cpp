@@ -0,0 +1,146 @@
+#include "finalizer_executor.hpp"
+#include <algorithm>
+#include <cgc1/cgc1.hpp>
+#include <iostream>
+namespace cgc1::details
+{
+  /**
+   * \brief True on executor threads.
+   **/
+  static thread_local bool s_is_executor_thread = false;
+  finalizer_executor_t::~finalizer_executor_t()
+  {
+    if (running()) {
+      shutdown();
+    }
+  }
+  void finalizer_executor_t::start(size_t num_threads, size_t capacity)
+  {
+    if (num_threads == 0) {
+      return;
+    }
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_queue.clear();
+      m_queue.resize(::std::max(capacity, static_cast<size_t>(1)));
+      m_queue_head = 0;
+      m_queue_size = 0;
+      m_num_running = 0;
+      m_stats = cgc_finalizer_stats_t{};
+    }
+    m_run = true;
+    using thread_type = allocated_thread_t<cgc_internal_malloc_allocator_t<void>>;
+    m_threads.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      m_threads.emplace_back(thread_type::allocator{}, [this]() -> void * {
+        s_is_executor_thread = true;
+        cgc_register_thread(mcpputil_builtin_current_stack());
+        _run();
+        // also destroys the internal allocator state of this thread.
+        cgc_unregister_thread();
+        return nullptr;
+      });
+    }
+  }
+  void finalizer_executor_t::shutdown()
+  {
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_run = false;
+      m_task_available.notify_all();
+    }
+    for (auto &thread : m_threads) {
+      thread.join();
+    }
+    m_threads.clear();
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    m_idle.notify_all();
+  }
+  bool finalizer_executor_t::running() const noexcept
+  {
+    return m_run.load(::std::memory_order_acquire);
+  }
+  void finalizer_executor_t::submit(task_type task)
+  {
+    if (try_submit(::std::move(task))) {
+      return;
+    }
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      // waiting for room could deadlock if a queued finalizer needs a collection this thread is part of.
+      ++m_stats.m_num_submitted;
+      ++m_stats.m_num_run_inline;
+    }
+    _run_task(task);
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    ++m_stats.m_num_completed;
+  }
+  bool finalizer_executor_t::try_submit(task_type &&task)
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    if (!running() || m_queue_size == m_queue.size()) {
+      return false;
+    }
+    ++m_stats.m_num_submitted;
+    m_queue[(m_queue_head + m_queue_size) % m_queue.size()] = ::std::move(task);
+    ++m_queue_size;
+    m_stats.m_peak_queue_depth = ::std::max(m_stats.m_peak_queue_depth, m_queue_size);
+    m_task_available.notify_one();
+    return true;
+  }
+  void finalizer_executor_t::wait_until_idle()
+  {
+    if (is_executor_thread()) {
+      return;
+    }
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    m_idle.wait(m_mutex, [this]() -> bool { return m_queue_size == 0 && m_num_running == 0; });
+  }
+  bool finalizer_executor_t::is_executor_thread() noexcept
+  {
+    return s_is_executor_thread;
+  }
+  auto finalizer_executor_t::stats() const -> cgc_finalizer_stats_t
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    return m_stats;
+  }
+  void finalizer_executor_t::_run()
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    while (true) {
+      m_task_available.wait(m_mutex, [this]() -> bool { return !running() || m_queue_size != 0; });
+      // queued tasks still run during shutdown so no finalizer is lost.
+      if (m_queue_size == 0) {
+        return;
+      }
+      auto task = ::std::move(m_queue[m_queue_head]);
+      m_queue[m_queue_head] = nullptr;
+      m_queue_head = (m_queue_head + 1) % m_queue.size();
+      --m_queue_size;
+      ++m_num_running;
+      // do not hold mutex while running so producers can keep queueing.
+      m_mutex.unlock();
+      _run_task(task);
+      // release captured state before reporting idle.
+      task = nullptr;
+      m_mutex.lock();
+      --m_num_running;
+      ++m_stats.m_num_completed;
+      if (m_queue_size == 0 && m_num_running == 0) {
+        m_idle.notify_all();
+      }
+    }
+  }
+  void finalizer_executor_t::_run_task(task_type &task)
+  {
+    try {
+      task();
+    } catch (::std::exception &e) {
+      ::std::cerr << "CGC1: Finalizer exception: " << e.what();
+    } catch (...) {
+      ::std::cerr << "CGC1: Finalizer threw unknown exception: 0b7e1f4c-5d2a-4c8e-9a63-1f0e7d2b8c45";
+      ::std::terminate();
+    }
+  }
+}
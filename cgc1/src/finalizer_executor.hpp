@@ -0,0 +1,125 @@
+#pragma once
+#include "internal_allocator.hpp"
+#include <atomic>
+#include <cgc1/allocated_thread.hpp>
+#include <cgc1/cgc_internal_malloc_allocator.hpp>
+#include <cgc1/gc_stats.hpp>
+#include <functional>
+#include <mcpputil/mcpputil/concurrency.hpp>
+#include <vector>
+namespace cgc1::details
+{
+  /**
+   * \brief Threads that run finalizers outside of collections and away from user threads.
+   *
+   * Finalizer work goes to a bounded queue.
+   * Gc threads use try_submit and hand work that does not fit to user threads,
+   * since a finalizer that allocates may need a gc thread to finish before it can.
+   **/
+  class finalizer_executor_t
+  {
+  public:
+    using task_type = ::std::function<void()>;
+    finalizer_executor_t() = default;
+    finalizer_executor_t(const finalizer_executor_t &) = delete;
+    finalizer_executor_t(finalizer_executor_t &&) = delete;
+    finalizer_executor_t &operator=(const finalizer_executor_t &) = delete;
+    finalizer_executor_t &operator=(finalizer_executor_t &&) = delete;
+    ~finalizer_executor_t();
+    /**
+     * \brief Start executor threads.
+     *
+     * Threads register themselves with the gks.
+     * @param num_threads Number of executor threads.
+     * @param capacity Number of tasks that may wait in the queue.
+     **/
+    void start(size_t num_threads, size_t capacity) REQUIRES(!m_mutex);
+    /**
+     * \brief Run all queued tasks, then stop executor threads.
+     **/
+    void shutdown() REQUIRES(!m_mutex);
+    /**
+     * \brief Return true if executor threads are running.
+     **/
+    bool running() const noexcept;
+    /**
+     * \brief Queue task, or run it on this thread if the queue is full.
+     *
+     * Not for gc threads, which can not run finalizers.
+     **/
+    void submit(task_type task) REQUIRES(!m_mutex);
+    /**
+     * \brief Queue task if there is room.
+     *
+     * For work that must not run on the submitting thread.
+     * @return False if the executor is not running or the queue is full, task is then left untouched.
+     **/
+    bool try_submit(task_type &&task) REQUIRES(!m_mutex);
+    /**
+     * \brief Wait until no task is queued or running.
+     *
+     * Returns immediately on an executor thread, which would otherwise wait for itself.
+     **/
+    void wait_until_idle() REQUIRES(!m_mutex);
+    /**
+     * \brief Return true if the calling thread is an executor thread.
+     **/
+    static bool is_executor_thread() noexcept;
+    /**
+     * \brief Return queue statistics.
+     **/
+    auto stats() const -> cgc_finalizer_stats_t REQUIRES(!m_mutex);
+
+  private:
+    /**
+     * \brief Main loop of executor threads.
+     **/
+    void _run() REQUIRES(!m_mutex);
+    /**
+     * \brief Run task, reporting exceptions like bitmap finalization does.
+     **/
+    static void _run_task(task_type &task);
+    /**
+     * \brief Mutex for condition variables and protection.
+     **/
+    mutable ::mcpputil::mutex_t m_mutex;
+    /**
+     * \brief Variable for a task being queued or shutdown.
+     **/
+    condition_variable_any_t m_task_available;
+    /**
+     * \brief Variable for the executor becoming idle.
+     **/
+    condition_variable_any_t m_idle;
+    /**
+     * \brief Ring of queued tasks.
+     **/
+    ::std::vector<task_type, cgc_internal_malloc_allocator_t<task_type>> m_queue GUARDED_BY(m_mutex);
+    /**
+     * \brief Index of oldest queued task.
+     **/
+    size_t m_queue_head GUARDED_BY(m_mutex) = 0;
+    /**
+     * \brief Number of queued tasks.
+     **/
+    size_t m_queue_size GUARDED_BY(m_mutex) = 0;
+    /**
+     * \brief Number of tasks executor threads are running.
+     **/
+    size_t m_num_running GUARDED_BY(m_mutex) = 0;
+    /**
+     * \brief Statistics since start.
+     **/
+    cgc_finalizer_stats_t m_stats GUARDED_BY(m_mutex);
+    /**
+     * \brief Should the executor threads keep running.
+     **/
+    ::std::atomic<bool> m_run{false};
+    /**
+     * \brief Threads that tasks run in.
+     **/
+    ::std::vector<allocated_thread_t<cgc_internal_malloc_allocator_t<void>>,
+                  cgc_internal_malloc_allocator_t<allocated_thread_t<cgc_internal_malloc_allocator_t<void>>>>
+        m_threads;
+  };
+}
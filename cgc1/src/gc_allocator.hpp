@@ -68,6 +68,14 @@ namespace cgc1
      * \brief Type of object state for gc sparse allocator.
      **/
     using gc_sparse_object_state_t = gc_allocator_t::object_state_type;
+    /**
+     * \brief Distance from a sparse object state to the start of its object.
+     *
+     * Object states are padded to the minimum alignment so objects stay aligned.
+     **/
+    static const constexpr size_t cs_sparse_object_header_size =
+        (sizeof(gc_sparse_object_state_t) + gc_sparse_allocator_policy_t::cs_minimum_alignment - 1) &
+        ~(gc_sparse_allocator_policy_t::cs_minimum_alignment - 1);
     /**
      * \brief Return true if the object state is marked, false otherwise.
      **/
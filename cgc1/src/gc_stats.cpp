@@ -0,0 +1,189 @@
+#include "gc_stats.hpp"
+#include <cmath>
+#include <mcpputil/mcpputil/boost/property_tree/ptree.hpp>
+#include <string>
+namespace cgc1::details
+{
+  auto latency_histogram_t::bucket_index(uint64_t value) noexcept -> size_t
+  {
+    if (value < cs_sub_buckets) {
+      return static_cast<size_t>(value);
+    }
+#if defined(__GNUC__) || defined(__clang__)
+    const auto magnitude = static_cast<size_t>(63 - __builtin_clzll(value));
+#else
+    size_t magnitude = 0;
+    while (value >> (magnitude + 1)) {
+      ++magnitude;
+    }
+#endif
+    // shift so the value has cs_sub_bucket_bits significant bits with the top one set.
+    const auto shift = magnitude + 1 - cs_sub_bucket_bits;
+    const auto sub_bucket = static_cast<size_t>(value >> shift) - cs_half_sub_buckets;
+    return cs_sub_buckets + (shift - 1) * cs_half_sub_buckets + sub_bucket;
+  }
+  auto latency_histogram_t::bucket_upper_bound(size_t index) noexcept -> uint64_t
+  {
+    if (index < cs_sub_buckets) {
+      return index;
+    }
+    const auto shift = (index - cs_sub_buckets) / cs_half_sub_buckets + 1;
+    const auto sub_bucket = static_cast<uint64_t>((index - cs_sub_buckets) % cs_half_sub_buckets + cs_half_sub_buckets);
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+  void latency_histogram_t::record(uint64_t nanoseconds) noexcept
+  {
+    ++m_counts[bucket_index(nanoseconds)];
+    ++m_count;
+    m_max = ::std::max(m_max, nanoseconds);
+    m_sum += static_cast<double>(nanoseconds);
+  }
+  void latency_histogram_t::merge(const latency_histogram_t &other) noexcept
+  {
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+      m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_max = ::std::max(m_max, other.m_max);
+    m_sum += other.m_sum;
+  }
+  void latency_histogram_t::clear() noexcept
+  {
+    m_counts.fill(0);
+    m_count = 0;
+    m_max = 0;
+    m_sum = 0;
+  }
+  auto latency_histogram_t::count() const noexcept -> uint64_t
+  {
+    return m_count;
+  }
+  auto latency_histogram_t::max() const noexcept -> uint64_t
+  {
+    return m_max;
+  }
+  auto latency_histogram_t::mean() const noexcept -> double
+  {
+    return m_count ? m_sum / static_cast<double>(m_count) : 0;
+  }
+  auto latency_histogram_t::percentile(double q) const noexcept -> uint64_t
+  {
+    if (!m_count) {
+      return 0;
+    }
+    const auto target = ::std::max<uint64_t>(1, static_cast<uint64_t>(::std::ceil(q * static_cast<double>(m_count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < m_counts.size(); ++i) {
+      seen += m_counts[i];
+      if (seen >= target) {
+        return ::std::min(bucket_upper_bound(i), m_max);
+      }
+    }
+    return m_max;
+  }
+  void latency_histogram_t::summarize(cgc_phase_stats_t &stats) const noexcept
+  {
+    constexpr const double ns_to_s = 1e-9;
+    stats.m_count = static_cast<size_t>(m_count);
+    stats.m_mean = mean() * ns_to_s;
+    stats.m_p50 = static_cast<double>(percentile(0.5)) * ns_to_s;
+    stats.m_p99 = static_cast<double>(percentile(0.99)) * ns_to_s;
+    stats.m_p999 = static_cast<double>(percentile(0.999)) * ns_to_s;
+    stats.m_max = static_cast<double>(m_max) * ns_to_s;
+  }
+  gc_stats_t::gc_stats_t() : m_start_time(::std::chrono::steady_clock::now())
+  {
+  }
+  void gc_stats_t::record(gc_phase_t phase, duration_type duration)
+  {
+    const auto ns = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(duration).count();
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    m_histograms[static_cast<size_t>(phase)].record(static_cast<uint64_t>(::std::max<decltype(ns)>(ns, 0)));
+  }
+  void gc_stats_t::record(gc_phase_t phase, const latency_histogram_t &latencies)
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    m_histograms[static_cast<size_t>(phase)].merge(latencies);
+  }
+  void gc_stats_t::record_collection(size_t bytes_marked, size_t sparse_freed, size_t bitmap_freed, bool minor)
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    ++m_num_collections;
+    if (minor) {
+      ++m_num_minor_collections;
+    }
+    m_bytes_marked_last = bytes_marked;
+    m_bytes_marked_total += bytes_marked;
+    m_sparse_freed_last = sparse_freed;
+    m_sparse_freed_total += sparse_freed;
+    m_bitmap_freed_last = bitmap_freed;
+    m_bitmap_freed_total += bitmap_freed;
+  }
+  void gc_stats_t::add_lazy_bitmap_freed(size_t num_freed) noexcept
+  {
+    m_lazy_bitmap_freed.fetch_add(num_freed, ::std::memory_order_relaxed);
+  }
+  auto gc_stats_t::snapshot() const -> cgc_gc_stats_t
+  {
+    cgc_gc_stats_t ret;
+    const duration_type uptime = ::std::chrono::steady_clock::now() - m_start_time;
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    ret.m_num_collections = m_num_collections;
+    ret.m_num_minor_collections = m_num_minor_collections;
+    ret.m_collections_per_second = uptime.count() > 0 ? static_cast<double>(m_num_collections) / uptime.count() : 0;
+    m_histograms[static_cast<size_t>(gc_phase_t::time_to_safepoint)].summarize(ret.m_time_to_safepoint);
+    m_histograms[static_cast<size_t>(gc_phase_t::clear)].summarize(ret.m_clear);
+    m_histograms[static_cast<size_t>(gc_phase_t::mark)].summarize(ret.m_mark);
+    m_histograms[static_cast<size_t>(gc_phase_t::remark)].summarize(ret.m_remark);
+    m_histograms[static_cast<size_t>(gc_phase_t::sweep)].summarize(ret.m_sweep);
+    m_histograms[static_cast<size_t>(gc_phase_t::notify)].summarize(ret.m_notify);
+    m_histograms[static_cast<size_t>(gc_phase_t::total)].summarize(ret.m_total);
+    m_histograms[static_cast<size_t>(gc_phase_t::mark_slice)].summarize(ret.m_mark_slice);
+    ret.m_bytes_marked_last = m_bytes_marked_last;
+    ret.m_bytes_marked_total = m_bytes_marked_total;
+    ret.m_sparse_objects_freed_last = m_sparse_freed_last;
+    ret.m_sparse_objects_freed_total = m_sparse_freed_total;
+    ret.m_bitmap_objects_freed_last = m_bitmap_freed_last;
+    ret.m_bitmap_objects_freed_total = m_bitmap_freed_total + m_lazy_bitmap_freed.load(::std::memory_order_relaxed);
+    return ret;
+  }
+  /**
+   * \brief Put phase statistics into a property tree.
+   **/
+  static void phase_to_ptree(const cgc_phase_stats_t &stats, ::boost::property_tree::ptree &ptree)
+  {
+    ptree.put("count", ::std::to_string(stats.m_count));
+    ptree.put("mean", ::std::to_string(stats.m_mean));
+    ptree.put("p50", ::std::to_string(stats.m_p50));
+    ptree.put("p99", ::std::to_string(stats.m_p99));
+    ptree.put("p999", ::std::to_string(stats.m_p999));
+    ptree.put("max", ::std::to_string(stats.m_max));
+  }
+  void gc_stats_t::to_ptree(::boost::property_tree::ptree &ptree) const
+  {
+    const auto stats = snapshot();
+    ptree.put("num_collections", ::std::to_string(stats.m_num_collections));
+    ptree.put("num_minor_collections", ::std::to_string(stats.m_num_minor_collections));
+    ptree.put("collections_per_second", ::std::to_string(stats.m_collections_per_second));
+    const ::std::array<::std::pair<const char *, const cgc_phase_stats_t *>, 8> phases{
+        {{"time_to_safepoint", &stats.m_time_to_safepoint},
+         {"clear", &stats.m_clear},
+         {"mark", &stats.m_mark},
+         {"remark", &stats.m_remark},
+         {"sweep", &stats.m_sweep},
+         {"notify", &stats.m_notify},
+         {"total", &stats.m_total},
+         {"mark_slice", &stats.m_mark_slice}}};
+    for (auto &&phase : phases) {
+      ::boost::property_tree::ptree child;
+      phase_to_ptree(*phase.second, child);
+      ptree.put_child(phase.first, child);
+    }
+    ptree.put("bytes_marked_last", ::std::to_string(stats.m_bytes_marked_last));
+    ptree.put("bytes_marked_total", ::std::to_string(stats.m_bytes_marked_total));
+    ptree.put("sparse_objects_freed_last", ::std::to_string(stats.m_sparse_objects_freed_last));
+    ptree.put("sparse_objects_freed_total", ::std::to_string(stats.m_sparse_objects_freed_total));
+    ptree.put("bitmap_objects_freed_last", ::std::to_string(stats.m_bitmap_objects_freed_last));
+    ptree.put("bitmap_objects_freed_total", ::std::to_string(stats.m_bitmap_objects_freed_total));
+  }
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <boost/property_tree/ptree_fwd.hpp>
+#include <cgc1/gc_stats.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mcpputil/mcpputil/concurrency.hpp>
+namespace cgc1::details
+{
+  /**
+   * \brief Log linear histogram of nanosecond latencies in the style of HdrHistogram.
+   *
+   * Every power of two range is split in cs_sub_buckets, so percentiles are within about 3%.
+   * Fixed size, recording never allocates.
+   **/
+  class latency_histogram_t
+  {
+  public:
+    /**
+     * \brief Record a latency.
+     **/
+    void record(uint64_t nanoseconds) noexcept;
+    /**
+     * \brief Add all values recorded in other.
+     **/
+    void merge(const latency_histogram_t &other) noexcept;
+    /**
+     * \brief Forget all recorded values.
+     **/
+    void clear() noexcept;
+    /**
+     * \brief Return number of recorded values.
+     **/
+    auto count() const noexcept -> uint64_t;
+    /**
+     * \brief Return largest recorded value.
+     **/
+    auto max() const noexcept -> uint64_t;
+    /**
+     * \brief Return mean of recorded values.
+     **/
+    auto mean() const noexcept -> double;
+    /**
+     * \brief Return value at or below which fraction q of recorded values fall.
+     **/
+    auto percentile(double q) const noexcept -> uint64_t;
+    /**
+     * \brief Put summary in seconds into stats.
+     **/
+    void summarize(cgc_phase_stats_t &stats) const noexcept;
+
+  private:
+    static constexpr const size_t cs_sub_bucket_bits = 6;
+    static constexpr const size_t cs_sub_buckets = static_cast<size_t>(1) << cs_sub_bucket_bits;
+    static constexpr const size_t cs_half_sub_buckets = cs_sub_buckets / 2;
+    static constexpr const size_t cs_num_buckets = cs_sub_buckets + (64 - cs_sub_bucket_bits) * cs_half_sub_buckets;
+    /**
+     * \brief Return bucket of value.
+     **/
+    static auto bucket_index(uint64_t value) noexcept -> size_t;
+    /**
+     * \brief Return largest value that maps to bucket index.
+     **/
+    static auto bucket_upper_bound(size_t index) noexcept -> uint64_t;
+    ::std::array<uint64_t, cs_num_buckets> m_counts{};
+    uint64_t m_count{0};
+    uint64_t m_max{0};
+    double m_sum{0};
+  };
+  /**
+   * \brief Phases with a latency histogram.
+   **/
+  enum class gc_phase_t : size_t { time_to_safepoint, clear, mark, remark, sweep, notify, total, mark_slice, num_phases };
+  /**
+   * \brief Statistics about all collections.
+   *
+   * Written by the collecting thread and by mutators running mark slices, readable from any thread.
+   **/
+  class gc_stats_t
+  {
+  public:
+    using duration_type = ::std::chrono::duration<double>;
+    gc_stats_t();
+    gc_stats_t(const gc_stats_t &) = delete;
+    gc_stats_t(gc_stats_t &&) = delete;
+    gc_stats_t &operator=(const gc_stats_t &) = delete;
+    gc_stats_t &operator=(gc_stats_t &&) = delete;
+    ~gc_stats_t() = default;
+    /**
+     * \brief Record latency of a phase.
+     **/
+    void record(gc_phase_t phase, duration_type duration) REQUIRES(!m_mutex);
+    /**
+     * \brief Record latencies of a phase that were collected elsewhere.
+     **/
+    void record(gc_phase_t phase, const latency_histogram_t &latencies) REQUIRES(!m_mutex);
+    /**
+     * \brief Record totals of a finished collection.
+     *
+     * @param minor True if only the young generation was collected.
+     **/
+    void record_collection(size_t bytes_marked, size_t sparse_freed, size_t bitmap_freed, bool minor) REQUIRES(!m_mutex);
+    /**
+     * \brief Record bitmap objects freed by lazy sweeping.
+     **/
+    void add_lazy_bitmap_freed(size_t num_freed) noexcept;
+    /**
+     * \brief Return a consistent copy of all statistics.
+     **/
+    auto snapshot() const -> cgc_gc_stats_t REQUIRES(!m_mutex);
+    /**
+     * \brief Put statistics into a property tree.
+     **/
+    void to_ptree(::boost::property_tree::ptree &ptree) const REQUIRES(!m_mutex);
+
+  private:
+    mutable ::mcpputil::spinlock_t m_mutex;
+    ::std::array<latency_histogram_t, static_cast<size_t>(gc_phase_t::num_phases)> m_histograms GUARDED_BY(m_mutex);
+    size_t m_num_collections GUARDED_BY(m_mutex) = 0;
+    size_t m_num_minor_collections GUARDED_BY(m_mutex) = 0;
+    size_t m_bytes_marked_last GUARDED_BY(m_mutex) = 0;
+    size_t m_bytes_marked_total GUARDED_BY(m_mutex) = 0;
+    size_t m_sparse_freed_last GUARDED_BY(m_mutex) = 0;
+    size_t m_sparse_freed_total GUARDED_BY(m_mutex) = 0;
+    size_t m_bitmap_freed_last GUARDED_BY(m_mutex) = 0;
+    size_t m_bitmap_freed_total GUARDED_BY(m_mutex) = 0;
+    /**
+     * \brief Bitmap objects freed by mutators, kept apart so mutators never take the mutex.
+     **/
+    ::std::atomic<size_t> m_lazy_bitmap_freed{0};
+    /**
+     * \brief Time stats started, used for collection rate.
+     **/
+    const ::std::chrono::steady_clock::time_point m_start_time;
+  };
+}
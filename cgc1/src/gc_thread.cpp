@@ -1,6 +1,12 @@
 #include "gc_thread.hpp"
+#include "bitmap_finalization.hpp"
+#include "bitmap_gc_user_data.hpp"
+#include "dirty_page_tracker.hpp"
 #include "global_kernel_state.hpp"
+#include "numa.hpp"
+#include "sparse_finalization.hpp"
 #include "thread_local_kernel_state.hpp"
+#include <algorithm>
 #include <cgc1/hide_pointer.hpp>
 #include <mcpputil/mcpputil/algorithm.hpp>
 #ifdef _WIN32
@@ -15,7 +21,18 @@ namespace cgc1
   namespace details
   {
     using ::mcpputil::unsafe_reference_cast;
-    gc_thread_t::gc_thread_t()
+    /**
+     * \brief Hint that addr will be read soon.
+     **/
+    static inline void prefetch_for_mark(const void *addr) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+      __builtin_prefetch(addr, 0, 3);
+#else
+      (void)addr;
+#endif
+    }
+    gc_thread_t::gc_thread_t(size_t mark_stack_size) : m_mark_stack(mark_stack_size)
     {
       // tell thread to run.
       m_run = true;
@@ -48,8 +65,15 @@ namespace cgc1
       m_thread.join();
       MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
       ::mcpputil::clear_capacity(m_addresses_to_mark);
+      ::mcpputil::clear_capacity(m_mark_stack_overflow);
+      ::mcpputil::clear_capacity(m_deferred_addresses);
       ::mcpputil::clear_capacity(m_stack_roots);
       ::mcpputil::clear_capacity(m_watched_threads);
+      ::mcpputil::clear_capacity(m_bitmap_states_to_finalize);
+      ::mcpputil::clear_capacity(m_bitmap_states_to_lazy_sweep);
+      ::mcpputil::clear_capacity(m_to_be_freed_block_ends);
+      ::mcpputil::clear_capacity(m_destroy_batch);
+      ::mcpputil::clear_capacity(m_deferred_finalizers);
     }
     void gc_thread_t::reset()
     {
@@ -63,9 +87,33 @@ namespace cgc1
       m_do_mark = false;
       m_do_sweep = false;
       m_do_all_threads_resumed = false;
+      m_roots_done = false;
+      m_do_remark = false;
+      m_do_mark_slice = false;
+      m_mark_slice_done = false;
+      m_mark_slice_budget = ::std::chrono::microseconds::zero();
+      m_mark_slice_work = 0;
+      m_remark_done = false;
+      m_concurrent_mark = false;
+      m_in_concurrent_mark = false;
+      m_minor_collection = false;
+      m_sticky_mark_bits = false;
+      m_young_bitmap_states = {};
+      m_dirty_pages = {};
+      m_pending_finalization = {};
       m_block_begin = m_block_end = nullptr;
       m_root_begin = m_root_end = nullptr;
+      m_bitmap_states = {};
+      m_lazy_sweep = false;
+      m_lazy_sweep_leftovers = {};
+      m_bitmap_states_to_finalize.clear();
+      m_bitmap_states_to_lazy_sweep.clear();
+      m_bytes_marked = 0;
+      m_bitmap_objects_freed = 0;
       m_addresses_to_mark.clear();
+      m_mark_stack.clear();
+      m_mark_stack_overflow.clear();
+      m_deferred_addresses.clear();
       m_stack_roots.clear();
       m_watched_threads.clear();
     }
@@ -74,10 +122,19 @@ namespace cgc1
       MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
       m_wake_up.notify_all();
     }
-    void gc_thread_t::add_thread(::std::thread::id id)
+    void gc_thread_t::add_thread(thread_local_kernel_state_t *tlks)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      ::mcpputil::insert_unique_sorted(m_watched_threads, tlks, ::std::less<>());
+    }
+    void gc_thread_t::clear_threads()
     {
       MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
-      ::mcpputil::insert_unique_sorted(m_watched_threads, id, ::std::less<::std::thread::id>());
+      m_watched_threads.clear();
+    }
+    bool gc_thread_t::pin_to_numa_node(size_t index)
+    {
+      return numa_topology().pin_thread(m_thread.native_handle(), index);
     }
     void gc_thread_t::set_allocator_blocks(gc_allocator_t::this_allocator_block_handle_t *begin,
                                            gc_allocator_t::this_allocator_block_handle_t *end)
@@ -92,11 +149,67 @@ namespace cgc1
       m_root_begin = begin;
       m_root_end = end;
     }
+    void gc_thread_t::set_bitmap_states(::gsl::span<bitmap_state_type *> states)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_bitmap_states = states;
+    }
+    void gc_thread_t::set_bitmap_sweep_policy(bool lazy_sweep, ::gsl::span<bitmap_state_type *const> leftovers)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_lazy_sweep = lazy_sweep;
+      m_lazy_sweep_leftovers = leftovers;
+    }
+    auto gc_thread_t::_bitmap_states_to_finalize() const noexcept -> const cgc_internal_vector_t<bitmap_state_type *> &
+    {
+      return m_bitmap_states_to_finalize;
+    }
+    auto gc_thread_t::_bitmap_states_to_lazy_sweep() const noexcept -> const cgc_internal_vector_t<bitmap_state_type *> &
+    {
+      return m_bitmap_states_to_lazy_sweep;
+    }
+    auto gc_thread_t::bytes_marked() const noexcept -> size_t
+    {
+      return m_bytes_marked;
+    }
+    auto gc_thread_t::bitmap_objects_freed() const noexcept -> size_t
+    {
+      return m_bitmap_objects_freed;
+    }
     void gc_thread_t::set_root_ranges(::gsl::span<mcpputil::system_memory_range_t> ranges)
     {
       MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
       m_root_ranges = ranges;
     }
+    void gc_thread_t::set_parallel_mark_state(parallel_mark_state_t *state)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_parallel_mark_state = state;
+      m_parallel_mark_index = state->register_deque(&m_mark_stack);
+    }
+    void gc_thread_t::set_concurrent_mark(bool concurrent)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_concurrent_mark = concurrent;
+    }
+    void gc_thread_t::set_dirty_pages(::gsl::span<uint8_t *> pages)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_dirty_pages = pages;
+    }
+    void gc_thread_t::set_pending_finalization(::gsl::span<void *const> objects)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_pending_finalization = objects;
+    }
+    void gc_thread_t::set_minor_collection(bool minor, bool sticky_mark_bits,
+                                           ::gsl::span<bitmap_state_type *const> young_states)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_minor_collection = minor;
+      m_sticky_mark_bits = minor && sticky_mark_bits;
+      m_young_bitmap_states = young_states;
+    }
     void gc_thread_t::_run()
     {
       while (m_run) {
@@ -117,10 +230,38 @@ namespace cgc1
         m_start_mark.wait(m_mutex, [this]() -> bool { return m_do_mark; });
         ::std::atomic_thread_fence(::std::memory_order_acq_rel);
         m_do_mark = false;
-        _mark();
-        ::std::atomic_thread_fence(::std::memory_order_acq_rel);
-        m_mark_done = true;
-        m_done_mark.notify_all();
+        if (m_concurrent_mark) {
+          // only stacks need the world stopped.
+          _mark_thread_roots();
+          ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+          m_roots_done = true;
+          m_done_roots.notify_all();
+          // trace while mutators run.
+          m_in_concurrent_mark = true;
+          if (m_mark_slice_budget != ::std::chrono::microseconds::zero()) {
+            // sliced tracing only runs when given a slice.
+            _wait_for_mark_slice();
+          }
+          _trace();
+          m_in_concurrent_mark = false;
+          ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+          m_mark_done = true;
+          m_done_mark.notify_all();
+          m_done_mark_slice.notify_all();
+          // wait for world to be stopped again.
+          m_start_remark.wait(m_mutex, [this]() -> bool { return m_do_remark; });
+          ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+          m_do_remark = false;
+          _remark();
+          ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+          m_remark_done = true;
+          m_done_remark.notify_all();
+        } else {
+          _mark();
+          ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+          m_mark_done = true;
+          m_done_mark.notify_all();
+        }
         // wait to start sweeping
         m_start_sweep.wait(m_mutex, [this]() -> bool { return m_do_sweep; });
         m_do_sweep = false;
@@ -158,6 +299,45 @@ namespace cgc1
       ::std::unique_lock<decltype(m_mutex)> l(m_mutex);
       m_done_mark.wait(l, [this]() -> bool { return m_mark_done; });
     }
+    void gc_thread_t::wait_until_roots_finished()
+    {
+      // the gc thread keeps its mutex while tracing, so wait on the flag alone.
+      while (!m_roots_done.load(::std::memory_order_acquire)) {
+        ::std::this_thread::yield();
+      }
+    }
+    bool gc_thread_t::mark_finished() const noexcept
+    {
+      return m_mark_done;
+    }
+    void gc_thread_t::set_mark_slice_budget(::std::chrono::microseconds budget)
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_mark_slice_budget = budget;
+    }
+    void gc_thread_t::start_mark_slice()
+    {
+      // the gc thread only releases its mutex between slices.
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      m_mark_slice_done = false;
+      m_do_mark_slice = true;
+      m_start_mark_slice.notify_all();
+    }
+    void gc_thread_t::wait_until_mark_slice_finished()
+    {
+      ::std::unique_lock<decltype(m_mutex)> l(m_mutex);
+      m_done_mark_slice.wait(l, [this]() -> bool { return m_mark_slice_done || m_mark_done; });
+    }
+    void gc_thread_t::start_remark()
+    {
+      m_do_remark = true;
+      m_start_remark.notify_all();
+    }
+    void gc_thread_t::wait_until_remark_finished()
+    {
+      ::std::unique_lock<decltype(m_mutex)> l(m_mutex);
+      m_done_remark.wait(l, [this]() -> bool { return m_remark_done; });
+    }
     void gc_thread_t::start_sweep()
     {
       m_do_sweep = true;
@@ -183,12 +363,8 @@ namespace cgc1
     {
       return m_finalization_done;
     }
-    bool gc_thread_t::handle_thread(::std::thread::id id)
+    void gc_thread_t::handle_thread(thread_local_kernel_state_t *tlks)
     {
-      thread_local_kernel_state_t *tlks = g_gks->tlks(id);
-      if (tlks == nullptr) {
-        return false;
-      }
       // this is during GC so the slab will not be changed so no locks for gks needed.
       MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->gc_allocator()._mutex());
       // add potential roots (ex: registers).
@@ -199,10 +375,13 @@ namespace cgc1
       tlks->scan_stack(m_stack_roots, g_gks->gc_allocator().underlying_memory().begin(), g_gks->gc_allocator()._u_current_end(),
                        g_gks->_bitmap_allocator().underlying_memory().begin(),
                        g_gks->_bitmap_allocator().underlying_memory().end());
-      return true;
     }
     void gc_thread_t::_clear_marks()
     {
+      if (m_sticky_mark_bits) {
+        // marks of survivors are what makes them old.
+        return;
+      }
       // clear marks for all objects in blocks.
       // hopefully this takes advantage of cache locality.
       for (auto it = m_block_begin; it != m_block_end; ++it) {
@@ -217,28 +396,233 @@ namespace cgc1
           clear_mark(&*os_it);
         }
       }
+      for (auto state : m_bitmap_states) {
+        state->clear_mark_bits();
+      }
     }
     void gc_thread_t::_mark()
+    {
+      _mark_thread_roots();
+      if (m_minor_collection) {
+        // old objects are not traced, so pointers they gained since the last collection must be found here.
+        for (auto page : m_dirty_pages) {
+          if (m_sticky_mark_bits) {
+            // old objects are exactly the marked ones.
+            _rescan_dirty_page(page);
+          } else {
+            _scan_remembered_page(page);
+          }
+        }
+      }
+      _trace();
+    }
+    void gc_thread_t::_mark_thread_roots()
     {
       // First do thread specific work.
       for (const auto &thread : m_watched_threads) {
         handle_thread(thread);
       }
-      // mark everything from stack.
+      // grey everything from stack.
       for (auto root : m_stack_roots) {
-        _mark_addrs(*unsafe_reference_cast<void **>(root), 0);
+        _mark_addrs(*unsafe_reference_cast<void **>(root));
+      }
+      // grey potential roots (ex: registers).
+      mcpputil::reverse_consume_for_each(m_addresses_to_mark, [&](void *addr) {
+        MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_mutex);
+        _mark_addrs(addr);
+      });
+      // finalizers not run yet still use their objects.
+      for (auto object : m_pending_finalization) {
+        _mark_addrs(object);
       }
+    }
+    void gc_thread_t::_trace()
+    {
+      // trace what is already grey first to keep mark stack small.
+      _drain_mark_stack();
       // mark all roots.
       for (auto it = m_root_begin; it != m_root_end; ++it) {
-        _mark_addrs(**it, 0);
+        _mark_addrs(**it);
+        _drain_mark_stack();
       }
       for (auto range : m_root_ranges) {
         for (auto it = range.begin(); it != range.end(); ++it) {
-          _mark_addrs(*reinterpret_cast<void **>(it), 0);
+          _mark_addrs(*reinterpret_cast<void **>(it));
         }
+        _drain_mark_stack();
       }
       // mark additional stuff.
       _mark_mark_vector();
+      // help other gc threads until everyone is done.
+      _steal_marks();
+    }
+    void gc_thread_t::_remark()
+    {
+      // stacks are rescanned from scratch.
+      m_stack_roots.clear();
+      // resolve interior pointers now that allocator metadata is frozen.
+      for (auto addr : m_deferred_addresses) {
+        _mark_addrs(addr);
+      }
+      m_deferred_addresses.clear();
+      for (auto page : m_dirty_pages) {
+        _rescan_dirty_page(page);
+      }
+      _mark();
+    }
+    void gc_thread_t::_rescan_dirty_page(uint8_t *page)
+    {
+      uint8_t *const page_end = page + dirty_page_tracker_t::page_size();
+      void *const fast_heap_begin = g_gks->_bitmap_allocator().underlying_memory().begin();
+      void *const fast_heap_end = g_gks->_bitmap_allocator().underlying_memory().end();
+      // only marked objects need rescanning, unmarked reachable objects are found through their referrers.
+      if (page >= fast_heap_begin && page < fast_heap_end) {
+        for (uint8_t *cur = page; cur < page_end;) {
+          const auto state = ::mcppalloc::bitmap_allocator::details::get_state(cur);
+          if (reinterpret_cast<uint8_t *>(state) < fast_heap_begin || !state->has_valid_magic_numbers() ||
+              state->addr_in_header(cur)) {
+            cur += sizeof(void *);
+            continue;
+          }
+          const auto index = state->get_index(cur);
+          if (mcpputil_unlikely(index == ::std::numeric_limits<size_t>::max())) {
+            cur += sizeof(void *);
+            continue;
+          }
+          uint8_t *const object_end = reinterpret_cast<uint8_t *>(state->get_object(index)) + state->real_entry_size();
+          uint8_t *const stop = ::std::min(object_end, page_end);
+          if (state->type_id() == cs_bitmap_allocation_type_typed && state->is_marked(index)) {
+            // pointer slots are only known for the whole object.
+            _scan_object(state->get_object(index));
+            cur = ::std::max(object_end, cur + sizeof(void *));
+            continue;
+          }
+          if (state->type_id() == cs_bitmap_allocation_type_user_data && state->is_marked(index)) {
+            for (void **it = reinterpret_cast<void **>(cur); it < reinterpret_cast<void **>(stop); ++it) {
+              _mark_addrs(*it);
+            }
+          }
+          cur = ::std::max(stop, cur + sizeof(void *));
+        }
+        return;
+      }
+      // This is called during garbage collection, therefore no mutex is needed.
+      MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->gc_allocator()._mutex());
+      MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->_mutex());
+      for (uint8_t *cur = page; cur < page_end;) {
+        gc_sparse_object_state_t *const os = g_gks->_u_find_valid_object_state(cur);
+        if (os == nullptr) {
+          cur += sizeof(void *);
+          continue;
+        }
+        uint8_t *const start = ::std::max(cur, reinterpret_cast<uint8_t *>(os->object_start()));
+        uint8_t *const stop = ::std::min(reinterpret_cast<uint8_t *>(os->object_end()), page_end);
+        const auto ud = static_cast<gc_user_data_t *>(os->user_data());
+        if (is_marked(os) && !is_atomic(os) && ud && ud->descriptor() != cs_conservative_descriptor) {
+          _scan_object(os->object_start());
+          cur = ::std::max(reinterpret_cast<uint8_t *>(os->object_end()), cur + sizeof(void *));
+          continue;
+        }
+        if (is_marked(os) && !is_atomic(os)) {
+          for (void **it = reinterpret_cast<void **>(start); it < reinterpret_cast<void **>(stop); ++it) {
+            _mark_addrs(*it);
+          }
+        }
+        cur = ::std::max(stop, cur + sizeof(void *));
+      }
+    }
+    void gc_thread_t::_scan_remembered_page(uint8_t *page)
+    {
+      uint8_t *const page_end = page + dirty_page_tracker_t::page_size();
+      void *const fast_heap_begin = g_gks->_bitmap_allocator().underlying_memory().begin();
+      void *const fast_heap_end = g_gks->_bitmap_allocator().underlying_memory().end();
+      if (page >= fast_heap_begin && page < fast_heap_end) {
+        for (uint8_t *cur = page; cur < page_end;) {
+          const auto state = ::mcppalloc::bitmap_allocator::details::get_state(cur);
+          if (reinterpret_cast<uint8_t *>(state) < fast_heap_begin || !state->has_valid_magic_numbers() ||
+              state->addr_in_header(cur)) {
+            cur += sizeof(void *);
+            continue;
+          }
+          const auto index = state->get_index(cur);
+          if (mcpputil_unlikely(index == ::std::numeric_limits<size_t>::max())) {
+            cur += sizeof(void *);
+            continue;
+          }
+          uint8_t *const object_end = reinterpret_cast<uint8_t *>(state->get_object(index)) + state->real_entry_size();
+          uint8_t *const stop = ::std::min(object_end, page_end);
+          // young objects are traced from their referrers.
+          if (!_is_young(state) && !state->is_free(index)) {
+            if (state->type_id() == cs_bitmap_allocation_type_typed) {
+              // pointer slots are only known for the whole object.
+              _scan_object(state->get_object(index));
+            } else if (state->type_id() == cs_bitmap_allocation_type_user_data) {
+              for (void **it = reinterpret_cast<void **>(cur); it < reinterpret_cast<void **>(stop); ++it) {
+                _mark_addrs(*it);
+              }
+            }
+          }
+          cur = ::std::max(stop, cur + sizeof(void *));
+        }
+        return;
+      }
+      // This is called during garbage collection, therefore no mutex is needed.
+      MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->gc_allocator()._mutex());
+      MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->_mutex());
+      for (uint8_t *cur = page; cur < page_end;) {
+        gc_sparse_object_state_t *const os = g_gks->_u_find_valid_object_state(cur);
+        if (os == nullptr) {
+          cur += sizeof(void *);
+          continue;
+        }
+        uint8_t *const start = ::std::max(cur, reinterpret_cast<uint8_t *>(os->object_start()));
+        uint8_t *const stop = ::std::min(reinterpret_cast<uint8_t *>(os->object_end()), page_end);
+        // the whole sparse heap is old.
+        if (os->in_use() && !os->quasi_freed() && !is_atomic(os)) {
+          const auto ud = static_cast<gc_user_data_t *>(os->user_data());
+          if (ud && ud->descriptor() != cs_conservative_descriptor) {
+            _scan_object(os->object_start());
+          } else {
+            for (void **it = reinterpret_cast<void **>(start); it < reinterpret_cast<void **>(stop); ++it) {
+              _mark_addrs(*it);
+            }
+          }
+        }
+        cur = ::std::max(stop, cur + sizeof(void *));
+      }
+    }
+    bool gc_thread_t::_is_young(const bitmap_state_type *state) const
+    {
+      return ::std::binary_search(m_young_bitmap_states.begin(), m_young_bitmap_states.end(), state);
+    }
+    bool gc_thread_t::_skips_old_objects() const
+    {
+      return m_minor_collection && !m_sticky_mark_bits;
+    }
+    bool gc_thread_t::_mark_slice_expired() const
+    {
+      return m_in_concurrent_mark && m_mark_slice_budget != ::std::chrono::microseconds::zero() &&
+             ::std::chrono::steady_clock::now() >= m_mark_slice_deadline;
+    }
+    void gc_thread_t::_poll_mark_slice()
+    {
+      // reading the clock per object would cost more than scanning most objects.
+      static constexpr const size_t cs_objects_per_check = 64;
+      if (mcpputil_likely(++m_mark_slice_work < cs_objects_per_check)) {
+        return;
+      }
+      m_mark_slice_work = 0;
+      if (_mark_slice_expired()) {
+        _wait_for_mark_slice();
+      }
+    }
+    void gc_thread_t::_wait_for_mark_slice()
+    {
+      m_mark_slice_done = true;
+      m_done_mark_slice.notify_all();
+      m_start_mark_slice.wait(m_mutex, [this]() -> bool { return m_do_mark_slice; });
+      m_do_mark_slice = false;
+      m_mark_slice_deadline = ::std::chrono::steady_clock::now() + m_mark_slice_budget;
     }
     int _is_bitmap_addr_markable(void *addr, bool do_mark, bool force_mark)
     {
@@ -268,39 +652,50 @@ namespace cgc1
       if (do_mark) {
         state->set_marked(index);
       }
-      if (state->type_id() != 2) {
+      if (state->type_id() != cs_bitmap_allocation_type_user_data && state->type_id() != cs_bitmap_allocation_type_typed) {
         // atomic, so done.
         return 7;
       }
       return 0;
     }
-    void gc_thread_t::_mark_addrs_bitmap(void *addr, size_t depth)
+    void gc_thread_t::_mark_addrs_bitmap(void *addr)
     {
-      if (depth > 300) {
-        // if recursion depth too big, put it on addresses to mark.
-        m_addresses_to_mark.insert(addr);
+      if (_skips_old_objects() && !_is_young(::mcppalloc::bitmap_allocator::details::get_state(addr))) {
+        // old objects are live until the next full collection.
         return;
       }
-      auto is_markable = _is_bitmap_addr_markable(addr, true, false);
-      if (is_markable != 0) {
+      int is_markable = 0;
+      if (m_parallel_mark_state && m_parallel_mark_state->is_parallel()) {
+        // mark bits share words between objects, so test and set under lock.
+        auto &mark_lock = m_parallel_mark_state->mark_lock(::mcppalloc::bitmap_allocator::details::get_state(addr));
+        MCPPALLOC_CONCURRENCY_LOCK_GUARD(mark_lock);
+        is_markable = _is_bitmap_addr_markable(addr, true, false);
+      } else {
+        is_markable = _is_bitmap_addr_markable(addr, true, false);
+      }
+      // 7 means newly marked but atomic.
+      if (is_markable != 0 && is_markable != 7) {
         return;
       }
       const auto state = ::mcppalloc::bitmap_allocator::details::get_state(addr);
-      const auto index = state->get_index(addr);
-      const auto start = state->get_object(index);
-      // recurse to pointers.
-      for (void **it = reinterpret_cast<void **>(start);
-           it != reinterpret_cast<void **>(reinterpret_cast<uint8_t *>(start) + state->real_entry_size()); ++it) {
-        _mark_addrs(*it, depth + 1);
+      m_bytes_marked += state->real_entry_size();
+      if (is_markable == 7) {
+        return;
       }
+      _push_grey(state->get_object(state->get_index(addr)));
     }
 
-    void gc_thread_t::_mark_addrs_sparse(void *addr, size_t depth)
+    void gc_thread_t::_mark_addrs_sparse(void *addr)
     {
       // This is calling during garbage collection, therefore no mutex is needed.
       MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->gc_allocator()._mutex());
       gc_sparse_object_state_t *os = gc_sparse_object_state_t::template from_object_start<gc_sparse_object_state_t>(addr);
       if (!g_gks->is_valid_object_state(os)) {
+        if (m_in_concurrent_mark) {
+          // finding the containing object walks blocks mutators may be changing.
+          m_deferred_addresses.push_back(addr);
+          return;
+        }
         // This is calling during garbage collection, therefore no mutex is needed.
         MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->_mutex());
         os = g_gks->_u_find_valid_object_state(addr);
@@ -312,50 +707,134 @@ namespace cgc1
       if (!os->in_use() || os->quasi_freed() || (os->next() == nullptr)) {
         return;
       }
-      if (is_marked(os)) {
+      // only the thread that sets the mark traces the object and counts its bytes.
+      const auto try_mark = [os]() -> bool {
+        if (is_marked(os)) {
+          return false;
+        }
+        set_mark(os);
+        return true;
+      };
+      bool newly_marked = false;
+      if (m_parallel_mark_state && m_parallel_mark_state->is_parallel()) {
+        // mark bit shares the header flags word, so test and set under lock.
+        auto &mark_lock = m_parallel_mark_state->mark_lock(os);
+        MCPPALLOC_CONCURRENCY_LOCK_GUARD(mark_lock);
+        newly_marked = try_mark();
+      } else {
+        newly_marked = try_mark();
+      }
+      if (!newly_marked) {
         return;
       }
-
+      m_bytes_marked += os->object_size();
       // if it is atomic we are done here.
       if (is_atomic(os)) {
-        set_mark(os);
         return;
       }
-      if (depth > 100) {
-        // if recursion depth too big, put it on addresses to mark.
-        m_addresses_to_mark.insert(addr);
-        return;
-      } // set it as marked.
-      set_mark(os);
-      // recurse to pointers.
-      for (void **it = reinterpret_cast<void **>(os->object_start()); it != reinterpret_cast<void **>(os->object_end()); ++it) {
-        _mark_addrs(*it, depth + 1);
-      }
+      _push_grey(os->object_start());
     }
-    void gc_thread_t::_mark_addrs(void *addr, size_t depth)
+    void gc_thread_t::_mark_addrs(void *addr)
     {
       // Find heap begin and end.
       void *fast_heap_begin = g_gks->_bitmap_allocator().underlying_memory().begin();
       void *fast_heap_end = g_gks->_bitmap_allocator().underlying_memory().end();
       if (addr >= fast_heap_begin && addr < fast_heap_end) {
-        _mark_addrs_bitmap(addr, depth);
+        _mark_addrs_bitmap(addr);
         return;
       }
       // This is calling during garbage collection, therefore no mutex is needed.
       MCPPALLOC_CONCURRENCY_LOCK_ASSUME(g_gks->gc_allocator()._mutex());
       gc_sparse_object_state_t *os = gc_sparse_object_state_t::template from_object_start<gc_sparse_object_state_t>(addr);
-      if (g_gks->gc_allocator()._u_current_range().contains(os)) {
-        _mark_addrs_sparse(addr, depth);
+      // the sparse heap is old, so minor collections without sticky mark bits never mark it.
+      if (!_skips_old_objects() && g_gks->gc_allocator()._u_current_range().contains(os)) {
+        _mark_addrs_sparse(addr);
         return;
       }
     }
+    void gc_thread_t::_push_grey(void *object_start)
+    {
+      // the object will be scanned soon, so start pulling it into cache.
+      prefetch_for_mark(object_start);
+      if (mcpputil_unlikely(!m_mark_stack.push(object_start))) {
+        m_mark_stack_overflow.push_back(object_start);
+      }
+    }
+    void gc_thread_t::_scan_object(void *object_start)
+    {
+      void *fast_heap_begin = g_gks->_bitmap_allocator().underlying_memory().begin();
+      void *fast_heap_end = g_gks->_bitmap_allocator().underlying_memory().end();
+      void **begin = reinterpret_cast<void **>(object_start);
+      void **end = nullptr;
+      cgc_descriptor_t descriptor = cs_conservative_descriptor;
+      if (object_start >= fast_heap_begin && object_start < fast_heap_end) {
+        const auto state = ::mcppalloc::bitmap_allocator::details::get_state(object_start);
+        end = reinterpret_cast<void **>(reinterpret_cast<uint8_t *>(object_start) + state->real_entry_size());
+        if (state->type_id() == cs_bitmap_allocation_type_typed) {
+          const auto descriptor_slot = bitmap_typed_descriptor(state, object_start);
+          descriptor = *descriptor_slot;
+          end = reinterpret_cast<void **>(descriptor_slot);
+        }
+      } else {
+        // only object starts are pushed, so the state lookup is exact.
+        gc_sparse_object_state_t *os =
+            gc_sparse_object_state_t::template from_object_start<gc_sparse_object_state_t>(object_start);
+        end = reinterpret_cast<void **>(os->object_end());
+        const auto ud = static_cast<gc_user_data_t *>(os->user_data());
+        if (ud) {
+          descriptor = ud->descriptor();
+        }
+      }
+      for_each_pointer_slot(descriptor, begin, end, [this](void **slot) {
+        MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_mutex);
+        _mark_addrs(*slot);
+      });
+    }
+    void gc_thread_t::_drain_mark_stack()
+    {
+      void *object_start = nullptr;
+      while (true) {
+        while (m_mark_stack.pop(object_start)) {
+          _scan_object(object_start);
+          _poll_mark_slice();
+        }
+        if (m_mark_stack_overflow.empty()) {
+          return;
+        }
+        // refill the mark stack from overflow so the work is visible to thieves again.
+        while (!m_mark_stack_overflow.empty() && m_mark_stack.push(m_mark_stack_overflow.back())) {
+          m_mark_stack_overflow.pop_back();
+        }
+      }
+    }
     void gc_thread_t::_mark_mark_vector()
     {
       // note we go from back to front because elements may be added during marking.
       mcpputil::reverse_consume_for_each(m_addresses_to_mark, [&](void *addr) {
         MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_mutex);
-        _mark_addrs(addr, 0);
+        _mark_addrs(addr);
       });
+      _drain_mark_stack();
+    }
+    void gc_thread_t::_steal_marks()
+    {
+      if (!m_parallel_mark_state) {
+        return;
+      }
+      void *object_start = nullptr;
+      // idle threads must not spin between slices either.
+      const auto idle = [this]() {
+        MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_mutex);
+        if (_mark_slice_expired()) {
+          _wait_for_mark_slice();
+        } else {
+          ::std::this_thread::yield();
+        }
+      };
+      while (m_parallel_mark_state->find_work(m_parallel_mark_index, object_start, idle)) {
+        _scan_object(object_start);
+        _drain_mark_stack();
+      }
     }
     void gc_thread_t::_sweep()
     {
@@ -403,44 +882,132 @@ namespace cgc1
             }
           }
         }
+        if (m_to_be_freed.size() != (m_to_be_freed_block_ends.empty() ? 0 : m_to_be_freed_block_ends.back())) {
+          m_to_be_freed_block_ends.push_back(m_to_be_freed.size());
+        }
       }
       g_gks->_add_num_freed_in_last_collection(num_freed);
+      _sweep_bitmap_states();
+    }
+    void gc_thread_t::_sweep_bitmap_states()
+    {
+      const bool defer = g_gks->_finalizer_executor().running();
+      for (auto state : m_bitmap_states) {
+        if (has_unmarked_finalizable(state)) {
+          if (!defer) {
+            // finalizers run on the collecting thread.
+            m_bitmap_states_to_finalize.push_back(state);
+            continue;
+          }
+          // finalizers run on finalizer threads after the pause, so the state sweeps like any other.
+          defer_finalizers(state, m_deferred_finalizers);
+        }
+        if (m_lazy_sweep &&
+            !::std::binary_search(m_lazy_sweep_leftovers.begin(), m_lazy_sweep_leftovers.end(), state)) {
+          m_bitmap_states_to_lazy_sweep.push_back(state);
+        } else {
+          m_bitmap_objects_freed += finalize(state);
+        }
+      }
     }
     void gc_thread_t::_finalize()
     {
+      // each batch holds the sparse allocator mutex, so mutators allocating after a collection only wait for one.
+      static constexpr const size_t cs_max_destroy_batch_size = 256;
       // debug info.
       // to be freed gets hidden pointers.
       cgc_internal_vector_t<uintptr_t> to_be_freed;
       cgc_internal_vector_t<typename gc_allocator_t::object_state_type *> special_finalization;
-      for (auto &os : m_to_be_freed) {
-        gc_user_data_t *ud = static_cast<gc_user_data_t *>(os->user_data());
-        if (ud != nullptr) {
-          if (ud->is_default()) {
-          } else {
-            // if it has a finalizer that can run in this thread, finalize.
-            if (ud->m_finalizer && ud->allow_arbitrary_finalizer_thread()) {
-              ud->m_finalizer(os->object_start());
+      size_t block_begin = 0;
+      for (auto block_end : m_to_be_freed_block_ends) {
+        for (size_t i = block_begin; i < block_end; ++i) {
+          auto os = m_to_be_freed[i];
+          gc_user_data_t *ud = static_cast<gc_user_data_t *>(os->user_data());
+          if (ud != nullptr) {
+            if (ud->is_default()) {
+            } else {
+              // if it has a finalizer that can run in this thread, finalize.
+              if (ud->m_finalizer && ud->allow_arbitrary_finalizer_thread()) {
+                ud->m_finalizer(os->object_start());
+                unique_ptr_allocated<gc_user_data_t, cgc_internal_allocator_t<void>> up(ud);
+              }
+              // if it has a thread restricted finalizer, push
+              else if (ud->m_finalizer) {
+                special_finalization.emplace_back(os);
+                // we do not want to zero memory etc so continue.
+                continue;
+              } // delete user data if not owned by block.
               unique_ptr_allocated<gc_user_data_t, cgc_internal_allocator_t<void>> up(ud);
             }
-            // if it has a thread restricted finalizer, push
-            else if (ud->m_finalizer) {
-              special_finalization.emplace_back(os);
-              // we do not want to zero memory etc so continue.
-              continue;
-            } // delete user data if not owned by block.
-            unique_ptr_allocated<gc_user_data_t, cgc_internal_allocator_t<void>> up(ud);
           }
+          assert(os->object_end() < g_gks->gc_allocator().underlying_memory().end());
+          ::mcpputil::secure_zero_stream(os->object_start(), os->object_size());
+          // add to list of objects to be freed.
+          to_be_freed.push_back(::mcpputil::hide_pointer(os->object_start()));
+        }
+        // destroy the memory of this block in allocator.
+        for (size_t i = block_begin; i < block_end; i += cs_max_destroy_batch_size) {
+          const auto batch_end = ::std::min(i + cs_max_destroy_batch_size, block_end);
+          m_destroy_batch.assign(m_to_be_freed.begin() + static_cast<ptrdiff_t>(i),
+                                 m_to_be_freed.begin() + static_cast<ptrdiff_t>(batch_end));
+          g_gks->gc_allocator().bulk_destroy_memory(m_destroy_batch);
+          m_destroy_batch.clear();
         }
-        assert(os->object_end() < g_gks->gc_allocator().underlying_memory().end());
-        ::mcpputil::secure_zero_stream(os->object_start(), os->object_size());
-        // add to list of objects to be freed.
-        to_be_freed.push_back(::mcpputil::hide_pointer(os->object_start()));
+        block_begin = block_end;
       }
+      m_to_be_freed.clear();
+      m_to_be_freed_block_ends.clear();
       // notify kernel that the memory was freed.
       g_gks->_add_freed_in_last_collection(to_be_freed);
-      g_gks->_add_need_special_finalizing_collection(special_finalization);
-      // destroy the memory in allocator.
-      g_gks->gc_allocator().bulk_destroy_memory(m_to_be_freed);
+      auto &executor = g_gks->_finalizer_executor();
+      if (!executor.running()) {
+        g_gks->_add_need_special_finalizing_collection(special_finalization);
+      } else if (!special_finalization.empty()) {
+        finalizer_executor_t::task_type task = [objects = special_finalization]() mutable {
+          auto freed = do_local_sparse_finalization(g_gks->gc_allocator(), objects);
+          g_gks->_add_freed_in_last_collection(freed);
+        };
+        // restricted finalizers must never run on this thread, so a full queue hands them back to user threads.
+        if (!executor.try_submit(::std::move(task))) {
+          g_gks->_add_need_special_finalizing_collection(special_finalization);
+        }
+      }
+      _submit_deferred_finalizers();
+    }
+    void gc_thread_t::_submit_deferred_finalizers()
+    {
+      // split so that finalizer threads share the work.
+      static constexpr const size_t cs_max_finalizer_task_size = 64;
+      if (m_deferred_finalizers.empty()) {
+        return;
+      }
+      auto &executor = g_gks->_finalizer_executor();
+      // objects must be kept alive until a finalizer or user thread runs their finalizers.
+      g_gks->_add_pending_finalization(m_deferred_finalizers);
+      // restricted finalizers get queue room first.
+      ::std::stable_partition(m_deferred_finalizers.begin(), m_deferred_finalizers.end(),
+                              [](const deferred_finalizer_t &deferred) { return !deferred.m_allow_arbitrary_thread; });
+      size_t i = 0;
+      while (i < m_deferred_finalizers.size()) {
+        const auto end = ::std::min(i + cs_max_finalizer_task_size, m_deferred_finalizers.size());
+        cgc_internal_vector_t<deferred_finalizer_t> task_finalizers(
+            m_deferred_finalizers.begin() + static_cast<ptrdiff_t>(i),
+            m_deferred_finalizers.begin() + static_cast<ptrdiff_t>(end));
+        finalizer_executor_t::task_type task = [finalizers = ::std::move(task_finalizers)]() mutable {
+          run_deferred_finalizers(finalizers);
+          g_gks->_remove_pending_finalization(finalizers);
+        };
+        // no finalizer may run on this thread, so once the queue is full the rest go to user threads.
+        if (!executor.try_submit(::std::move(task))) {
+          break;
+        }
+        i = end;
+      }
+      if (i < m_deferred_finalizers.size()) {
+        g_gks->_add_need_special_finalizing_bitmap(
+            ::gsl::span<deferred_finalizer_t>(m_deferred_finalizers).subspan(static_cast<ptrdiff_t>(i)));
+      }
+      m_deferred_finalizers.clear();
     }
   }
 }
@@ -1,11 +1,15 @@
 #pragma once
+#include "bitmap_finalization.hpp"
 #include "gc_allocator.hpp"
 #include "internal_allocator.hpp"
 #include "internal_declarations.hpp"
+#include "parallel_mark_state.hpp"
 #include <atomic>
+#include <chrono>
 #include <cgc1/allocated_thread.hpp>
 #include <cgc1/cgc_internal_malloc_allocator.hpp>
 #include <condition_variable>
+#include <mcppalloc/mcppalloc_bitmap_allocator/bitmap_state.hpp>
 #include <mcppalloc/mcppalloc_sparse/allocator.hpp>
 #include <mcpputil/mcpputil/boost/container/flat_set.hpp>
 #include <mcpputil/mcpputil/concurrency.hpp>
@@ -15,6 +19,7 @@ namespace cgc1
 {
   namespace details
   {
+    class thread_local_kernel_state_t;
     /**
      * \brief Internal thread that performs garbage collection.
      *
@@ -23,10 +28,13 @@ namespace cgc1
     class gc_thread_t
     {
     public:
+      using bitmap_state_type = ::mcppalloc::bitmap_allocator::details::bitmap_state_t;
       /**
        * \brief Constructor.
+       *
+       * @param mark_stack_size Number of grey objects the mark stack holds before overflowing.
        **/
-      gc_thread_t();
+      explicit gc_thread_t(size_t mark_stack_size = mark_deque_type::cs_default_capacity);
       gc_thread_t(const gc_thread_t &) = delete;
       gc_thread_t(gc_thread_t &&) = delete;
       gc_thread_t &operator=(const gc_thread_t &) = delete;
@@ -48,7 +56,19 @@ namespace cgc1
        *
        * This gets called every garbage collection cycle.
        **/
-      void add_thread(::std::thread::id id) REQUIRES(!m_mutex);
+      void add_thread(thread_local_kernel_state_t *tlks) REQUIRES(!m_mutex);
+      /**
+       * \brief Stop being responsible for any thread.
+       *
+       * Threads may have started or exited while marking concurrently, so remark assigns them again.
+       **/
+      void clear_threads() REQUIRES(!m_mutex);
+      /**
+       * \brief Run this thread only on cpus of NUMA node with index.
+       *
+       * @return False if the thread could not be pinned.
+       **/
+      bool pin_to_numa_node(size_t index);
       /**
        * \brief Set the allocator blocks that this thread is responsible for marking.
        **/
@@ -60,10 +80,80 @@ namespace cgc1
        * Note this takes a void***, that is an iterator to a pointer to an unknown memory location.
        **/
       void set_root_iterators(void ***begin, void ***end) REQUIRES(!m_mutex);
+      /**
+       * \brief Set the bitmap states that this thread is responsible for clearing and sweeping.
+       **/
+      void set_bitmap_states(::gsl::span<bitmap_state_type *> states) REQUIRES(!m_mutex);
+      /**
+       * \brief Set how bitmap states are swept.
+       *
+       * @param lazy_sweep If true, states that need no finalizers are left for mutators to sweep.
+       * @param leftovers States sorted by address that must be swept now even if lazy.
+       **/
+      void set_bitmap_sweep_policy(bool lazy_sweep, ::gsl::span<bitmap_state_type *const> leftovers) REQUIRES(!m_mutex);
+      /**
+       * \brief Return bitmap states with finalizers to run, found by last sweep.
+       *
+       * Only valid after sweep finished and before next reset.
+       **/
+      auto _bitmap_states_to_finalize() const noexcept -> const cgc_internal_vector_t<bitmap_state_type *> &;
+      /**
+       * \brief Return bitmap states left for mutators to sweep, found by last sweep.
+       *
+       * Only valid after sweep finished and before next reset.
+       **/
+      auto _bitmap_states_to_lazy_sweep() const noexcept -> const cgc_internal_vector_t<bitmap_state_type *> &;
+      /**
+       * \brief Return bytes of objects newly marked by this thread since reset.
+       *
+       * Only valid after mark finished.
+       **/
+      auto bytes_marked() const noexcept -> size_t;
+      /**
+       * \brief Return number of bitmap objects freed by this thread since reset.
+       *
+       * Only valid after sweep finished.
+       **/
+      auto bitmap_objects_freed() const noexcept -> size_t;
       /**
        * \brief Set the root ranges that this thread is responsible for marking.
        **/
       void set_root_ranges(::gsl::span<mcpputil::system_memory_range_t> ranges) REQUIRES(!m_mutex);
+      /**
+       * \brief Set state shared between gc threads for parallel marking.
+       *
+       * This registers the mark deque of this thread so that other gc threads may steal from it.
+       * Must be called once before first collection.
+       **/
+      void set_parallel_mark_state(parallel_mark_state_t *state) REQUIRES(!m_mutex);
+      /**
+       * \brief Set if the next mark phase runs concurrently with mutators.
+       *
+       * In concurrent mode the mark phase only snapshots stacks while the world is stopped,
+       * then traces while mutators run, and a later remark phase finishes marking.
+       **/
+      void set_concurrent_mark(bool concurrent) REQUIRES(!m_mutex);
+      /**
+       * \brief Set the pages written by mutators during concurrent marking that this thread rescans.
+       *
+       * In a minor collection these are the pages written since the last collection.
+       **/
+      void set_dirty_pages(::gsl::span<uint8_t *> pages) REQUIRES(!m_mutex);
+      /**
+       * \brief Set objects waiting for a finalizer thread that this thread keeps alive.
+       **/
+      void set_pending_finalization(::gsl::span<void *const> objects) REQUIRES(!m_mutex);
+      /**
+       * \brief Set if the next collection is minor.
+       *
+       * A minor collection only marks objects in young bitmap states, everything else is treated as live.
+       * Old objects on dirty pages are scanned as roots instead.
+       * With sticky mark bits marks are not cleared, marked objects are old and every unmarked object is young.
+       * @param sticky_mark_bits True if marks of survivors are kept.
+       * @param young_states All young bitmap states sorted by address, not just those of this thread.
+       **/
+      void set_minor_collection(bool minor, bool sticky_mark_bits, ::gsl::span<bitmap_state_type *const> young_states)
+          REQUIRES(!m_mutex);
       /**
        * \brief Wake up thread from sleeping.
        **/
@@ -84,6 +174,41 @@ namespace cgc1
        * \brief Wait until mark phase finished.
        **/
       void wait_until_mark_finished();
+      /**
+       * \brief Wait until stacks were snapshotted in concurrent mode.
+       *
+       * After this returns mutators may resume.
+       **/
+      void wait_until_roots_finished();
+      /**
+       * \brief Return true if the mark phase finished.
+       **/
+      bool mark_finished() const noexcept;
+      /**
+       * \brief Set how long each slice of concurrent tracing may run.
+       *
+       * Zero traces without stopping.
+       * Otherwise tracing only runs during slices started by start_mark_slice.
+       **/
+      void set_mark_slice_budget(::std::chrono::microseconds budget) REQUIRES(!m_mutex);
+      /**
+       * \brief Let concurrent tracing run for one slice.
+       **/
+      void start_mark_slice() REQUIRES(!m_mutex);
+      /**
+       * \brief Wait until the current slice ran out of budget or tracing finished.
+       *
+       * A slice ends at the first check after its budget ran out, so it may run a little longer.
+       **/
+      void wait_until_mark_slice_finished() REQUIRES(!m_mutex);
+      /**
+       * \brief Start remarking after concurrent mark.
+       **/
+      void start_remark();
+      /**
+       * \brief Wait until remark phase finished.
+       **/
+      void wait_until_remark_finished();
       /**
        * \brief Start sweeping.
        **/
@@ -111,7 +236,7 @@ namespace cgc1
        *
        * This handles stack/registers.
        **/
-      bool handle_thread(::std::thread::id id) REQUIRES(m_mutex);
+      void handle_thread(thread_local_kernel_state_t *tlks) REQUIRES(m_mutex);
       /**
        * \brief Inner thread loop.
        **/
@@ -124,35 +249,107 @@ namespace cgc1
        * \brief Mark all roots and additional vector of stuff to mark.
        **/
       void _mark() REQUIRES(m_mutex);
+      /**
+       * \brief Grey everything reachable from thread stacks and registers without tracing.
+       **/
+      void _mark_thread_roots() REQUIRES(m_mutex);
+      /**
+       * \brief Mark root collection and trace everything grey.
+       **/
+      void _trace() REQUIRES(m_mutex);
+      /**
+       * \brief Finish marking after concurrent mark while the world is stopped.
+       *
+       * Rescans roots, deferred addresses, and marked objects on dirty pages.
+       **/
+      void _remark() REQUIRES(m_mutex);
+      /**
+       * \brief Rescan marked objects on a page written during concurrent mark.
+       **/
+      void _rescan_dirty_page(uint8_t *page) REQUIRES(m_mutex);
+      /**
+       * \brief Scan old objects on a page written since the last collection for pointers to young objects.
+       **/
+      void _scan_remembered_page(uint8_t *page) REQUIRES(m_mutex);
+      /**
+       * \brief Return true if state is in the young generation of the current minor collection.
+       **/
+      bool _is_young(const bitmap_state_type *state) const REQUIRES(m_mutex);
+      /**
+       * \brief Return true if objects outside young bitmap states are neither marked nor swept.
+       **/
+      bool _skips_old_objects() const REQUIRES(m_mutex);
+      /**
+       * \brief Return true if tracing runs in slices and the current one is out of budget.
+       **/
+      bool _mark_slice_expired() const REQUIRES(m_mutex);
+      /**
+       * \brief Every few scanned objects, stop tracing if the current slice is out of budget.
+       **/
+      void _poll_mark_slice() REQUIRES(m_mutex);
+      /**
+       * \brief Report the current slice finished and wait for the next one.
+       **/
+      void _wait_for_mark_slice() REQUIRES(m_mutex);
       /**
        * \brief Mark a given address.
        *
+       * If the address is an unmarked object that may contain pointers it is pushed on the mark stack.
        * @param addr Address to mark.
-       * @param depth Current depth for controlling infinite recursion.
        **/
-      void _mark_addrs(void *addr, size_t depth) REQUIRES(m_mutex);
+      void _mark_addrs(void *addr) REQUIRES(m_mutex);
       /**
        * \brief Mark a given address that was allocated by sparse allocator.
        **/
-      void _mark_addrs_sparse(void *addr, size_t depth) REQUIRES(m_mutex);
+      void _mark_addrs_sparse(void *addr) REQUIRES(m_mutex);
       /**
        * \brief Mark a given address that was allocated by bitmap allocator.
        **/
-      void _mark_addrs_bitmap(void *addr, size_t depth) REQUIRES(m_mutex);
+      void _mark_addrs_bitmap(void *addr) REQUIRES(m_mutex);
       /**
-       * \brief Function called at end to mark any addresses that would have caused stack overflows.
+       * \brief Push a marked object that still needs scanning onto the mark stack.
        *
-       * This is how infinite recursion is prevented.
+       * Falls back to the overflow vector if the mark stack is full.
+       **/
+      void _push_grey(void *object_start) REQUIRES(m_mutex);
+      /**
+       * \brief Mark all pointers inside of a marked object.
+       **/
+      void _scan_object(void *object_start) REQUIRES(m_mutex);
+      /**
+       * \brief Scan objects on mark stack and overflow vector until both are empty.
+       **/
+      void _drain_mark_stack() REQUIRES(m_mutex);
+      /**
+       * \brief Mark potential roots found while handling threads and drain mark stack.
        **/
       void _mark_mark_vector() REQUIRES(m_mutex);
+      /**
+       * \brief Steal work from other gc threads until all gc threads are out of work.
+       **/
+      void _steal_marks() REQUIRES(m_mutex);
       /**
        * \brief Sweep for unaccessible memory.
        **/
       void _sweep() REQUIRES(m_mutex);
+      /**
+       * \brief Sweep bitmap states this thread is responsible for.
+       *
+       * States that would run finalizers are handed back to the collecting thread,
+       * unless finalizer threads run them, in which case their finalizers are taken and the states swept.
+       **/
+      void _sweep_bitmap_states() REQUIRES(m_mutex);
       /**
        * \brief Finalize sweeped objects.
+       *
+       * Objects are finalized and handed back to the sparse allocator one block at a time,
+       * so freed memory becomes available while later blocks are still being finalized.
        **/
       void _finalize() REQUIRES(m_mutex);
+      /**
+       * \brief Hand bitmap finalizers taken during sweep to finalizer threads, or to user threads if the queue is full.
+       **/
+      void _submit_deferred_finalizers() REQUIRES(m_mutex);
       /**
        * \brief Mutex for condition variables and protection.
        **/
@@ -160,7 +357,7 @@ namespace cgc1
       /**
        * \brief Vector of threads whose stack this thread is responsible for.
        **/
-      cgc_internal_vector_t<::std::thread::id> m_watched_threads GUARDED_BY(m_mutex);
+      cgc_internal_vector_t<thread_local_kernel_state_t *> m_watched_threads GUARDED_BY(m_mutex);
       /**
        * \brief Variable for waking up.
        **/
@@ -177,6 +374,18 @@ namespace cgc1
        * \brief Variable for done marking.
        **/
       condition_variable_any_t m_done_mark;
+      /**
+       * \brief Variable for done snapshotting roots.
+       **/
+      condition_variable_any_t m_done_roots;
+      /**
+       * \brief Variable for start remarking.
+       **/
+      condition_variable_any_t m_start_remark;
+      /**
+       * \brief Variable for done remarking.
+       **/
+      condition_variable_any_t m_done_remark;
       /**
        * \brief Variable for starting sweeping.
        **/
@@ -209,6 +418,56 @@ namespace cgc1
        * \brief State variables.
        **/
       ::std::atomic<bool> m_do_clear, m_do_mark, m_do_sweep, m_do_all_threads_resumed;
+      /**
+       * \brief Concurrent mark state variables.
+       **/
+      ::std::atomic<bool> m_roots_done, m_do_remark, m_remark_done;
+      /**
+       * \brief Incremental mark state variables.
+       **/
+      ::std::atomic<bool> m_do_mark_slice, m_mark_slice_done;
+      /**
+       * \brief Variable for starting a mark slice.
+       **/
+      condition_variable_any_t m_start_mark_slice;
+      /**
+       * \brief Variable for mark slice done.
+       **/
+      condition_variable_any_t m_done_mark_slice;
+      /**
+       * \brief How long each slice of concurrent tracing may run, zero if tracing is not sliced.
+       **/
+      ::std::chrono::microseconds m_mark_slice_budget GUARDED_BY(m_mutex){0};
+      /**
+       * \brief Time the current mark slice runs out of budget.
+       **/
+      ::std::chrono::steady_clock::time_point m_mark_slice_deadline GUARDED_BY(m_mutex);
+      /**
+       * \brief Objects scanned since the budget was last checked.
+       **/
+      size_t m_mark_slice_work GUARDED_BY(m_mutex) = 0;
+      /**
+       * \brief True if the current collection marks concurrently with mutators.
+       **/
+      bool m_concurrent_mark GUARDED_BY(m_mutex) = false;
+      /**
+       * \brief True while tracing with mutators running.
+       *
+       * Allocator metadata may change under us, so lookups that walk it are deferred.
+       **/
+      bool m_in_concurrent_mark GUARDED_BY(m_mutex) = false;
+      /**
+       * \brief True if the current collection is minor.
+       **/
+      bool m_minor_collection GUARDED_BY(m_mutex) = false;
+      /**
+       * \brief True if the current minor collection keeps marks of survivors.
+       **/
+      bool m_sticky_mark_bits GUARDED_BY(m_mutex) = false;
+      /**
+       * \brief Young bitmap states of the current minor collection sorted by address.
+       **/
+      ::gsl::span<bitmap_state_type *const> m_young_bitmap_states GUARDED_BY(m_mutex);
       /**
        * \brief Start block iterator.
        **/
@@ -230,10 +489,70 @@ namespace cgc1
        **/
       ::gsl::span<mcpputil::system_memory_range_t> m_root_ranges;
       /**
-       * \brief Hold addresses to mark that would have otherwise caused excessive recursion.
+       * \brief Bitmap states to clear and sweep.
+       **/
+      ::gsl::span<bitmap_state_type *> m_bitmap_states GUARDED_BY(m_mutex);
+      /**
+       * \brief True if bitmap states without finalizers are left for mutators to sweep.
+       **/
+      bool m_lazy_sweep GUARDED_BY(m_mutex) = false;
+      /**
+       * \brief States that must be swept now even when lazy, sorted by address.
+       **/
+      ::gsl::span<bitmap_state_type *const> m_lazy_sweep_leftovers GUARDED_BY(m_mutex);
+      /**
+       * \brief Bitmap states whose finalizers the collecting thread must run.
+       **/
+      cgc_internal_vector_t<bitmap_state_type *> m_bitmap_states_to_finalize;
+      /**
+       * \brief Bitmap states left for mutators to sweep.
+       **/
+      cgc_internal_vector_t<bitmap_state_type *> m_bitmap_states_to_lazy_sweep;
+      /**
+       * \brief Bytes of objects newly marked since reset.
+       **/
+      size_t m_bytes_marked{0};
+      /**
+       * \brief Bitmap objects freed since reset.
+       **/
+      size_t m_bitmap_objects_freed{0};
+      /**
+       * \brief Potential roots (ex: registers) to mark.
        **/
       ::boost::container::flat_set<void *, ::std::less<>, cgc_internal_malloc_allocator_t<void *>>
           m_addresses_to_mark GUARDED_BY(m_mutex);
+      /**
+       * \brief Marked objects whose contents still need to be scanned.
+       *
+       * Other gc threads may steal from it, so it is not guarded.
+       **/
+      mark_deque_type m_mark_stack;
+      /**
+       * \brief Marked objects that did not fit in the mark stack.
+       **/
+      cgc_internal_vector_t<void *> m_mark_stack_overflow GUARDED_BY(m_mutex);
+      /**
+       * \brief Interior pointers into sparse heap found during concurrent mark.
+       *
+       * Resolving these walks allocator blocks, so it is deferred to remark.
+       **/
+      cgc_internal_vector_t<void *> m_deferred_addresses GUARDED_BY(m_mutex);
+      /**
+       * \brief Pages written during concurrent mark that this thread rescans.
+       **/
+      ::gsl::span<uint8_t *> m_dirty_pages GUARDED_BY(m_mutex);
+      /**
+       * \brief Objects waiting for a finalizer thread that this thread marks with roots.
+       **/
+      ::gsl::span<void *const> m_pending_finalization GUARDED_BY(m_mutex);
+      /**
+       * \brief State shared between gc threads for parallel marking.
+       **/
+      parallel_mark_state_t *m_parallel_mark_state{nullptr};
+      /**
+       * \brief Index of this thread in parallel mark state.
+       **/
+      size_t m_parallel_mark_index{0};
       /**
        * \brief Roots from stack.
        **/
@@ -242,6 +561,18 @@ namespace cgc1
        * \brief List of objects to be freed.
        **/
       cgc_internal_vector_t<gc_sparse_object_state_t *> m_to_be_freed GUARDED_BY(m_mutex);
+      /**
+       * \brief End index in m_to_be_freed of the objects of each swept block.
+       **/
+      cgc_internal_vector_t<size_t> m_to_be_freed_block_ends GUARDED_BY(m_mutex);
+      /**
+       * \brief Objects currently being handed back to the sparse allocator.
+       **/
+      cgc_internal_vector_t<gc_sparse_object_state_t *> m_destroy_batch GUARDED_BY(m_mutex);
+      /**
+       * \brief Bitmap finalizers taken during sweep that finalizer threads run after the collection.
+       **/
+      cgc_internal_vector_t<deferred_finalizer_t> m_deferred_finalizers GUARDED_BY(m_mutex);
     };
   }
 }
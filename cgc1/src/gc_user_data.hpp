@@ -1,4 +1,5 @@
 #pragma once
+#include <cgc1/declarations.hpp>
 #include <functional>
 #include <mcppalloc/user_data_base.hpp>
 namespace cgc1
@@ -47,6 +48,20 @@ namespace cgc1
       {
         m_allow_arbitrary_finalizer_thread = allow;
       }
+      /**
+       * \brief Return pointer layout of object, zero if it is scanned conservatively.
+       **/
+      auto descriptor() const noexcept -> cgc_descriptor_t
+      {
+        return m_descriptor;
+      }
+      /**
+       * \brief Set pointer layout of object.
+       **/
+      void set_descriptor(cgc_descriptor_t descriptor) noexcept
+      {
+        m_descriptor = descriptor;
+      }
       /**
        * \brief Return reference to finalizer.
        **/
@@ -72,6 +87,10 @@ namespace cgc1
        * True if an arbittrary finalization thread can be used, false otherwise.
        **/
       bool m_allow_arbitrary_finalizer_thread{false};
+      /**
+       * \brief Pointer layout of typed objects.
+       **/
+      cgc_descriptor_t m_descriptor{0};
     };
     inline gc_user_data_t::gc_user_data_t() noexcept = default;
     inline gc_user_data_t::gc_user_data_t(const gc_user_data_t &) = default;
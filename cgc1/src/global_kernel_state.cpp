@@ -1,7 +1,9 @@
 #include "global_kernel_state.hpp"
+#include "bitmap_finalization.hpp"
 #include "bitmap_gc_user_data.hpp"
 #include "internal_declarations.hpp"
 #include "new.hpp"
+#include "numa.hpp"
 #include "sparse_finalization.hpp"
 #include "thread_local_kernel_state.hpp"
 #include <algorithm>
@@ -9,8 +11,10 @@
 #include <cgc1/declarations.hpp>
 #include <cgc1/posix.hpp>
 #include <chrono>
+#include <csetjmp>
 #include <csignal>
 #include <iostream>
+#include <iterator>
 #include <mcpputil/mcpputil/aligned_allocator.hpp>
 #include <mcpputil/mcpputil/concurrency.hpp>
 #include <mcpputil/mcpputil/equipartition.hpp>
@@ -34,7 +38,6 @@ template <>
 namespace cgc1::details
 {
   const constexpr global_kernel_state_t::collection_lock_t global_kernel_state_t::sc_collection_lock;
-  void finalize(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state);
   auto _real_gks() -> global_kernel_state_t *
   {
     // TODO: This seems inefficient
@@ -78,6 +81,13 @@ namespace cgc1::details
         m_initialization_parameters(param)
   {
     m_cgc_allocator.initialize(param.internal_allocator_start_size(), param.internal_allocator_expansion_size());
+    m_free_space_divisor.store(param.free_space_divisor(), ::std::memory_order_release);
+    m_minor_collections_per_full.store(param.minor_collections_per_full(), ::std::memory_order_release);
+    m_sticky_mark_bits.store(param.sticky_mark_bits(), ::std::memory_order_release);
+    m_concurrent_mark.store(param.concurrent_mark(), ::std::memory_order_release);
+    m_dirty_page_fallback.store(param.dirty_page_fallback(), ::std::memory_order_release);
+    m_lazy_sweep.store(param.lazy_sweep(), ::std::memory_order_release);
+    m_incremental_mark_budget.store(param.incremental_mark_budget(), ::std::memory_order_release);
     details::initialize_tlks();
   }
   struct shutdown_ptr_functional_t {
@@ -91,21 +101,30 @@ namespace cgc1::details
   global_kernel_state_t::~global_kernel_state_t()
   {
     m_in_destructor = true;
+    if (m_background_collector.running()) {
+      m_background_collector.shutdown();
+    }
+    if (m_finalizer_executor.running()) {
+      m_finalizer_executor.shutdown();
+    }
     ::std::for_each(m_gc_threads.begin(), m_gc_threads.end(), shutdown_ptr_functional);
     m_bitmap_allocator.shutdown();
     m_gc_allocator.shutdown();
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+      _u_reclaim_threads();
+    }
     {
       m_gc_threads.clear();
       auto a1 = ::std::move(m_gc_threads);
       auto a2 = ::std::move(m_roots);
-      m_threads.clear();
-      auto a3 = ::std::move(m_threads);
       m_freed_in_last_collection.clear();
       auto a4 = ::std::move(m_freed_in_last_collection);
+      auto a5 = ::std::move(m_pending_finalization);
+      auto a6 = ::std::move(m_need_special_finalizing_bitmap);
     }
     m_cgc_allocator.shutdown();
     assert(!m_gc_threads.capacity());
-    assert(!m_threads.capacity());
     assert(!m_freed_in_last_collection.capacity());
     m_in_destructor = false;
   }
@@ -118,11 +137,18 @@ namespace cgc1::details
     m_bitmap_allocator.add_type(::mcppalloc::bitmap_allocator::details::bitmap_type_info_t(0, 0));
     m_bitmap_allocator.add_type(::mcppalloc::bitmap_allocator::details::bitmap_type_info_t(1, 0));
     m_bitmap_allocator.add_type(::mcppalloc::bitmap_allocator::details::bitmap_type_info_t(2, 2));
+    m_bitmap_allocator.add_type(::mcppalloc::bitmap_allocator::details::bitmap_type_info_t(3, 2));
   }
   void global_kernel_state_t::shutdown()
   {
+    if (m_background_collector.running()) {
+      m_background_collector.shutdown();
+    }
     disable();
     wait_for_finalization();
+    if (m_finalizer_executor.running()) {
+      m_finalizer_executor.shutdown();
+    }
     mcpputil::double_lock_t<decltype(m_mutex), decltype(m_thread_mutex)> guard(m_mutex, m_thread_mutex);
     m_gc_threads.clear();
   }
@@ -150,6 +176,10 @@ namespace cgc1::details
   {
     return m_mark_time_span;
   }
+  auto global_kernel_state_t::remark_time_span() const -> duration_type
+  {
+    return m_remark_time_span;
+  }
   auto global_kernel_state_t::sweep_time_span() const -> duration_type
   {
     return m_sweep_time_span;
@@ -192,15 +222,13 @@ namespace cgc1::details
   {
     details::gc_allocator_t::block_type ret{nullptr, 0};
     auto &tlks = *details::get_tlks();
-    // check to see if size with user data fits in a bin.
-    const auto size_with_user_data =
-        ::mcpputil::align(sz, sizeof(::mcppalloc::details::user_data_alignment_t)) + sizeof(bitmap_gc_user_data_t);
-
-    if (::mcppalloc::bitmap_allocator::details::fits_in_bins(size_with_user_data)) {
+    _poll_safepoint(tlks);
+    _pace_allocation(tlks, sz);
+    if (::mcppalloc::bitmap_allocator::details::fits_in_bins(sz)) {
       auto &bitmap_allocator = *tlks.bitmap_thread_allocator();
-      ret = bitmap_allocator.allocate(size_with_user_data, 2);
-      auto user_data = bitmap_allocator_user_data(ret.m_ptr);
-      *user_data = bitmap_gc_user_data_t();
+      // user data lives in a side table, so the object keeps its true size.
+      ret = bitmap_allocator.allocate(sz, cs_bitmap_allocation_type_user_data);
+      _lazy_sweep_after_allocation(tlks, ret.m_ptr);
     } else {
       auto &sparse_allocator = *tlks.thread_allocator();
       ret = sparse_allocator.allocate(sz);
@@ -211,9 +239,12 @@ namespace cgc1::details
   {
     details::gc_allocator_t::block_type ret{nullptr, 0};
     auto &tlks = *details::get_tlks();
+    _poll_safepoint(tlks);
+    _pace_allocation(tlks, sz);
     if (::mcppalloc::bitmap_allocator::details::fits_in_bins(sz)) {
       auto &bitmap_allocator = *tlks.bitmap_thread_allocator();
       ret = bitmap_allocator.allocate(sz, 1);
+      _lazy_sweep_after_allocation(tlks, ret.m_ptr);
     } else {
       auto &sparse_allocator = *tlks.thread_allocator();
       const auto allocation = sparse_allocator.allocate_detailed(sz);
@@ -226,9 +257,12 @@ namespace cgc1::details
   {
     details::gc_allocator_t::block_type ret{nullptr, 0};
     auto &tlks = *details::get_tlks();
+    _poll_safepoint(tlks);
+    _pace_allocation(tlks, sz);
     if (::mcppalloc::bitmap_allocator::details::fits_in_bins(sz)) {
       auto &bitmap_allocator = *tlks.bitmap_thread_allocator();
       ret = bitmap_allocator.allocate(sz, 0);
+      _lazy_sweep_after_allocation(tlks, ret.m_ptr);
     } else {
       auto &sparse_allocator = *tlks.thread_allocator();
       ret = sparse_allocator.allocate(sz);
@@ -236,17 +270,239 @@ namespace cgc1::details
     return ret;
   }
 
+  void global_kernel_state_t::_lazy_sweep_state_of(thread_local_kernel_state_t &tlks, void *ptr)
+  {
+    // force_collect checks this flag so a stopped sweep never overlaps concurrent marking.
+    tlks.set_in_lazy_sweep(true);
+    const auto epoch = m_pending_sweep.epoch();
+    const auto state = ::mcppalloc::bitmap_allocator::details::get_state(ptr);
+    bool needed_no_sweep = false;
+    if (!tlks.lazy_sweep_checked(state, epoch)) {
+      // only this thread allocates from state, so nothing else was allocated in it since marking.
+      if (m_pending_sweep.claim(state)) {
+        // ptr was allocated after marking, keep it alive.
+        state->set_marked(state->get_index(ptr));
+        m_gc_stats.add_lazy_bitmap_freed(finalize(state));
+      } else {
+        needed_no_sweep = true;
+      }
+      tlks.set_lazy_sweep_checked(state, epoch);
+    }
+    tlks.set_in_lazy_sweep(false);
+    // the allocator moved on to a state that needed no sweep, so it may have skipped states full of garbage.
+    if (needed_no_sweep && tlks.own_states_swept_epoch() != epoch) {
+      _lazy_sweep_own_states(tlks);
+    }
+  }
+  void global_kernel_state_t::_lazy_sweep_own_states(thread_local_kernel_state_t &tlks)
+  {
+    if (m_pending_sweep.empty()) {
+      return;
+    }
+    tlks.set_in_lazy_sweep(true);
+    tlks.set_own_states_swept_epoch(m_pending_sweep.epoch());
+    tlks.bitmap_thread_allocator()->_for_all_state([this](auto &&state) {
+      if (m_pending_sweep.claim(state)) {
+        m_gc_stats.add_lazy_bitmap_freed(finalize(state));
+      }
+    });
+    tlks.set_in_lazy_sweep(false);
+  }
+  void global_kernel_state_t::_pace_allocation_slow(thread_local_kernel_state_t &tlks)
+  {
+    const auto flushed = tlks.take_bytes_allocated();
+    const auto allocated = m_bytes_allocated_since_collection.fetch_add(flushed, ::std::memory_order_acq_rel) + flushed;
+    if (m_incremental_mark_active.load(::std::memory_order_acquire) && !tlks.in_signal_handler()) {
+      // allocating threads pay for marking in bounded slices.
+      _mark_slice();
+    }
+    const auto divisor = free_space_divisor();
+    if (divisor == 0 || tlks.in_signal_handler()) {
+      return;
+    }
+    if (m_background_collector.running()) {
+      _local_finalization_after_background_collection();
+    }
+    const auto live = ::std::max(m_live_bytes_after_collection.load(::std::memory_order_acquire), cs_pacer_min_live_size);
+    const auto trigger = live / divisor;
+    if (allocated < trigger) {
+      return;
+    }
+    // sweeping now keeps that work out of the pause and may free enough to make the collection cheaper.
+    _lazy_sweep_own_states(tlks);
+    if (m_background_collector.running()) {
+      const auto ticket = m_background_collector.request_collection();
+      // only wait if allocation is outrunning the collector.
+      if (allocated >= trigger * cs_pacer_hard_limit_factor) {
+        m_background_collector.wait_for_collection(ticket);
+        _local_finalization_after_background_collection();
+      }
+      return;
+    }
+    // collect before allocating so the new object can not be lost in a register.
+    // collect declines while finalizers run, so allocating finalizers do not recurse.
+    collect();
+  }
+  void global_kernel_state_t::safepoint()
+  {
+    const auto tlks = get_tlks();
+    if (mcpputil_unlikely(!tlks)) {
+      return;
+    }
+    _poll_safepoint(*tlks);
+  }
+  void global_kernel_state_t::_stop_at_safepoint(thread_local_kernel_state_t &tlks)
+  {
+    // a collector that claimed this thread first stops it with a signal instead.
+    if (!tlks.try_claim_stop()) {
+      return;
+    }
+    // the request may have ended while this thread was stopped by a signal after polling.
+    if (!m_safepoint_requested.load(::std::memory_order_acquire)) {
+      tlks.release_stop();
+      return;
+    }
+    // spill registers onto the stack so the stack scan sees pointers only held in registers.
+    ::std::jmp_buf registers;
+    setjmp(registers);
+    _collect_current_thread();
+  }
+  void global_kernel_state_t::_collect_for_allocation_failure()
+  {
+    if (!m_background_collector.running()) {
+      force_collect();
+      return;
+    }
+    m_background_collector.wait_for_collection(m_background_collector.request_collection());
+    _local_finalization_after_background_collection();
+  }
+  void global_kernel_state_t::_local_finalization_after_background_collection()
+  {
+    auto finalized = m_background_collections_finalized.load(::std::memory_order_acquire);
+    const auto finished = m_background_collector.num_finished();
+    // one mutator per collection picks up the local finalizers.
+    if (finalized != finished && m_background_collections_finalized.compare_exchange_strong(finalized, finished)) {
+      local_thread_finalization();
+    }
+  }
+  bool global_kernel_state_t::_u_any_thread_in_lazy_sweep() const
+  {
+    bool ret = false;
+    m_thread_registry.for_each([&ret](thread_local_kernel_state_t *tlks) { ret = ret || tlks->in_lazy_sweep(); });
+    return ret;
+  }
+  auto global_kernel_state_t::_u_finish_bitmap_sweep() -> size_t
+  {
+    size_t num_freed = 0;
+    cgc_internal_vector_t<pending_sweep_set_t::state_type *> pending;
+    for (auto &gc_thread : m_gc_threads) {
+      // finalizers may not be thread safe, so they keep running on this thread only.
+      for (auto state : gc_thread->_bitmap_states_to_finalize()) {
+        num_freed += finalize(state);
+      }
+      const auto &lazy = gc_thread->_bitmap_states_to_lazy_sweep();
+      pending.insert(pending.end(), lazy.begin(), lazy.end());
+    }
+    if (_u_minor_skips_old_states()) {
+      // old states were not swept, so ones mutators have not claimed keep their place.
+      const auto old = m_pending_sweep.take_unclaimed();
+      pending.insert(pending.end(), old.begin(), old.end());
+    }
+    m_lazy_sweep_leftovers.clear();
+    m_pending_sweep.reset(::std::move(pending));
+    return num_freed;
+  }
   auto global_kernel_state_t::allocate_sparse(size_t sz) -> details::gc_allocator_t::block_type
   {
     auto &tlks = *details::get_tlks();
+    _poll_safepoint(tlks);
+    _pace_allocation(tlks, sz);
     auto &sparse_allocator = *tlks.thread_allocator();
     return sparse_allocator.allocate(sz);
   }
+  auto global_kernel_state_t::allocate_many(size_t sz, size_t count, void **out) -> size_t
+  {
+    auto &tlks = *details::get_tlks();
+    _poll_safepoint(tlks);
+    _pace_allocation(tlks, sz * count);
+    size_t num_allocated = 0;
+    if (!::mcppalloc::bitmap_allocator::details::fits_in_bins(sz)) {
+      auto &sparse_allocator = *tlks.thread_allocator();
+      for (; num_allocated < count; ++num_allocated) {
+        out[num_allocated] = sparse_allocator.allocate(sz).m_ptr;
+        if (mcpputil_unlikely(!out[num_allocated])) {
+          break;
+        }
+      }
+      return num_allocated;
+    }
+    auto &bitmap_allocator = *tlks.bitmap_thread_allocator();
+    ::mcppalloc::bitmap_allocator::details::bitmap_state_t *last_state = nullptr;
+    for (; num_allocated < count; ++num_allocated) {
+      void *const ptr = bitmap_allocator.allocate(sz, cs_bitmap_allocation_type_user_data).m_ptr;
+      if (mcpputil_unlikely(!ptr)) {
+        break;
+      }
+      // consecutive objects mostly come from the same state, which only needs checking once.
+      const auto state = ::mcppalloc::bitmap_allocator::details::get_state(ptr);
+      if (state != last_state) {
+        _lazy_sweep_after_allocation(tlks, ptr);
+        last_state = state;
+      }
+      out[num_allocated] = ptr;
+    }
+    return num_allocated;
+  }
+  auto global_kernel_state_t::allocate_typed(size_t sz, cgc_descriptor_t descriptor) -> details::gc_allocator_t::block_type
+  {
+    if (descriptor == cs_conservative_descriptor) {
+      return allocate(sz);
+    }
+    if (descriptor == cs_pointer_free_descriptor) {
+      return allocate_atomic(sz);
+    }
+    details::gc_allocator_t::block_type ret{nullptr, 0};
+    auto &tlks = *details::get_tlks();
+    _poll_safepoint(tlks);
+    _pace_allocation(tlks, sz);
+    // small objects carry their descriptor in their last word, a zero word is scanned conservatively.
+    const auto size_with_descriptor = ::mcpputil::align(sz, sizeof(cgc_descriptor_t)) + sizeof(cgc_descriptor_t);
+    if (::mcppalloc::bitmap_allocator::details::fits_in_bins(size_with_descriptor)) {
+      auto &bitmap_allocator = *tlks.bitmap_thread_allocator();
+      ret = bitmap_allocator.allocate(size_with_descriptor, cs_bitmap_allocation_type_typed);
+      _lazy_sweep_after_allocation(tlks, ret.m_ptr);
+      const auto state = ::mcppalloc::bitmap_allocator::details::get_state(ret.m_ptr);
+      *bitmap_typed_descriptor(state, ret.m_ptr) = descriptor;
+    } else {
+      auto &sparse_allocator = *tlks.thread_allocator();
+      const auto allocation = sparse_allocator.allocate_detailed(sz);
+      const auto os = get_allocation_object_state(allocation);
+      auto ud = static_cast<gc_user_data_t *>(os->user_data());
+      ud = ::mcpputil::make_unique_allocator<gc_user_data_t, cgc_internal_allocator_t<void>>(*ud).release();
+      ud->set_is_default(false);
+      ud->set_descriptor(descriptor);
+      os->set_user_data(ud);
+      ret = ::std::get<0>(allocation);
+    }
+    return ret;
+  }
+  auto global_kernel_state_t::make_descriptor(const uint64_t *bitmap, size_t num_words) -> cgc_descriptor_t
+  {
+    return m_typed_layouts.make_descriptor(bitmap, num_words);
+  }
   void global_kernel_state_t::deallocate(void *v)
   {
     auto &tlks = *details::get_tlks();
     auto &sparse_allocator = *tlks.thread_allocator();
     auto &bitmap_allocator = *tlks.bitmap_thread_allocator();
+    if (mcpputil_unlikely(!m_bitmap_user_data.empty()) && bitmap_user_data_state(v)) {
+      // drop finalizer so it neither runs nor leaks onto the next object at this address.
+      const auto state = ::mcppalloc::bitmap_allocator::details::get_state(v);
+      const auto index = state->get_index(v);
+      state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable).set_bit(index, false);
+      state->user_bits_ref(cs_bitmap_allocation_user_bit_finalizeable_arbitrary_thread).set_bit(index, false);
+      m_bitmap_user_data.take(v);
+    }
     if (!bitmap_allocator.deallocate(v)) {
       sparse_allocator.deallocate(v);
     }
@@ -256,28 +512,209 @@ namespace cgc1::details
   {
     return m_num_collections;
   }
-  void global_kernel_state_t::_u_setup_gc_threads()
+  void global_kernel_state_t::add_root(void **root)
+  {
+    const auto tlks = get_tlks();
+    if (mcpputil_unlikely(nullptr == tlks)) {
+      m_roots.add_root(root);
+      return;
+    }
+    m_roots.add_root(tlks->root_log(), root);
+  }
+  void global_kernel_state_t::remove_root(void **root)
+  {
+    const auto tlks = get_tlks();
+    if (mcpputil_unlikely(nullptr == tlks)) {
+      m_roots.remove_root(root);
+      return;
+    }
+    m_roots.remove_root(tlks->root_log(), root);
+    // a collection that started before the change was logged may scan the root until it finishes.
+    // the fence pairs with setting m_collect, so a collection not seen here merges the change before marking.
+    ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    if (mcpputil_unlikely(m_collect.load(::std::memory_order_relaxed))) {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(sc_collection_lock);
+    }
+  }
+  void global_kernel_state_t::set_free_space_divisor(size_t divisor) noexcept
+  {
+    m_free_space_divisor.store(divisor, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::free_space_divisor() const noexcept -> size_t
+  {
+    return m_free_space_divisor.load(::std::memory_order_acquire);
+  }
+  void global_kernel_state_t::set_minor_collections_per_full(size_t num) noexcept
+  {
+    m_minor_collections_per_full.store(num, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::minor_collections_per_full() const noexcept -> size_t
+  {
+    return m_minor_collections_per_full.load(::std::memory_order_acquire);
+  }
+  void global_kernel_state_t::set_sticky_mark_bits(bool sticky) noexcept
+  {
+    m_sticky_mark_bits.store(sticky, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::sticky_mark_bits() const noexcept -> bool
+  {
+    return m_sticky_mark_bits.load(::std::memory_order_acquire);
+  }
+  void global_kernel_state_t::set_concurrent_mark(bool concurrent) noexcept
+  {
+    m_concurrent_mark.store(concurrent, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::concurrent_mark() const noexcept -> bool
+  {
+    return m_concurrent_mark.load(::std::memory_order_acquire);
+  }
+  void global_kernel_state_t::set_dirty_page_fallback(bool fallback) noexcept
+  {
+    m_dirty_page_fallback.store(fallback, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::dirty_page_fallback() const noexcept -> bool
+  {
+    return m_dirty_page_fallback.load(::std::memory_order_acquire);
+  }
+  void global_kernel_state_t::set_lazy_sweep(bool lazy) noexcept
+  {
+    m_lazy_sweep.store(lazy, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::lazy_sweep() const noexcept -> bool
+  {
+    return m_lazy_sweep.load(::std::memory_order_acquire);
+  }
+  void global_kernel_state_t::set_incremental_mark_budget(size_t microseconds) noexcept
+  {
+    m_incremental_mark_budget.store(microseconds, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::incremental_mark_budget() const noexcept -> size_t
+  {
+    return m_incremental_mark_budget.load(::std::memory_order_acquire);
+  }
+  bool global_kernel_state_t::_minor_collection_due() const noexcept
+  {
+    return !m_full_collection_due.load(::std::memory_order_acquire) &&
+           m_minor_collections_since_full.load(::std::memory_order_acquire) < minor_collections_per_full();
+  }
+
+  auto global_kernel_state_t::bytes_allocated_since_collection() const noexcept -> size_t
+  {
+    return m_bytes_allocated_since_collection.load(::std::memory_order_acquire);
+  }
+  void global_kernel_state_t::_u_partition_bitmap_states()
+  {
+    m_bitmap_states.clear();
+    _bitmap_allocator()._for_all_state([this](auto &&state) {
+      // a minor collection without sticky mark bits only marks and sweeps young states.
+      if (!_u_minor_skips_old_states() || !::std::binary_search(m_old_bitmap_states.begin(), m_old_bitmap_states.end(), state)) {
+        m_bitmap_states.push_back(state);
+      }
+    });
+    if (_u_minor_skips_old_states()) {
+      // gc threads look young states up by address.
+      ::std::sort(m_bitmap_states.begin(), m_bitmap_states.end());
+    }
+    const auto set_bitmap_states = [](auto &&thread, auto &&tup) {
+      auto begin = ::std::get<0>(tup);
+      auto end = ::std::get<1>(tup);
+      auto sz = end - begin;
+      thread->set_bitmap_states({begin != end ? &*begin : nullptr, sz});
+    };
+    if (m_num_numa_nodes > 1) {
+      _u_partition_bitmap_states_by_node();
+      return;
+    }
+    mcpputil::equipartition(m_bitmap_states, m_gc_threads, set_bitmap_states);
+  }
+  void global_kernel_state_t::_u_partition_bitmap_states_by_node()
+  {
+    // gc thread i is pinned to node i % nodes, with fewer gc threads than nodes some nodes share gc threads.
+    const size_t num_groups = ::std::min(m_num_numa_nodes, m_gc_threads.size());
+    const auto heap_begin = m_bitmap_allocator.underlying_memory().begin();
+    const auto stripe_size = m_numa_stripe_size;
+    const auto num_nodes = m_num_numa_nodes;
+    const auto group_of = [heap_begin, stripe_size, num_nodes, num_groups](auto &&state) {
+      return numa_node_of(state, heap_begin, stripe_size, num_nodes) % num_groups;
+    };
+    // m_bitmap_states keeps its order, minor collections look states up in it by address.
+    m_numa_bitmap_states.assign(m_bitmap_states.begin(), m_bitmap_states.end());
+    ::std::sort(m_numa_bitmap_states.begin(), m_numa_bitmap_states.end(), [&group_of](auto &&lhs, auto &&rhs) {
+      return ::std::make_pair(group_of(lhs), lhs) < ::std::make_pair(group_of(rhs), rhs);
+    });
+    auto begin = m_numa_bitmap_states.begin();
+    for (size_t group = 0; group < num_groups; ++group) {
+      const auto end =
+          ::std::find_if(begin, m_numa_bitmap_states.end(), [&group_of, group](auto &&state) { return group_of(state) != group; });
+      // split states of node evenly between gc threads of node.
+      const size_t num_threads = (m_gc_threads.size() - group + num_groups - 1) / num_groups;
+      const auto num_states = static_cast<size_t>(end - begin);
+      for (size_t i = 0; i < num_threads; ++i) {
+        const auto first = begin + static_cast<ptrdiff_t>(num_states * i / num_threads);
+        const auto last = begin + static_cast<ptrdiff_t>(num_states * (i + 1) / num_threads);
+        const auto sz = last - first;
+        m_gc_threads[group + i * num_groups]->set_bitmap_states({first != last ? &*first : nullptr, sz});
+      }
+      begin = end;
+    }
+  }
+  void global_kernel_state_t::_u_initialize_numa()
+  {
+    const auto &topology = numa_topology();
+    if (topology.num_nodes() < 2) {
+      return;
+    }
+    // stripes are bound before any page is touched, so pages fault in on the node of their stripe.
+    auto &bitmap_memory = m_bitmap_allocator.underlying_memory();
+    const auto bitmap_stripe_size = numa_stripe_size(static_cast<size_t>(bitmap_memory.end() - bitmap_memory.begin()));
+    if (!numa_stripe_heap(bitmap_memory.begin(), bitmap_memory.end(), bitmap_stripe_size)) {
+      ::std::cerr << "CGC1: Unable to stripe heap across NUMA nodes 5f0c2d8e-7a41-4b6e-9c3d-2e8a1f6b4d70\n";
+      return;
+    }
+    // sparse blocks are still partitioned by address, striping only spreads their bandwidth over nodes.
+    auto &sparse_memory = m_gc_allocator.underlying_memory();
+    numa_stripe_heap(sparse_memory.begin(), sparse_memory.end(),
+                     numa_stripe_size(static_cast<size_t>(sparse_memory.end() - sparse_memory.begin())));
+    m_numa_stripe_size = bitmap_stripe_size;
+    m_num_numa_nodes = topology.num_nodes();
+  }
+  void global_kernel_state_t::_u_create_gc_threads(size_t num_gc_threads, size_t mark_stack_size)
+  {
+    if (num_gc_threads == 0) {
+      num_gc_threads = ::std::max<size_t>(1, ::std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_gc_threads; ++i) {
+      m_gc_threads.emplace_back(make_unique_malloc<gc_thread_t>(mark_stack_size));
+      m_gc_threads.back()->set_parallel_mark_state(&m_parallel_mark_state);
+      if (m_num_numa_nodes > 1) {
+        m_gc_threads.back()->pin_to_numa_node(i % m_num_numa_nodes);
+      }
+    }
+  }
+  void global_kernel_state_t::_u_setup_gc_threads(bool concurrent_mark, bool lazy_sweep)
   {
     // if no gc threads, trivially done.
     if (m_gc_threads.empty()) {
       return;
     }
-    size_t cur_gc_thread = 0;
     // reset all threads.
     for (auto &thread : m_gc_threads) {
       thread->reset();
+      thread->set_concurrent_mark(concurrent_mark);
+      thread->set_mark_slice_budget(concurrent_mark ? _mark_slice_budget() : ::std::chrono::microseconds::zero());
+      thread->set_bitmap_sweep_policy(lazy_sweep, m_lazy_sweep_leftovers);
     }
-    // for each thread, assign a gc thread to manage it.
-    for (auto state : m_threads) {
-      m_gc_threads[cur_gc_thread]->add_thread(state->thread_id());
-      cur_gc_thread = (cur_gc_thread + 1) % m_gc_threads.size();
-    }
+    // all gc threads start marking as active.
+    m_parallel_mark_state.reset();
+    _u_assign_threads();
 
     const auto set_allocator_blocks = [](auto &&thread, auto &&tup) {
       auto begin = ::std::get<0>(tup);
       auto end = ::std::get<1>(tup);
       if (begin != end) {
         thread->set_allocator_blocks(&*begin, &*end);
+      } else {
+        thread->set_allocator_blocks(nullptr, nullptr);
       }
     };
     const auto set_root_iterators = [](auto &&thread, auto &&tup) {
@@ -293,31 +730,382 @@ namespace cgc1::details
       auto sz = end - begin;
       thread->set_root_ranges({&*begin, sz});
     };
-    mcpputil::equipartition(m_gc_allocator._u_blocks(), m_gc_threads, set_allocator_blocks);
+    const auto set_dirty_pages = [](auto &&thread, auto &&tup) {
+      auto begin = ::std::get<0>(tup);
+      auto end = ::std::get<1>(tup);
+      auto sz = end - begin;
+      thread->set_dirty_pages({begin != end ? &*begin : nullptr, sz});
+    };
+    if (m_minor_collection) {
+      mcpputil::equipartition(m_dirty_pages, m_gc_threads, set_dirty_pages);
+    }
+    const auto set_pending_finalization = [](auto &&thread, auto &&tup) {
+      auto begin = ::std::get<0>(tup);
+      auto end = ::std::get<1>(tup);
+      auto sz = end - begin;
+      thread->set_pending_finalization({begin != end ? &*begin : nullptr, sz});
+    };
+    mcpputil::equipartition(m_pending_finalization, m_gc_threads, set_pending_finalization);
+    if (_u_minor_skips_old_states()) {
+      // the sparse heap is old, so it is neither cleared nor swept.
+      for (auto &thread : m_gc_threads) {
+        thread->set_allocator_blocks(nullptr, nullptr);
+      }
+    } else {
+      mcpputil::equipartition(m_gc_allocator._u_blocks(), m_gc_threads, set_allocator_blocks);
+    }
     mcpputil::equipartition(m_roots.roots(), m_gc_threads, set_root_iterators);
     mcpputil::equipartition(m_roots.ranges(), m_gc_threads, set_root_range);
+    _u_partition_bitmap_states();
+    for (auto &thread : m_gc_threads) {
+      thread->set_minor_collection(m_minor_collection, m_sticky_collection, {m_bitmap_states.data(), m_bitmap_states.size()});
+    }
   }
-  void global_kernel_state_t::wait_for_finalization(bool do_local_finalization)
+  void global_kernel_state_t::_u_assign_threads()
   {
-    wait_for_collection2();
-    MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_thread_mutex);
-    m_mutex.unlock();
+    // world is stopped, so the registry is closed and no state can be reclaimed.
+    size_t cur_gc_thread = 0;
+    // for each thread, assign a gc thread to manage it.
+    m_thread_registry.for_each([this, &cur_gc_thread](thread_local_kernel_state_t *tlks) {
+      m_gc_threads[cur_gc_thread]->add_thread(tlks);
+      cur_gc_thread = (cur_gc_thread + 1) % m_gc_threads.size();
+    });
+  }
+  void global_kernel_state_t::_u_reclaim_threads()
+  {
+    m_thread_registry.reclaim([this](thread_local_kernel_state_t *tlks) {
+      // keep root changes of this thread, later ones go straight to root collection.
+      m_roots._u_unregister_log(tlks->root_log());
+      // this will delete the tlks.
+      ::std::unique_ptr<details::thread_local_kernel_state_t, cgc_internal_malloc_deleter_t> tlks_deleter(tlks);
+    });
+  }
+  void global_kernel_state_t::_u_setup_gc_threads_for_remark()
+  {
+    // all gc threads start remarking as active.
+    m_parallel_mark_state.reset();
+    // threads that left during concurrent mark are gone, threads that joined need their stacks scanned.
+    for (auto &thread : m_gc_threads) {
+      thread->clear_threads();
+    }
+    _u_assign_threads();
+    const auto set_allocator_blocks = [](auto &&thread, auto &&tup) {
+      auto begin = ::std::get<0>(tup);
+      auto end = ::std::get<1>(tup);
+      if (begin != end) {
+        thread->set_allocator_blocks(&*begin, &*end);
+      } else {
+        thread->set_allocator_blocks(nullptr, nullptr);
+      }
+    };
+    const auto set_root_iterators = [](auto &&thread, auto &&tup) {
+      auto begin = ::std::get<0>(tup);
+      auto end = ::std::get<1>(tup);
+      if (begin != end) {
+        thread->set_root_iterators(&*begin, &*end);
+      } else {
+        thread->set_root_iterators(nullptr, nullptr);
+      }
+    };
+    const auto set_dirty_pages = [](auto &&thread, auto &&tup) {
+      auto begin = ::std::get<0>(tup);
+      auto end = ::std::get<1>(tup);
+      auto sz = end - begin;
+      thread->set_dirty_pages({begin != end ? &*begin : nullptr, sz});
+    };
+    // sparse blocks may have been created while mutators ran, so sweep needs a fresh partition.
+    MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_gc_allocator._mutex());
+    mcpputil::equipartition(m_gc_allocator._u_blocks(), m_gc_threads, set_allocator_blocks);
+    mcpputil::equipartition(m_dirty_pages, m_gc_threads, set_dirty_pages);
+    // roots logged while mutators ran are merged now, so the old partition may point into moved storage.
+    m_roots._u_merge_logs();
+    mcpputil::equipartition(m_roots.roots(), m_gc_threads, set_root_iterators);
+    // likewise for bitmap states.
+    _u_partition_bitmap_states();
+  }
+  bool global_kernel_state_t::_u_collect_remembered_pages()
+  {
+    m_dirty_pages.clear();
+    if (dirty_page_fallback()) {
+      _u_add_in_use_pages();
+      return true;
+    }
+    // the cost of a minor collection must not grow with reserved address space.
+    return _u_collect_in_use_dirty_pages();
+  }
+  void global_kernel_state_t::_u_find_in_use_ranges()
+  {
+    const auto page_size = dirty_page_tracker_t::page_size();
+    m_in_use_ranges.clear();
+    // the rest of the bitmap heap is reserved but may not be mapped.
+    _bitmap_allocator()._for_all_state([this](auto &&state) {
+      m_in_use_ranges.emplace_back(reinterpret_cast<uint8_t *>(state),
+                                   state->begin() + state->size() * state->real_entry_size());
+    });
+    ::std::sort(m_in_use_ranges.begin(), m_in_use_ranges.end());
+    // neighbouring states become one range, so no page is visited twice.
+    size_t num_ranges = 0;
+    for (auto &range : m_in_use_ranges) {
+      if (num_ranges != 0) {
+        auto &last = m_in_use_ranges[num_ranges - 1];
+        const auto last_page_end = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(last.second) + page_size - 1) &
+                                                               ~(page_size - 1));
+        if (range.first <= last_page_end) {
+          last.second = ::std::max(last.second, range.second);
+          continue;
+        }
+      }
+      m_in_use_ranges[num_ranges++] = range;
+    }
+    m_in_use_ranges.resize(num_ranges);
+    // world is stopped, so allocator state is frozen.
+    MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_gc_allocator._mutex());
+    m_in_use_ranges.emplace_back(m_gc_allocator.underlying_memory().begin(), m_gc_allocator._u_current_end());
+  }
+  void global_kernel_state_t::_u_add_in_use_pages()
+  {
+    const auto page_size = dirty_page_tracker_t::page_size();
+    _u_find_in_use_ranges();
+    for (auto &range : m_in_use_ranges) {
+      auto page = reinterpret_cast<uint8_t *>(reinterpret_cast<uintptr_t>(range.first) & ~(page_size - 1));
+      for (; page < range.second; page += page_size) {
+        m_dirty_pages.push_back(page);
+      }
+    }
+  }
+  bool global_kernel_state_t::_u_collect_in_use_dirty_pages()
+  {
+    _u_find_in_use_ranges();
+    return ::std::all_of(m_in_use_ranges.begin(), m_in_use_ranges.end(), [this](auto &&range) {
+      MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_mutex);
+      return m_dirty_page_tracker.collect_dirty_pages(range.first, range.second, m_dirty_pages);
+    });
+  }
+  void global_kernel_state_t::_u_promote_survivors()
+  {
+    m_old_bitmap_states.clear();
+    _bitmap_allocator()._for_all_state([this](auto &&state) { m_old_bitmap_states.push_back(state); });
+    ::std::sort(m_old_bitmap_states.begin(), m_old_bitmap_states.end());
+    // world is still stopped, so no write can slip in before tracking starts.
+    m_old_generation_valid = m_dirty_page_tracker.reset() || dirty_page_fallback();
+  }
+  bool global_kernel_state_t::_u_minor_skips_old_states() const noexcept
+  {
+    return m_minor_collection && !m_sticky_collection;
+  }
+  bool global_kernel_state_t::_d_in_old_generation(void *addr) const
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    auto state = ::mcppalloc::bitmap_allocator::details::get_state(addr);
+    return ::std::binary_search(m_old_bitmap_states.begin(), m_old_bitmap_states.end(), state);
+  }
+  void global_kernel_state_t::_d_set_gc_threads(size_t num_gc_threads, size_t mark_stack_size)
+  {
+    while (true) {
+      wait_for_finalization(false);
+      wait_for_collection2();
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_mutex);
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_thread_mutex);
+      // finalizing gc threads need the gks lock, so they can not be joined while holding it.
+      // no new finalization can start while it is held.
+      if (::std::all_of(m_gc_threads.begin(), m_gc_threads.end(),
+                        [](auto &&gc_thread) { return gc_thread->finalization_finished(); })) {
+        m_gc_threads.clear();
+        m_parallel_mark_state.clear();
+        _u_create_gc_threads(num_gc_threads, mark_stack_size);
+        return;
+      }
+    }
+  }
+  size_t global_kernel_state_t::_d_num_gc_threads() const
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    return m_gc_threads.size();
+  }
+  bool global_kernel_state_t::_d_sweep_pending(void *addr) const
+  {
+    return m_pending_sweep.pending(::mcppalloc::bitmap_allocator::details::get_state(addr));
+  }
+  size_t global_kernel_state_t::_d_num_threads() const noexcept
+  {
+    return m_thread_registry.size();
+  }
+  size_t global_kernel_state_t::_d_num_retired_threads() const noexcept
+  {
+    return m_thread_registry.num_retired();
+  }
+  void global_kernel_state_t::_u_concurrent_mark()
+  {
+    // stacks must be snapshotted before mutators may run.
+    for (auto &gc_thread : m_gc_threads) {
+      gc_thread->wait_until_roots_finished();
+    }
+    _u_resume_world_for_concurrent_mark();
+    const auto budget = _mark_slice_budget();
+    if (budget != ::std::chrono::microseconds::zero()) {
+      // mutators run slices as they allocate, this keeps marking going when they do not.
+      m_incremental_mark_active.store(true, ::std::memory_order_release);
+      const auto mark_finished = [this]() {
+        return ::std::all_of(m_gc_threads.begin(), m_gc_threads.end(),
+                             [](auto &&gc_thread) { return gc_thread->mark_finished(); });
+      };
+      while (!mark_finished()) {
+        _mark_slice();
+        // leave mutators at least as much time as marking.
+        ::std::this_thread::sleep_for(budget);
+      }
+      // a slice in progress must finish before the world is stopped.
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mark_slice_mutex);
+      m_incremental_mark_active.store(false, ::std::memory_order_release);
+      m_gc_stats.record(gc_phase_t::mark_slice, m_mark_slice_latencies);
+      m_mark_slice_latencies.clear();
+    }
+    for (auto &gc_thread : m_gc_threads) {
+      gc_thread->wait_until_mark_finished();
+    }
+    _u_stop_world_for_remark();
+    const auto remark_start = ::std::chrono::high_resolution_clock::now();
+    m_dirty_pages.clear();
+    // if we can not tell what changed, everything changed.
+    if (dirty_page_fallback() || !_u_collect_in_use_dirty_pages()) {
+      m_dirty_pages.clear();
+      _u_add_in_use_pages();
+    }
+    _u_setup_gc_threads_for_remark();
+    for (auto &gc_thread : m_gc_threads) {
+      gc_thread->start_remark();
+    }
     for (auto &gc_thread : m_gc_threads) {
-      gc_thread->wait_until_finalization_finished();
+      gc_thread->wait_until_remark_finished();
+    }
+    m_remark_time_span = ::std::chrono::duration_cast<duration_type>(::std::chrono::high_resolution_clock::now() - remark_start);
+  }
+  void global_kernel_state_t::_mark_slice()
+  {
+    if (!m_incremental_mark_active.load(::std::memory_order_acquire)) {
+      return;
+    }
+    ::std::unique_lock<mutex_type> lock(m_mark_slice_mutex, ::std::try_to_lock);
+    // if another thread is running a slice, this one does not need to.
+    if (!lock.owns_lock() || !m_incremental_mark_active.load(::std::memory_order_acquire)) {
+      return;
+    }
+    const auto slice_start = ::std::chrono::high_resolution_clock::now();
+    for (auto &gc_thread : m_gc_threads) {
+      gc_thread->start_mark_slice();
+    }
+    for (auto &gc_thread : m_gc_threads) {
+      gc_thread->wait_until_mark_slice_finished();
+    }
+    const auto slice_time = ::std::chrono::high_resolution_clock::now() - slice_start;
+    MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_mark_slice_mutex);
+    m_mark_slice_latencies.record(
+        static_cast<uint64_t>(::std::chrono::duration_cast<::std::chrono::nanoseconds>(slice_time).count()));
+  }
+  auto global_kernel_state_t::_mark_slice_budget() const noexcept -> ::std::chrono::microseconds
+  {
+    return ::std::chrono::microseconds(incremental_mark_budget());
+  }
+  void global_kernel_state_t::_u_resume_world_for_concurrent_mark()
+  {
+    m_thread_mutex.lock();
+    m_start_world_condition_mutex.lock();
+    // mutators wait on this, m_collect stays set so no other collection starts.
+    m_collect_finished = true;
+    ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+    _u_resume_threads();
+    m_start_world_condition_mutex.unlock();
+    m_thread_mutex.unlock();
+  }
+  void global_kernel_state_t::_u_stop_world_for_remark()
+  {
+    // every thread must leave the signal handler of the first pause before it can be paused again.
+    while (m_num_resumed_threads.load(::std::memory_order_acquire) != m_num_paused_threads.load(::std::memory_order_acquire)) {
+      ::std::this_thread::yield();
+    }
+    // grab allocator locks so that they are in a consistent state for remark and sweep.
+    lock(m_bitmap_allocator._mutex(), m_gc_allocator._mutex(), m_cgc_allocator._mutex(), m_slab_allocator._mutex(),
+         m_thread_mutex);
+    m_collect_finished.store(false, ::std::memory_order_release);
+    m_num_paused_threads.store(0, ::std::memory_order_release);
+    m_num_resumed_threads.store(0, ::std::memory_order_release);
+    ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+    m_allocators_unavailable_mutex.lock();
+    _u_suspend_threads();
+    m_thread_mutex.unlock();
+    // set stack pointer for this stack.
+    get_tlks()->set_stack_ptr(mcpputil_builtin_current_stack());
+    // maintenance was held back while mutators ran.
+    m_bitmap_allocator._u_set_force_maintenance();
+    m_gc_allocator._u_set_force_free_empty_blocks();
+    m_cgc_allocator._u_set_force_free_empty_blocks();
+    // release allocator locks so they can be used.
+    m_bitmap_allocator._mutex().unlock();
+    m_gc_allocator._mutex().unlock();
+    m_cgc_allocator._mutex().unlock();
+    m_slab_allocator._mutex().unlock();
+    m_allocators_unavailable_mutex.unlock();
+  }
+  void global_kernel_state_t::wait_for_finalization(bool do_local_finalization)
+  {
+    {
+      wait_for_collection2();
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_thread_mutex);
+      m_mutex.unlock();
+      for (auto &gc_thread : m_gc_threads) {
+        gc_thread->wait_until_finalization_finished();
+      }
     }
     if (do_local_finalization) {
+      // finalizers on executor threads may collect, so do not hold the thread mutex while waiting for them.
+      m_finalizer_executor.wait_until_idle();
       local_thread_finalization();
     }
   }
   void global_kernel_state_t::local_thread_finalization()
   {
     cgc_internal_vector_t<gc_sparse_object_state_t *> vec;
+    cgc_internal_vector_t<deferred_finalizer_t> bitmap_finalizers;
     {
       MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
       vec = _u_get_local_finalization_vector_sparse();
+      bitmap_finalizers.swap(m_need_special_finalizing_bitmap);
     }
     auto to_be_freed = do_local_sparse_finalization(gc_allocator(), vec);
     _add_freed_in_last_collection(to_be_freed);
+    if (!bitmap_finalizers.empty()) {
+      run_deferred_finalizers(bitmap_finalizers);
+      _remove_pending_finalization(bitmap_finalizers);
+    }
+  }
+  void global_kernel_state_t::_add_need_special_finalizing_bitmap(::gsl::span<deferred_finalizer_t> finalizers)
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    m_need_special_finalizing_bitmap.insert(m_need_special_finalizing_bitmap.end(),
+                                            ::std::make_move_iterator(finalizers.begin()),
+                                            ::std::make_move_iterator(finalizers.end()));
+  }
+  void global_kernel_state_t::_add_pending_finalization(::gsl::span<const deferred_finalizer_t> finalizers)
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    for (const auto &deferred : finalizers) {
+      m_pending_finalization.push_back(deferred.m_object);
+    }
+  }
+  void global_kernel_state_t::_remove_pending_finalization(::gsl::span<const deferred_finalizer_t> finalizers)
+  {
+    cgc_internal_vector_t<void *> objects;
+    objects.reserve(static_cast<size_t>(finalizers.size()));
+    for (const auto &deferred : finalizers) {
+      objects.push_back(deferred.m_object);
+    }
+    ::std::sort(objects.begin(), objects.end());
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    m_pending_finalization.erase(::std::remove_if(m_pending_finalization.begin(), m_pending_finalization.end(),
+                                                  [&objects](void *object) {
+                                                    return ::std::binary_search(objects.begin(), objects.end(), object);
+                                                  }),
+                                 m_pending_finalization.end());
   }
   auto global_kernel_state_t::_u_get_local_finalization_vector_sparse() -> cgc_internal_vector_t<gc_sparse_object_state_t *>
   {
@@ -340,9 +1128,9 @@ namespace cgc1::details
       }
     }
     // force a collection.
-    force_collect();
+    force_collect(true, _minor_collection_due());
   }
-  void global_kernel_state_t::force_collect(bool do_local_finalization)
+  void global_kernel_state_t::force_collect(bool do_local_finalization, bool minor)
   {
     if (mcpputil_unlikely(!get_tlks())) {
       ::std::cerr << "Attempted to gc with no thread state" << ::std::endl;
@@ -351,6 +1139,11 @@ namespace cgc1::details
     if (!enabled()) {
       return;
     }
+    // incremental marking is concurrent marking that only traces in slices.
+    bool concurrent_mark = (this->concurrent_mark() || _mark_slice_budget() != ::std::chrono::microseconds::zero()) &&
+                           (dirty_page_tracker_t::is_supported() || dirty_page_fallback());
+    const bool lazy_sweep = this->lazy_sweep();
+    const bool sticky_mark_bits = this->sticky_mark_bits();
     bool expected = false;
     m_collect.compare_exchange_strong(expected, true);
     if (expected) {
@@ -364,7 +1157,7 @@ namespace cgc1::details
       return;
     }
     // wait until safe to collect.
-    wait_for_finalization();
+    wait_for_finalization(do_local_finalization);
     // we need to maintain global allocator at some point so do it here.
     m_gc_allocator.collect();
     // note that the order of allocator locks and unlocks are all important here to prevent deadlocks!
@@ -383,6 +1176,11 @@ namespace cgc1::details
       lock(m_cgc_allocator._mutex(), m_slab_allocator._mutex(), m_start_world_condition_mutex);
     }
     m_start_world_condition_mutex.unlock();
+    // writes are only remembered since the last collection, and minor collections stop the world for all of marking.
+    minor = minor && m_old_generation_valid && !(sticky_mark_bits && m_unmarked_old_objects);
+    if (minor) {
+      concurrent_mark = false;
+    }
     ::std::atomic_thread_fence(::std::memory_order_acq_rel);
     //      m_collect = true;
     m_num_freed_in_last_collection = 0;
@@ -394,58 +1192,93 @@ namespace cgc1::details
     ::std::atomic_thread_fence(::std::memory_order_acq_rel);
     m_allocators_unavailable_mutex.lock();
     _u_suspend_threads();
+    // a thread stopped in the middle of a lazy sweep would finish it against cleared marks if resumed before sweep.
+    if (concurrent_mark && _u_any_thread_in_lazy_sweep()) {
+      concurrent_mark = false;
+    }
+    if (minor && !_u_collect_remembered_pages()) {
+      minor = false;
+    }
+    m_minor_collection = minor;
+    m_sticky_collection = minor && sticky_mark_bits;
     m_thread_mutex.unlock();
     // set stack pointer for this stack.
     get_tlks()->set_stack_ptr(mcpputil_builtin_current_stack());
-    m_bitmap_allocator._u_set_force_maintenance();
-    m_gc_allocator._u_set_force_free_empty_blocks();
-    m_cgc_allocator._u_set_force_free_empty_blocks();
+    // in concurrent mode mutators run again before sweep, so maintenance waits for remark.
+    if (!concurrent_mark) {
+      m_bitmap_allocator._u_set_force_maintenance();
+      m_gc_allocator._u_set_force_free_empty_blocks();
+      m_cgc_allocator._u_set_force_free_empty_blocks();
+    }
     // release allocator locks so they can be used.
     m_bitmap_allocator._mutex().unlock();
     m_gc_allocator._mutex().unlock();
     m_cgc_allocator._mutex().unlock();
     m_slab_allocator._mutex().unlock();
     m_allocators_unavailable_mutex.unlock();
+    // marks of states mutators did not get to are about to be cleared, sweep them after this mark instead.
+    // a minor collection that skips old states does not clear their marks, so they stay pending.
+    if (!_u_minor_skips_old_states()) {
+      m_lazy_sweep_leftovers = m_pending_sweep.take_unclaimed();
+    }
     // do collection
     {
       // Thread data can not be modified during collection.
       MCPPALLOC_CONCURRENCY_LOCK_ASSUME(m_thread_mutex);
-      _u_setup_gc_threads();
+      // world is stopped, so every root change logged so far is visible.
+      m_roots._u_merge_logs();
+      _u_setup_gc_threads(concurrent_mark, lazy_sweep);
     }
+    m_remark_time_span = duration_type::zero();
     ::std::chrono::high_resolution_clock::time_point t2, tstart;
     tstart = ::std::chrono::high_resolution_clock::now();
     // clear all marks.
     m_clear_mark_time_span = mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->start_clear(); });
-    // clear bitmap
-    m_clear_mark_time_span += ::std::get<::std::chrono::duration<double>>(
-        mcpputil::timed_invoke([&]() { _bitmap_allocator()._for_all_state([](auto &&state) { state->clear_mark_bits(); }); }));
     // wait for clear to finish.
     m_clear_mark_time_span +=
         mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->wait_until_clear_finished(); });
     // make sure all clears are visible to everyone.
     ::std::atomic_thread_fence(::std::memory_order_acq_rel);
+    if (concurrent_mark) {
+      // writes from now on must be seen by remark.
+      m_dirty_page_tracker.reset();
+    }
     // start marking.
     m_mark_time_span = mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->start_mark(); });
-    // wait for marking to finish.
-    m_mark_time_span += mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->wait_until_mark_finished(); });
+    if (concurrent_mark) {
+      m_mark_time_span += ::std::get<::std::chrono::duration<double>>(mcpputil::timed_invoke([&]() { _u_concurrent_mark(); }));
+    } else {
+      // wait for marking to finish.
+      m_mark_time_span +=
+          mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->wait_until_mark_finished(); });
+    }
     // make sure all marks are visible to everyone.
     ::std::atomic_thread_fence(::std::memory_order_acq_rel);
     // start sweeping.
     m_sweep_time_span = mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->start_sweep(); });
-    // do bitmap allocator finalization
-    m_sweep_time_span = ::std::get<::std::chrono::duration<double>>(mcpputil::timed_invoke([&]() {
-      cgc_internal_vector_t<gc_sparse_object_state_t *> to_be_finalized;
-      _bitmap_allocator()._for_all_state([](auto &&state) { finalize(state); });
-    }));
     // wait for sweeping to finish.
     m_sweep_time_span += mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->wait_until_sweep_finished(); });
+    // run bitmap finalizers and hand remaining states to mutators.
+    size_t bitmap_objects_freed = 0;
+    m_sweep_time_span += ::std::get<::std::chrono::duration<double>>(
+        mcpputil::timed_invoke([&]() { bitmap_objects_freed = _u_finish_bitmap_sweep(); }));
     // notify safe to resume threads.
     m_notify_time_span =
         mcpputil::timed_for_each(m_gc_threads, [](auto &&gc_thread) { gc_thread->notify_all_threads_resumed(); });
     // get total timespan
     t2 = ::std::chrono::high_resolution_clock::now();
     m_total_collect_time_span = ::std::chrono::duration_cast<::std::chrono::duration<double>>(t2 - tstart);
+    _u_record_collection_stats(concurrent_mark, bitmap_objects_freed);
+    // live objects in old states are only sure to be marked after a full or sticky collection.
+    m_unmarked_old_objects = _u_minor_skips_old_states();
+    if (minor_collections_per_full() != 0 && (dirty_page_tracker_t::is_supported() || dirty_page_fallback())) {
+      _u_promote_survivors();
+    } else {
+      m_old_generation_valid = false;
+    }
     m_num_collections++;
+    // no gc thread looks at thread states anymore.
+    _u_reclaim_threads();
     m_thread_mutex.lock();
     // tell threads they make wake up.
     m_start_world_condition_mutex.lock();
@@ -461,6 +1294,48 @@ namespace cgc1::details
       wait_for_finalization();
     }
   }
+  void global_kernel_state_t::_u_record_collection_stats(bool concurrent_mark, size_t bitmap_objects_freed)
+  {
+    // the mark time of a concurrent collection includes the remark pause.
+    m_gc_stats.record(gc_phase_t::clear, m_clear_mark_time_span);
+    m_gc_stats.record(gc_phase_t::mark, m_mark_time_span);
+    if (concurrent_mark) {
+      m_gc_stats.record(gc_phase_t::remark, m_remark_time_span);
+    }
+    m_gc_stats.record(gc_phase_t::sweep, m_sweep_time_span);
+    m_gc_stats.record(gc_phase_t::notify, m_notify_time_span);
+    m_gc_stats.record(gc_phase_t::total, m_total_collect_time_span);
+    size_t bytes_marked = 0;
+    for (auto &gc_thread : m_gc_threads) {
+      bytes_marked += gc_thread->bytes_marked();
+      bitmap_objects_freed += gc_thread->bitmap_objects_freed();
+    }
+    m_gc_stats.record_collection(bytes_marked, m_num_freed_in_last_collection, bitmap_objects_freed, m_minor_collection);
+    if (m_minor_collection) {
+      // once most of what was allocated survives, minor collections stop paying for themselves.
+      const auto survival_percent = m_initialization_parameters.minor_survival_percent();
+      const auto allocated = m_bytes_allocated_since_collection.load(::std::memory_order_acquire);
+      m_full_collection_due.store(survival_percent != 0 && bytes_marked * 100 > allocated * survival_percent,
+                                  ::std::memory_order_release);
+      // old objects were not marked, so they count as they did after the last collection.
+      bytes_marked += m_live_bytes_after_collection.load(::std::memory_order_acquire);
+      m_minor_collections_since_full.fetch_add(1, ::std::memory_order_acq_rel);
+    } else {
+      m_full_collection_due.store(false, ::std::memory_order_release);
+      m_minor_collections_since_full.store(0, ::std::memory_order_release);
+    }
+    m_live_bytes_after_collection.store(bytes_marked, ::std::memory_order_release);
+    // bytes still sitting in thread counters are at most a batch per thread, so they are left to count towards next time.
+    m_bytes_allocated_since_collection.store(0, ::std::memory_order_release);
+  }
+  auto global_kernel_state_t::gc_stats() const noexcept -> const gc_stats_t &
+  {
+    return m_gc_stats;
+  }
+  auto global_kernel_state_t::finalizer_stats() const -> cgc_finalizer_stats_t
+  {
+    return m_finalizer_executor.stats();
+  }
   void global_kernel_state_t::_add_num_freed_in_last_collection(size_t num_freed) noexcept
   {
     m_num_freed_in_last_collection += num_freed;
@@ -506,27 +1381,23 @@ namespace cgc1::details
     void *adjusted_top_of_stack = mcpputil::unsafe_cast<uint8_t>(top_of_stack);
     mcpputil::thread_id_manager_t::gs().add_current_thread();
     // this is not a race condition because only this thread could initialize.
-    auto tlks = details::get_tlks();
-    // do not start creating threads during an ongoing collection.
-    wait_for_collection2();
-    // assume we have mutex and thread mutex from wait for collection 2 specs.
-    MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_mutex);
-    MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_thread_mutex);
-    // if no tlks, create one.
-    if (tlks == nullptr) {
-      tlks = ::mcpputil::make_unique_allocator<details::thread_local_kernel_state_t, cgc_internal_malloc_allocator_t<void>>()
-                 .release();
-      set_tlks(tlks);
-      // make sure gc kernel is initialized.
+    if (mcpputil_unlikely(details::get_tlks() != nullptr)) {
+      ::std::terminate();
+    }
+    // make sure gc kernel is initialized.
+    if (mcpputil_unlikely(!m_initialized.load(::std::memory_order_acquire))) {
+      wait_for_collection();
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_mutex);
       _u_initialize();
-    } else {
-      {
-        ::std::terminate();
-      }
     }
+    auto tlks =
+        ::mcpputil::make_unique_allocator<details::thread_local_kernel_state_t, cgc_internal_malloc_allocator_t<void>>().release();
+    set_tlks(tlks);
     // set very top of stack.
     tlks->set_top_of_stack(adjusted_top_of_stack);
-    m_threads.push_back(tlks);
+    m_roots.register_log(tlks->root_log());
+    // only waits if threads are stopped, not for the rest of an ongoing collection.
+    tlks->set_registry_slot(m_thread_registry.add(tlks));
     // initialize thread allocators for this thread.
     m_cgc_allocator.initialize_thread();
     m_gc_allocator.initialize_thread();
@@ -534,16 +1405,9 @@ namespace cgc1::details
   void global_kernel_state_t::destroy_current_thread()
   {
     auto tlks = details::get_tlks();
-    // do not start destroying threads during an ongoing collection.
-    wait_for_collection2();
-    // assume we have mutex and thread mutex from wait for collection 2 specs.
-    MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_mutex);
-    MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_thread_mutex);
-    // find thread and erase it from global state
-    const auto it = find(m_threads.begin(), m_threads.end(), tlks);
-    if (mcpputil_unlikely(it == m_threads.end())) {
+    if (mcpputil_unlikely(tlks == nullptr)) {
       // this is a pretty big logic error, so catch in debug mode.
-      ::std::cerr << "can not find thread with id " << tlks->thread_id() << " 614164d3-1ab6-4079-b978-7880aa74b566"
+      ::std::cerr << "can not find thread with id " << ::std::this_thread::get_id() << " 614164d3-1ab6-4079-b978-7880aa74b566"
                   << ::std::endl;
       ::std::terminate();
     }
@@ -551,13 +1415,17 @@ namespace cgc1::details
     m_gc_allocator.destroy_thread();
     m_cgc_allocator.destroy_thread();
     m_bitmap_allocator.destroy_thread();
-    // remove thread from gks.
-    m_threads.erase(it);
-    // this will delete our tks.
-    ::std::unique_ptr<details::thread_local_kernel_state_t, cgc_internal_malloc_deleter_t> tlks_deleter(tlks);
+    // remove thread from gks, a collection may still be looking at the tlks so it is freed later.
+    m_thread_registry.remove(tlks->registry_slot());
+    set_tlks(nullptr);
     // mcpputil::thread_id_manager_t::gs().remove_current_thread();
     // do this to make any changes to state globally visible.
     ::std::atomic_thread_fence(::std::memory_order_release);
+    // free states of threads that left if no collection is running, otherwise that collection frees them.
+    if (m_mutex.try_lock()) {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD_TAKE(m_mutex);
+      _u_reclaim_threads();
+    }
     /*#ifndef _WIN32
     details::stop_thread_suspension();
     #endif*/
@@ -574,28 +1442,45 @@ namespace cgc1::details
     details::initialize_thread_suspension();
 #endif
     m_gc_allocator.initialize(::mcpputil::pow2(33), ::mcpputil::pow2(36));
-    //      const size_t num_gc_threads = ::std::thread::hardware_concurrency();
-    const size_t num_gc_threads = 1;
-    // add gc threads
-    for (size_t i = 0; i < num_gc_threads; ++i) {
-      {
-        m_gc_threads.emplace_back(make_unique_malloc<gc_thread_t>());
-      }
+    if (m_initialization_parameters.numa()) {
+      _u_initialize_numa();
     }
+    _u_create_gc_threads(m_initialization_parameters.num_gc_threads(), m_initialization_parameters.mark_stack_size());
     m_initialized = true;
+    // collector registers itself once this thread releases the gks locks.
+    if (m_initialization_parameters.background_collection()) {
+      m_background_collector.start();
+    }
+    m_finalizer_executor.start(m_initialization_parameters.finalizer_threads(),
+                               m_initialization_parameters.finalizer_queue_size());
   }
 #ifndef _WIN32
   void global_kernel_state_t::_u_suspend_threads()
   {
+    const auto suspend_start_time = ::std::chrono::high_resolution_clock::now();
     // adopt the lock since we need to be able to lock/unlock it.
     ::std::unique_lock<decltype(m_mutex)> lock(m_mutex, ::std::adopt_lock);
+    // threads can not join or leave until the registry is opened when they resume.
+    m_thread_registry.close();
+    const auto num_other_threads = m_thread_registry.size() - 1;
+    // this thread must never stop itself at a safepoint poll.
+    get_tlks()->try_claim_stop();
+    m_safepoint_requested.store(true, ::std::memory_order_release);
+    // give threads polling at safepoints a chance to stop on their own.
+    const auto grace_period = ::std::chrono::microseconds(m_initialization_parameters.safepoint_grace_period());
+    if (grace_period.count() != 0) {
+      lock.unlock();
+      while (m_num_paused_threads.load(::std::memory_order_acquire) != num_other_threads &&
+             ::std::chrono::high_resolution_clock::now() - suspend_start_time < grace_period) {
+        ::std::this_thread::yield();
+      }
+      lock.lock();
+    }
     // for each thread
-    for (auto state : m_threads) {
-      // don't want to suspend this thread.
-      if (state->thread_id() == ::std::this_thread::get_id()) {
-        {
-          continue;
-        }
+    m_thread_registry.for_each([](thread_local_kernel_state_t *state) {
+      // threads already stopping on their own, and this thread, are already claimed.
+      if (!state->try_claim_stop()) {
+        return;
       }
       // send signal to stop it.
       if (mcpputil_unlikely(cgc1::pthread_kill(state->thread_handle(), SIGUSR1))) {
@@ -603,13 +1488,17 @@ namespace cgc1::details
         // there is no way to recover from this error.
         ::std::terminate();
       }
-    }
+    });
     // wait for all threads to stop
-    // note threads.size() can not change out from under us here by logic.
-    // in particular we can't add threads during collection cycle.
     lock.unlock();
     ::std::chrono::high_resolution_clock::time_point start_time = ::std::chrono::high_resolution_clock::now();
-    while (m_num_paused_threads.load(::std::memory_order_acquire) != m_threads.size() - 1) {
+    while (m_num_paused_threads.load(::std::memory_order_acquire) != num_other_threads) {
+      // pauses only count up while stopping, so a count past the registry never comes back.
+      if (mcpputil_unlikely(m_num_paused_threads.load(::std::memory_order_acquire) > num_other_threads)) {
+        ::std::cerr << "CGC1: More threads paused than are registered, a thread was stopped twice or missed by the registry "
+                       "0252db3c-4e34-4eef-89a3-9b846f579ecf\n";
+        ::std::terminate();
+      }
       // os friendly spin a bit.
       ::std::this_thread::yield();
       ::std::chrono::high_resolution_clock::time_point cur_time = ::std::chrono::high_resolution_clock::now();
@@ -620,13 +1509,19 @@ namespace cgc1::details
         }
       }
     }
+    m_gc_stats.record(gc_phase_t::time_to_safepoint, ::std::chrono::high_resolution_clock::now() - suspend_start_time);
     lock.lock();
     // we shouldn't unlock at end of this.
     lock.release();
   }
   void global_kernel_state_t::_u_resume_threads()
   {
+    // cleared before waking so resumed threads do not stop again at a stale request.
+    m_safepoint_requested.store(false, ::std::memory_order_release);
+    get_tlks()->release_stop();
+    m_world_resumed.notify_all();
     m_start_world_condition.notify_all();
+    m_thread_registry.open();
   }
   void global_kernel_state_t::_collect_current_thread()
   {
@@ -638,33 +1533,30 @@ namespace cgc1::details
     }
     // set stack pointer.
     tlks->set_stack_ptr(__builtin_frame_address(0));
+    // read before announcing pause, world can not resume until every thread paused.
+    const auto resume_epoch = m_world_resumed.epoch();
     // Make sure all data is committed.
     ::std::atomic_thread_fence(std::memory_order_release);
     m_num_paused_threads++;
-    {
-      // Make sure that allocators are available by now since we need them for our conditional.
-      // We don't actually need to hold the lock, just wait if it is locked.
-      // this is an os lock so there isn't a better way to do this.
-      m_allocators_unavailable_mutex.lock();
-      m_allocators_unavailable_mutex.unlock();
-    }
-    ::mcpputil::unique_lock_t<decltype(m_start_world_condition_mutex)> lock(m_start_world_condition_mutex);
-    // deadlock potential here if conditional var sets mutexes in kernel
-    // so we use our own conditional variable implementation.
-    m_start_world_condition.wait(lock, [this]() { return m_collect_finished.load(::std::memory_order_acquire); });
-    // do this inside lock just to prevent race conditions.
-    // This is defensive programming only, it shouldn't be required.
+    // futex wait takes no locks, so resuming does not make every thread fight over a mutex.
+    m_world_resumed.wait(resume_epoch);
     tlks->set_in_signal_handler(false);
+    tlks->release_stop();
     // this thread is resumed.
     m_num_resumed_threads++;
-    lock.unlock();
   }
 #else
   void global_kernel_state_t::_u_suspend_threads()
   {
+    const auto suspend_start_time = ::std::chrono::high_resolution_clock::now();
+    // threads can not join or leave until the registry is opened when they resume.
+    m_thread_registry.close();
     // for each thread.
-    for (auto it = m_threads.begin() + 1; it != m_threads.end(); ++it) {
-      auto state = *it;
+    m_thread_registry.for_each([this](thread_local_kernel_state_t *state) {
+      // don't touch this thread.
+      if (state->thread_id() == ::std::this_thread::get_id()) {
+        return;
+      }
       // we may have to retry mutliple times.
       for (size_t i = 0; i < 5000; ++i) {
         // bug in Windows function spec!
@@ -716,24 +1608,26 @@ namespace cgc1::details
           continue;
         state->add_potential_root(*context_it);
       }
-    }
+    });
+    m_gc_stats.record(gc_phase_t::time_to_safepoint, ::std::chrono::high_resolution_clock::now() - suspend_start_time);
     ::std::atomic_thread_fence(std::memory_order_release);
   }
   void global_kernel_state_t::_u_resume_threads()
   {
-    for (auto state : m_threads) {
+    m_thread_registry.for_each([](thread_local_kernel_state_t *state) {
       // don't touch this thread.
       if (state->thread_id() == ::std::this_thread::get_id())
-        continue;
+        return;
       // reset tlks
       state->set_stack_ptr(nullptr);
       state->set_in_signal_handler(false);
       // resume threads.
       if (static_cast<int>(::ResumeThread(state->thread_handle())) < 0)
         ::std::terminate();
-    }
+    });
     // force commit.
     ::std::atomic_thread_fence(std::memory_order_release);
+    m_thread_registry.open();
   }
   void global_kernel_state_t::_collect_current_thread()
   {
@@ -743,14 +1637,14 @@ namespace cgc1::details
       -> ::mcppalloc::details::allocation_failure_action_t
   {
     g_gks->gc_allocator().initialize_thread()._do_maintenance();
-    g_gks->force_collect();
+    g_gks->_collect_for_allocation_failure();
     return ::mcppalloc::details::allocation_failure_action_t{false, failure.m_failures < 5};
   }
   auto gc_bitmap_allocator_thread_policy_t::on_allocation_failure(const ::mcppalloc::details::allocation_failure_t &failure)
       -> ::mcppalloc::details::allocation_failure_action_t
   {
     g_gks->gc_allocator().initialize_thread()._do_maintenance();
-    g_gks->force_collect();
+    g_gks->_collect_for_allocation_failure();
     return ::mcppalloc::details::allocation_failure_action_t{false, failure.m_failures < 5};
   }
 }
@@ -1,10 +1,20 @@
 #pragma once
+#include "background_collector.hpp"
+#include "bitmap_finalization.hpp"
+#include "bitmap_user_data_table.hpp"
+#include "dirty_page_tracker.hpp"
+#include "epoch_event.hpp"
+#include "finalizer_executor.hpp"
 #include "gc_allocator.hpp"
+#include "gc_stats.hpp"
 #include "gc_thread.hpp"
 #include "global_kernel_state_param.hpp"
 #include "internal_allocator.hpp"
 #include "internal_declarations.hpp"
+#include "pending_sweep_set.hpp"
 #include "root_collection.hpp"
+#include "thread_registry.hpp"
+#include "typed_descriptor.hpp"
 #include <atomic>
 #include <cgc1/cgc_internal_malloc_allocator.hpp>
 #include <condition_variable>
@@ -12,6 +22,7 @@
 #include <mcppalloc/mcppalloc_slab_allocator/slab_allocator.hpp>
 #include <mcppalloc/mcppalloc_sparse/allocator.hpp>
 #include <mcpputil/mcpputil/concurrency.hpp>
+#include <utility>
 #include <vector>
 
 #include <boost/property_tree/ptree_fwd.hpp>
@@ -86,8 +97,9 @@ namespace cgc1::details
      * \brief Force a garbage collection.
      *
      * @param do_local_finalization Should the thread do local finalization.
+     * @param minor Only collect the young generation if generational collection can, otherwise do a full collection.
      **/
-    void force_collect(bool do_local_finalization = true)
+    void force_collect(bool do_local_finalization = true, bool minor = false)
         REQUIRES(!m_mutex, !m_thread_mutex, !m_allocators_unavailable_mutex, !m_start_world_condition_mutex);
     /**
      * \brief Return the number of collections that have happened.
@@ -95,6 +107,89 @@ namespace cgc1::details
      * May wrap around.
      **/
     size_t num_collections() const;
+    /**
+     * \brief Set free space divisor used to pace automatic collections.
+     *
+     * Zero disables automatic collection.
+     **/
+    void set_free_space_divisor(size_t divisor) noexcept;
+    /**
+     * \brief Return free space divisor used to pace automatic collections.
+     **/
+    auto free_space_divisor() const noexcept -> size_t;
+    /**
+     * \brief Set number of minor collections automatic collection may run between full collections.
+     *
+     * Zero disables generational collection, the old generation is only tracked when this is nonzero.
+     **/
+    void set_minor_collections_per_full(size_t num) noexcept;
+    /**
+     * \brief Return number of minor collections automatic collection may run between full collections.
+     **/
+    auto minor_collections_per_full() const noexcept -> size_t;
+    /**
+     * \brief Set if minor collections should keep mark bits of survivors instead of skipping old bitmap states.
+     *
+     * Takes effect at the next collection that can use it.
+     **/
+    void set_sticky_mark_bits(bool sticky) noexcept;
+    /**
+     * \brief Return true if minor collections keep mark bits of survivors.
+     **/
+    auto sticky_mark_bits() const noexcept -> bool;
+    /**
+     * \brief Set if marking should run concurrently with mutators when supported.
+     *
+     * Takes effect at the next collection.
+     **/
+    void set_concurrent_mark(bool concurrent) noexcept;
+    /**
+     * \brief Return true if marking should run concurrently with mutators when supported.
+     **/
+    auto concurrent_mark() const noexcept -> bool;
+    /**
+     * \brief Set if every page in use should be treated as dirty instead of asking the dirty page tracker.
+     *
+     * Lets concurrent marking and minor collections run without dirty page tracking,
+     * at the cost of rescanning the whole heap at remark and every minor collection.
+     **/
+    void set_dirty_page_fallback(bool fallback) noexcept;
+    /**
+     * \brief Return true if every page in use is treated as dirty.
+     **/
+    auto dirty_page_fallback() const noexcept -> bool;
+    /**
+     * \brief Set if bitmap states should be swept by mutators on allocation instead of during collection.
+     *
+     * Takes effect at the next collection, states already pending stay pending.
+     **/
+    void set_lazy_sweep(bool lazy) noexcept;
+    /**
+     * \brief Return true if bitmap states are swept by mutators on allocation.
+     **/
+    auto lazy_sweep() const noexcept -> bool;
+    /**
+     * \brief Set budget in microseconds of each slice of incremental marking, zero to not mark incrementally.
+     *
+     * Takes effect at the next collection.
+     **/
+    void set_incremental_mark_budget(size_t microseconds) noexcept;
+    /**
+     * \brief Return budget in microseconds of each slice of incremental marking.
+     **/
+    auto incremental_mark_budget() const noexcept -> size_t;
+    /**
+     * \brief Return true if the next automatic collection should be minor.
+     *
+     * It should not if too much survived the last minor collection.
+     **/
+    bool _minor_collection_due() const noexcept;
+    /**
+     * \brief Return bytes allocated since last collection.
+     *
+     * Threads report allocations in batches, so this lags behind by up to a batch per thread.
+     **/
+    auto bytes_allocated_since_collection() const noexcept -> size_t;
     /**
      * \brief Initialize the current thread for garbage collection.
      *
@@ -111,6 +206,12 @@ namespace cgc1::details
      * This calls into the thread kernel state's collect.
      **/
     void _collect_current_thread() REQUIRES(!m_mutex, !m_thread_mutex, !m_allocators_unavailable_mutex);
+    /**
+     * \brief Stop current thread here if a collection is waiting for it.
+     *
+     * Lets threads reach a safepoint without being signalled.
+     **/
+    void safepoint() REQUIRES(!m_mutex, !m_thread_mutex, !m_allocators_unavailable_mutex);
     /**
      * \brief Return the GC allocator.
      **/
@@ -127,21 +228,56 @@ namespace cgc1::details
      * \brief Return the internal slab allocator.
      **/
     auto _internal_slab_allocator() const noexcept -> internal_slab_allocator_type &;
+    /**
+     * \brief Return side table of bitmap allocation user data.
+     **/
+    auto _bitmap_user_data() noexcept -> bitmap_user_data_table_t &;
+    /**
+     * \brief Return executor that runs finalizers outside of collections.
+     **/
+    auto _finalizer_executor() noexcept -> finalizer_executor_t &;
     /**
      * \brief Return the thread local kernel state for the current thread.
      *
      * @return nullptr on error.
      **/
-    thread_local_kernel_state_t *tlks(::std::thread::id id) REQUIRES(!m_thread_mutex);
+    thread_local_kernel_state_t *tlks(::std::thread::id id);
 
     auto allocate(size_t sz) -> details::gc_allocator_t::block_type;
     auto allocate_atomic(size_t sz) -> details::gc_allocator_t::block_type;
     auto allocate_raw(size_t sz) -> details::gc_allocator_t::block_type;
     auto allocate_sparse(size_t sz) -> details::gc_allocator_t::block_type;
+    /**
+     * \brief Allocate count objects of sz bytes into out.
+     *
+     * Polls for safepoints and paces once for the whole batch, so no collection starts while out is being filled.
+     * @return Number of objects allocated.
+     **/
+    auto allocate_many(size_t sz, size_t count, void **out) -> size_t;
+    /**
+     * \brief Allocate an object that is only scanned at the pointer slots given by descriptor.
+     **/
+    auto allocate_typed(size_t sz, cgc_descriptor_t descriptor) -> details::gc_allocator_t::block_type;
+    /**
+     * \brief Return descriptor for an object whose first num_words words are described by bitmap.
+     **/
+    auto make_descriptor(const uint64_t *bitmap, size_t num_words) -> cgc_descriptor_t;
     void deallocate(void *v);
 
-    auto root_collection();
-    auto root_collection() const;
+    auto &root_collection();
+    const auto &root_collection() const;
+    /**
+     * \brief Add single root.
+     *
+     * Registered threads log the change instead of waiting for the collection lock.
+     **/
+    void add_root(void **root) REQUIRES(!m_mutex);
+    /**
+     * \brief Remove single root.
+     *
+     * Registered threads log the change, but wait for a running collection that may still scan the root.
+     **/
+    void remove_root(void **root) REQUIRES(!m_mutex);
     /**
      * \brief Wait for finalization of the last collection to finish.
      **/
@@ -176,6 +312,21 @@ namespace cgc1::details
      **/
     template <typename Container>
     void _add_need_special_finalizing_collection(Container &container) REQUIRES(!m_mutex);
+    /**
+     * \brief Add deferred bitmap finalizers that no finalizer thread could take.
+     *
+     * They run on a user thread in local_thread_finalization.
+     * Objects must already be pending finalization.
+     **/
+    void _add_need_special_finalizing_bitmap(::gsl::span<deferred_finalizer_t> finalizers) REQUIRES(!m_mutex);
+    /**
+     * \brief Keep objects of deferred finalizers alive until _remove_pending_finalization.
+     **/
+    void _add_pending_finalization(::gsl::span<const deferred_finalizer_t> finalizers) REQUIRES(!m_mutex);
+    /**
+     * \brief Let objects of deferred finalizers that have run be collected.
+     **/
+    void _remove_pending_finalization(::gsl::span<const deferred_finalizer_t> finalizers) REQUIRES(!m_mutex);
     /**
      * \brief Add number of pointers that were freed in last collection.
      *
@@ -195,6 +346,35 @@ namespace cgc1::details
      * Returns hidden pointers.
      **/
     cgc_internal_vector_t<uintptr_t> _d_freed_in_last_collection() const REQUIRES(!m_mutex);
+    /**
+     * \brief Return true if the bitmap object at addr is in the old generation.
+     *
+     * Only meaningful while generational collection is enabled.
+     **/
+    bool _d_in_old_generation(void *addr) const REQUIRES(!m_mutex);
+    /**
+     * \brief Replace gc threads by num_gc_threads new gc threads with given mark stack size.
+     *
+     * Waits for finalization of the previous collection first.
+     * Zero gc threads means one per hardware thread.
+     **/
+    void _d_set_gc_threads(size_t num_gc_threads, size_t mark_stack_size) REQUIRES(!m_mutex, !m_thread_mutex);
+    /**
+     * \brief Return number of gc threads.
+     **/
+    size_t _d_num_gc_threads() const REQUIRES(!m_mutex);
+    /**
+     * \brief Return true if the bitmap state containing addr was marked but not swept yet.
+     **/
+    bool _d_sweep_pending(void *addr) const;
+    /**
+     * \brief Return number of registered threads.
+     **/
+    size_t _d_num_threads() const noexcept;
+    /**
+     * \brief Return number of threads that left but whose states were not reclaimed yet.
+     **/
+    size_t _d_num_retired_threads() const noexcept;
     /**
      * \brief Return true if the object state is valid, false otherwise.
      **/
@@ -221,6 +401,12 @@ namespace cgc1::details
      * \brief Return time for mark phase of gc.
      **/
     auto mark_time_span() const -> duration_type;
+    /**
+     * \brief Return time for remark pause of concurrent mark.
+     *
+     * Zero if the last collection did not mark concurrently.
+     **/
+    auto remark_time_span() const -> duration_type;
     /**
      * \brief Return time for sweep phase of gc.
      **/
@@ -233,6 +419,14 @@ namespace cgc1::details
      * \brief Return total gc collect time.
      **/
     auto total_collect_time_span() const -> duration_type;
+    /**
+     * \brief Return statistics over all collections.
+     **/
+    auto gc_stats() const noexcept -> const gc_stats_t &;
+    /**
+     * \brief Return statistics of finalizer executor.
+     **/
+    auto finalizer_stats() const -> cgc_finalizer_stats_t;
 
     RETURN_CAPABILITY(m_mutex) auto _mutex() const -> mutex_type &;
 
@@ -253,6 +447,12 @@ namespace cgc1::details
      * This may be called multiple times, but will be a nop if already called.
      **/
     void _u_initialize() REQUIRES(m_mutex);
+    /**
+     * \brief Create num_gc_threads gc threads with given mark stack size.
+     *
+     * Zero gc threads means one per hardware thread.
+     **/
+    void _u_create_gc_threads(size_t num_gc_threads, size_t mark_stack_size) REQUIRES(m_mutex);
     /**
      * \brief Pause all threads.
      *
@@ -265,16 +465,162 @@ namespace cgc1::details
      * Abort on error because usually these errors are unrecoverable.
      **/
     void _u_resume_threads() REQUIRES(m_thread_mutex);
+    /**
+     * \brief Assign every registered thread to a gc thread.
+     **/
+    void _u_assign_threads() REQUIRES(m_mutex);
+    /**
+     * \brief Free states of threads that left once nothing can still see them.
+     **/
+    void _u_reclaim_threads() REQUIRES(m_mutex);
     /**
      * \brief Do per collection gc thread setup.
      *
      * When called during collection, does not require m_thread_mutex as that data is frozen.
      **/
-    void _u_setup_gc_threads() REQUIRES(m_mutex, m_thread_mutex);
+    void _u_setup_gc_threads(bool concurrent_mark, bool lazy_sweep) REQUIRES(m_mutex, m_thread_mutex);
+    /**
+     * \brief Hand out bitmap states to gc threads for clearing and sweeping.
+     **/
+    void _u_partition_bitmap_states() REQUIRES(m_mutex);
+    /**
+     * \brief Hand out bitmap states to gc threads pinned to the node their stripe is bound to.
+     **/
+    void _u_partition_bitmap_states_by_node() REQUIRES(m_mutex);
+    /**
+     * \brief Stripe heaps across NUMA nodes, gc threads created afterwards are pinned to nodes.
+     *
+     * Leaves NUMA mode off if the machine has one node or a heap could not be striped.
+     **/
+    void _u_initialize_numa() REQUIRES(m_mutex);
+    /**
+     * \brief Concurrently mark while mutators run, then stop the world and remark.
+     *
+     * Called with world stopped after gc threads were told to start marking.
+     * Returns with world stopped and marking finished.
+     **/
+    void _u_concurrent_mark() REQUIRES(m_mutex);
+    /**
+     * \brief Let gc threads trace for one slice of incremental marking and wait for them.
+     *
+     * Does nothing if no incremental mark is in progress or another thread is running a slice.
+     **/
+    void _mark_slice() REQUIRES(!m_mark_slice_mutex);
+    /**
+     * \brief Return budget of each slice of incremental marking, zero if marking is not incremental.
+     **/
+    auto _mark_slice_budget() const noexcept -> ::std::chrono::microseconds;
+    /**
+     * \brief Let mutators run again in the middle of a collection.
+     **/
+    void _u_resume_world_for_concurrent_mark() REQUIRES(m_mutex, !m_thread_mutex);
+    /**
+     * \brief Stop mutators again to finish a concurrent mark.
+     **/
+    void _u_stop_world_for_remark() REQUIRES(m_mutex, !m_thread_mutex);
+    /**
+     * \brief Hand out sparse blocks and dirty pages to gc threads for remark.
+     *
+     * Root assignments from the first pause remain valid because they can not change during collection.
+     * Threads may join or leave while marking concurrently, so they are assigned again.
+     **/
+    void _u_setup_gc_threads_for_remark() REQUIRES(m_mutex);
     /**
      * \brief Get a vector of sparse states that need to be finalized by this thread.
      **/
     REQUIRES(m_mutex) auto _u_get_local_finalization_vector_sparse() -> cgc_internal_vector_t<gc_sparse_object_state_t *>;
+    /**
+     * \brief Sweep bitmap state containing a just allocated object if it is pending a lazy sweep.
+     **/
+    void _lazy_sweep_after_allocation(thread_local_kernel_state_t &tlks, void *ptr);
+    /**
+     * \brief Slow path of _lazy_sweep_after_allocation.
+     **/
+    void _lazy_sweep_state_of(thread_local_kernel_state_t &tlks, void *ptr);
+    /**
+     * \brief Sweep every pending state of the bitmap allocator of this thread.
+     *
+     * States full of garbage have no free slot, so the allocator never picks them and they are never swept on allocation.
+     * This runs when the allocator moves on to a state that needs no sweep and before a collection is triggered,
+     * so their memory is reused in this cycle instead of being swept by the next pause.
+     * Only states of this thread are taken, other threads may be allocating from theirs.
+     **/
+    void _lazy_sweep_own_states(thread_local_kernel_state_t &tlks);
+    /**
+     * \brief Count an allocation of sz bytes and collect first if the heap grew enough since the last collection.
+     **/
+    void _pace_allocation(thread_local_kernel_state_t &tlks, size_t sz);
+    /**
+     * \brief Stop at safepoint if a collection is waiting for threads to stop.
+     **/
+    void _poll_safepoint(thread_local_kernel_state_t &tlks);
+    /**
+     * \brief Slow path of _poll_safepoint.
+     **/
+    void _stop_at_safepoint(thread_local_kernel_state_t &tlks);
+    /**
+     * \brief Slow path of _pace_allocation.
+     **/
+    void _pace_allocation_slow(thread_local_kernel_state_t &tlks);
+    /**
+     * \brief Free memory after an allocator ran out.
+     *
+     * Waits for the background collector if it runs, otherwise collects on this thread.
+     **/
+    void _collect_for_allocation_failure() REQUIRES(!m_mutex, !m_thread_mutex);
+    /**
+     * \brief Run local finalizers left by background collections this thread has not seen yet.
+     **/
+    void _local_finalization_after_background_collection() REQUIRES(!m_mutex);
+    /**
+     * \brief Return true if a stopped thread was interrupted while looking up or sweeping a pending state.
+     **/
+    bool _u_any_thread_in_lazy_sweep() const REQUIRES(m_thread_mutex);
+    /**
+     * \brief Finish bitmap sweep after gc threads swept.
+     *
+     * Runs bitmap finalizers and hands states left by gc threads to mutators for lazy sweeping.
+     * @return Number of bitmap objects freed by this thread.
+     **/
+    auto _u_finish_bitmap_sweep() -> size_t REQUIRES(m_mutex);
+    /**
+     * \brief Add the collection that just finished to gc stats.
+     **/
+    void _u_record_collection_stats(bool concurrent_mark, size_t bitmap_objects_freed) REQUIRES(m_mutex);
+    /**
+     * \brief Put pages written since the last collection in dirty pages.
+     *
+     * @return False if they could not be found, in which case a minor collection is impossible.
+     **/
+    bool _u_collect_remembered_pages() REQUIRES(m_mutex);
+    /**
+     * \brief Put every page of live bitmap states and of sparse blocks in use in dirty pages.
+     *
+     * The world must be stopped.
+     **/
+    void _u_add_in_use_pages() REQUIRES(m_mutex);
+    /**
+     * \brief Put pages of live bitmap states and of sparse blocks in use written since the last reset in dirty pages.
+     *
+     * Only ranges in use are read, so the cost does not grow with reserved address space.
+     * The world must be stopped.
+     * @return False if they could not be found, in which case every page in use must be assumed dirty.
+     **/
+    bool _u_collect_in_use_dirty_pages() REQUIRES(m_mutex);
+    /**
+     * \brief Put ranges of live bitmap states and of sparse blocks in use in in use ranges, sorted and merged.
+     *
+     * The world must be stopped.
+     **/
+    void _u_find_in_use_ranges() REQUIRES(m_mutex);
+    /**
+     * \brief Make every bitmap state old and start tracking writes for the next minor collection.
+     **/
+    void _u_promote_survivors() REQUIRES(m_mutex);
+    /**
+     * \brief Return true if the current collection neither marks nor sweeps old objects.
+     **/
+    bool _u_minor_skips_old_states() const noexcept REQUIRES(m_mutex);
     /**
      * \brief Internal slab allocator used for internal allocator.
      **/
@@ -314,6 +660,52 @@ namespace cgc1::details
      * May wrap around.
      **/
     mutable ::std::atomic<size_t> m_num_collections{0};
+    /**
+     * \brief Bytes a thread allocates before adding them to the shared allocation count.
+     **/
+    static const constexpr size_t cs_pacer_flush_size = 64 * 1024;
+    /**
+     * \brief Smallest live heap size used to compute the collection trigger.
+     *
+     * Prevents back to back collections while the heap is nearly empty.
+     **/
+    static const constexpr size_t cs_pacer_min_live_size = 4 * 1024 * 1024;
+    /**
+     * \brief Multiple of the collection trigger at which mutators wait for the background collector.
+     **/
+    static const constexpr size_t cs_pacer_hard_limit_factor = 2;
+    /**
+     * \brief Bytes allocated since last collection.
+     **/
+    ::std::atomic<size_t> m_bytes_allocated_since_collection{0};
+    /**
+     * \brief Bytes marked in last collection.
+     **/
+    ::std::atomic<size_t> m_live_bytes_after_collection{0};
+    /**
+     * \brief Free space divisor used to pace automatic collections.
+     **/
+    ::std::atomic<size_t> m_free_space_divisor{0};
+    /**
+     * \brief Runs automatic collections if enabled.
+     **/
+    background_collector_t m_background_collector;
+    /**
+     * \brief Runs finalizers outside of collections if enabled.
+     **/
+    finalizer_executor_t m_finalizer_executor;
+    /**
+     * \brief Number of background collections whose local finalizers were run.
+     **/
+    ::std::atomic<size_t> m_background_collections_finalized{0};
+    /**
+     * \brief True while a collection wants all threads stopped.
+     **/
+    ::std::atomic<bool> m_safepoint_requested{false};
+    /**
+     * \brief Notified when stopped threads may resume.
+     **/
+    epoch_event_t m_world_resumed;
 #ifndef _WIN32
     /**
      * \brief Condition variable used to broadcast
@@ -328,7 +720,7 @@ namespace cgc1::details
     mutable condition_variable_any_t m_start_world_condition;
 #endif
     /**
-     * \brief Mutex for protecting m_threads.
+     * \brief Mutex held while suspending and resuming threads.
      **/
     mutable mutex_type m_thread_mutex;
     /**
@@ -340,11 +732,133 @@ namespace cgc1::details
     mutable root_collection_t<root_collection_policy_type> m_roots{sc_collection_lock,
                                                                    cgc_internal_malloc_allocator_t<void **>()};
     /**
-     * \brief Vector of all threads registered with the kernel.
+     * \brief All threads registered with the kernel.
      *
-     * This is a vector for cache locality.
+     * Closed while threads are stopped, otherwise threads join and leave without waiting for a collection.
      **/
-    cgc_internal_vector_t<details::thread_local_kernel_state_t *> m_threads GUARDED_BY(m_thread_mutex);
+    thread_registry_t m_thread_registry;
+    /**
+     * \brief State shared between gc threads for parallel marking.
+     *
+     * Must outlive gc threads.
+     **/
+    parallel_mark_state_t m_parallel_mark_state;
+    /**
+     * \brief Tracks pages written by mutators during concurrent mark or since the last collection.
+     **/
+    dirty_page_tracker_t m_dirty_page_tracker;
+    /**
+     * \brief Pages written by mutators during the last concurrent mark or before the current minor collection.
+     **/
+    cgc_internal_vector_t<uint8_t *> m_dirty_pages GUARDED_BY(m_mutex);
+    /**
+     * \brief Ranges of heap memory in use, found when dirty pages are needed.
+     **/
+    cgc_internal_vector_t<::std::pair<uint8_t *, uint8_t *>> m_in_use_ranges GUARDED_BY(m_mutex);
+    /**
+     * \brief Bitmap states marked in the last collection that mutators have not swept yet.
+     **/
+    pending_sweep_set_t m_pending_sweep;
+    /**
+     * \brief Finalizers and abort on collect flags of bitmap allocations.
+     **/
+    bitmap_user_data_table_t m_bitmap_user_data;
+    /**
+     * \brief Layouts of descriptors too long to be inline.
+     **/
+    typed_layout_registry_t m_typed_layouts;
+    /**
+     * \brief Bitmap states of this collection, partitioned between gc threads.
+     **/
+    cgc_internal_vector_t<pending_sweep_set_t::state_type *> m_bitmap_states GUARDED_BY(m_mutex);
+    /**
+     * \brief Bitmap states of this collection grouped by NUMA node, only used in NUMA mode.
+     **/
+    cgc_internal_vector_t<pending_sweep_set_t::state_type *> m_numa_bitmap_states GUARDED_BY(m_mutex);
+    /**
+     * \brief Number of NUMA nodes heaps are striped across, one if NUMA mode is off.
+     **/
+    size_t m_num_numa_nodes GUARDED_BY(m_mutex) = 1;
+    /**
+     * \brief Size of stripes of the bitmap heap.
+     **/
+    size_t m_numa_stripe_size GUARDED_BY(m_mutex) = 0;
+    /**
+     * \brief States no mutator swept before the current collection, sorted by address.
+     *
+     * Their marks are stale, so they are swept during this collection once marking finishes.
+     **/
+    cgc_internal_vector_t<pending_sweep_set_t::state_type *> m_lazy_sweep_leftovers GUARDED_BY(m_mutex);
+    /**
+     * \brief Bitmap states that existed at the end of the last collection, sorted by address.
+     *
+     * States not in here are young.
+     **/
+    cgc_internal_vector_t<pending_sweep_set_t::state_type *> m_old_bitmap_states GUARDED_BY(m_mutex);
+    /**
+     * \brief True if old states and dirty pages since the last collection are known, so a minor collection is possible.
+     **/
+    bool m_old_generation_valid GUARDED_BY(m_mutex) = false;
+    /**
+     * \brief True if the current collection is minor.
+     **/
+    bool m_minor_collection GUARDED_BY(m_mutex) = false;
+    /**
+     * \brief True if the current collection is minor and keeps mark bits of survivors.
+     **/
+    bool m_sticky_collection GUARDED_BY(m_mutex) = false;
+    /**
+     * \brief True if old states may hold live unmarked objects.
+     *
+     * A minor collection that skipped old states leaves these, and sticky mark bits would take them for garbage.
+     **/
+    bool m_unmarked_old_objects GUARDED_BY(m_mutex) = false;
+    /**
+     * \brief True if minor collections should keep mark bits of survivors.
+     **/
+    ::std::atomic<bool> m_sticky_mark_bits{false};
+    /**
+     * \brief True if too much survived the last minor collection, so the next automatic collection is full.
+     **/
+    ::std::atomic<bool> m_full_collection_due{false};
+    /**
+     * \brief Mutex held while running a mark slice, so only one runs at a time.
+     **/
+    mutable mutex_type m_mark_slice_mutex;
+    /**
+     * \brief Pauses of mark slices in the current collection, merged into stats when marking finishes.
+     *
+     * Slices already hold the slice mutex, so mutators never wait on the stats lock.
+     **/
+    latency_histogram_t m_mark_slice_latencies GUARDED_BY(m_mark_slice_mutex);
+    /**
+     * \brief True while gc threads trace incrementally and wait for slices.
+     **/
+    ::std::atomic<bool> m_incremental_mark_active{false};
+    /**
+     * \brief Number of minor collections automatic collection may run between full collections.
+     **/
+    ::std::atomic<size_t> m_minor_collections_per_full{0};
+    /**
+     * \brief True if marking should run concurrently with mutators when supported.
+     **/
+    ::std::atomic<bool> m_concurrent_mark{false};
+    /**
+     * \brief True if every page in use is treated as dirty.
+     **/
+    ::std::atomic<bool> m_dirty_page_fallback{false};
+    /**
+     * \brief True if bitmap states are swept by mutators on allocation.
+     **/
+    ::std::atomic<bool> m_lazy_sweep{false};
+    /**
+     * \brief Budget in microseconds of each slice of incremental marking.
+     **/
+    ::std::atomic<size_t> m_incremental_mark_budget{0};
+    /**
+     * \brief Number of minor collections since the last full collection.
+     **/
+    ::std::atomic<size_t> m_minor_collections_since_full{0};
     /**
      * \brief Threads that do the actual garbage collection.
      *
@@ -366,6 +880,16 @@ namespace cgc1::details
      * The idea is that the finalizers for these need to run in a special thread(s).
      **/
     cgc_internal_vector_t<gc_sparse_object_state_t *> m_need_special_finalizing_collection_sparse GUARDED_BY(m_mutex);
+    /**
+     * \brief Deferred bitmap finalizers waiting for a user thread.
+     **/
+    cgc_internal_vector_t<deferred_finalizer_t> m_need_special_finalizing_bitmap GUARDED_BY(m_mutex);
+    /**
+     * \brief Objects whose finalizers are waiting for a finalizer thread.
+     *
+     * Marked every collection until their finalizers have run.
+     **/
+    cgc_internal_vector_t<void *> m_pending_finalization GUARDED_BY(m_mutex);
     /**
      * \brief True while a garbage collection is running or trying to run, otherwise false.
      **/
@@ -380,8 +904,10 @@ namespace cgc1::details
     ::std::atomic<long> m_enabled_count{1};
     /**
      * \brief True if the kernel has been initialized, false otherwise.
+     *
+     * Only set while holding m_mutex, registering threads check it without.
      **/
-    bool m_initialized GUARDED_BY(m_mutex) = false;
+    ::std::atomic<bool> m_initialized{false};
     //
     //
     // Debug information under here.
@@ -399,6 +925,10 @@ namespace cgc1::details
      * \brief Time for mark phase of gc.
      **/
     duration_type m_mark_time_span = duration_type::zero();
+    /**
+     * \brief Time for remark pause of concurrent mark.
+     **/
+    duration_type m_remark_time_span = duration_type::zero();
     /**
      * \brief Time for sweep phase of gc.
      **/
@@ -411,6 +941,10 @@ namespace cgc1::details
      * \brief Total gc collect time.
      **/
     duration_type m_total_collect_time_span = duration_type::zero();
+    /**
+     * \brief Statistics over all collections.
+     **/
+    gc_stats_t m_gc_stats;
     /**
      * \brief Saved initialization parameters.
      **/
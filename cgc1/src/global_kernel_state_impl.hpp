@@ -19,15 +19,19 @@ namespace cgc1::details
   {
     return m_slab_allocator;
   }
+  inline auto global_kernel_state_t::_bitmap_user_data() noexcept -> bitmap_user_data_table_t &
+  {
+    return m_bitmap_user_data;
+  }
+  inline auto global_kernel_state_t::_finalizer_executor() noexcept -> finalizer_executor_t &
+  {
+    return m_finalizer_executor;
+  }
   inline auto global_kernel_state_t::tlks(::std::thread::id id) -> thread_local_kernel_state_t *
   {
-    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_thread_mutex);
-    auto it = ::std::find_if(m_threads.begin(), m_threads.end(),
-                             [id](thread_local_kernel_state_t *tlks) { return tlks->thread_id() == id; });
-    if (it == m_threads.end()) {
-      return nullptr;
-    }
-    return *it;
+    // states seen while guarded are not freed under us.
+    thread_registry_t::read_guard_t guard(m_thread_registry);
+    return m_thread_registry.find(id);
   }
   template <typename Container>
   void global_kernel_state_t::_add_freed_in_last_collection(Container &container)
@@ -54,15 +58,36 @@ namespace cgc1::details
     return ::mcppalloc::sparse::details::is_valid_object_state(os, _internal_allocator().underlying_memory().begin(),
                                                                _internal_allocator()._u_current_end());
   }
+  inline void global_kernel_state_t::_lazy_sweep_after_allocation(thread_local_kernel_state_t &tlks, void *ptr)
+  {
+    if (mcpputil_likely(m_pending_sweep.empty()) || mcpputil_unlikely(!ptr)) {
+      return;
+    }
+    _lazy_sweep_state_of(tlks, ptr);
+  }
+  inline void global_kernel_state_t::_pace_allocation(thread_local_kernel_state_t &tlks, size_t sz)
+  {
+    if (mcpputil_likely(!tlks.add_bytes_allocated(sz, cs_pacer_flush_size))) {
+      return;
+    }
+    _pace_allocation_slow(tlks);
+  }
+  inline void global_kernel_state_t::_poll_safepoint(thread_local_kernel_state_t &tlks)
+  {
+    if (mcpputil_likely(!m_safepoint_requested.load(::std::memory_order_relaxed))) {
+      return;
+    }
+    _stop_at_safepoint(tlks);
+  }
   inline auto global_kernel_state_t::_mutex() const -> mutex_type &
   {
     return m_mutex;
   }
-  inline auto global_kernel_state_t::root_collection()
+  inline auto &global_kernel_state_t::root_collection()
   {
     return m_roots;
   }
-  inline auto global_kernel_state_t::root_collection() const
+  inline const auto &global_kernel_state_t::root_collection() const
   {
     return m_roots;
   }
@@ -1,4 +1,5 @@
 #include "global_kernel_state_param.hpp"
+#include <cstdlib>
 #include <mcpputil/mcpputil/boost/property_tree/ptree.hpp>
 namespace cgc1
 {
@@ -32,6 +33,66 @@ namespace cgc1
   {
     m_internal_allocator_expansion_size = sz;
   }
+  void global_kernel_state_param_t::set_num_gc_threads(size_t num)
+  {
+    m_num_gc_threads = num;
+  }
+  void global_kernel_state_param_t::set_mark_stack_size(size_t sz)
+  {
+    m_mark_stack_size = sz;
+  }
+  void global_kernel_state_param_t::set_concurrent_mark(bool concurrent)
+  {
+    m_concurrent_mark = concurrent;
+  }
+  void global_kernel_state_param_t::set_dirty_page_fallback(bool fallback)
+  {
+    m_dirty_page_fallback = fallback;
+  }
+  void global_kernel_state_param_t::set_lazy_sweep(bool lazy)
+  {
+    m_lazy_sweep = lazy;
+  }
+  void global_kernel_state_param_t::set_free_space_divisor(size_t divisor)
+  {
+    m_free_space_divisor = divisor;
+  }
+  void global_kernel_state_param_t::set_background_collection(bool background)
+  {
+    m_background_collection = background;
+  }
+  void global_kernel_state_param_t::set_safepoint_grace_period(size_t microseconds)
+  {
+    m_safepoint_grace_period = microseconds;
+  }
+  void global_kernel_state_param_t::set_minor_collections_per_full(size_t num)
+  {
+    m_minor_collections_per_full = num;
+  }
+  void global_kernel_state_param_t::set_sticky_mark_bits(bool sticky)
+  {
+    m_sticky_mark_bits = sticky;
+  }
+  void global_kernel_state_param_t::set_minor_survival_percent(size_t percent)
+  {
+    m_minor_survival_percent = percent;
+  }
+  void global_kernel_state_param_t::set_incremental_mark_budget(size_t microseconds)
+  {
+    m_incremental_mark_budget = microseconds;
+  }
+  void global_kernel_state_param_t::set_finalizer_threads(size_t num)
+  {
+    m_finalizer_threads = num;
+  }
+  void global_kernel_state_param_t::set_finalizer_queue_size(size_t size)
+  {
+    m_finalizer_queue_size = size;
+  }
+  void global_kernel_state_param_t::set_numa(bool numa)
+  {
+    m_numa = numa;
+  }
   auto global_kernel_state_param_t::slab_allocator_start_size() const noexcept -> size_t
   {
     return m_slab_allocator_start_size;
@@ -56,6 +117,134 @@ namespace cgc1
   {
     return m_internal_allocator_expansion_size;
   }
+  auto global_kernel_state_param_t::num_gc_threads() const noexcept -> size_t
+  {
+    return m_num_gc_threads;
+  }
+  auto global_kernel_state_param_t::mark_stack_size() const noexcept -> size_t
+  {
+    return m_mark_stack_size;
+  }
+  auto global_kernel_state_param_t::concurrent_mark() const noexcept -> bool
+  {
+    return m_concurrent_mark;
+  }
+  auto global_kernel_state_param_t::dirty_page_fallback() const noexcept -> bool
+  {
+    return m_dirty_page_fallback;
+  }
+  auto global_kernel_state_param_t::lazy_sweep() const noexcept -> bool
+  {
+    return m_lazy_sweep;
+  }
+  auto global_kernel_state_param_t::free_space_divisor() const noexcept -> size_t
+  {
+    return m_free_space_divisor;
+  }
+  auto global_kernel_state_param_t::background_collection() const noexcept -> bool
+  {
+    return m_background_collection;
+  }
+  auto global_kernel_state_param_t::safepoint_grace_period() const noexcept -> size_t
+  {
+    return m_safepoint_grace_period;
+  }
+  auto global_kernel_state_param_t::minor_collections_per_full() const noexcept -> size_t
+  {
+    return m_minor_collections_per_full;
+  }
+  auto global_kernel_state_param_t::sticky_mark_bits() const noexcept -> bool
+  {
+    return m_sticky_mark_bits;
+  }
+  auto global_kernel_state_param_t::minor_survival_percent() const noexcept -> size_t
+  {
+    return m_minor_survival_percent;
+  }
+  auto global_kernel_state_param_t::incremental_mark_budget() const noexcept -> size_t
+  {
+    return m_incremental_mark_budget;
+  }
+  auto global_kernel_state_param_t::finalizer_threads() const noexcept -> size_t
+  {
+    return m_finalizer_threads;
+  }
+  auto global_kernel_state_param_t::finalizer_queue_size() const noexcept -> size_t
+  {
+    return m_finalizer_queue_size;
+  }
+  auto global_kernel_state_param_t::numa() const noexcept -> bool
+  {
+    return m_numa;
+  }
+  /**
+   * \brief Read a size_t from environment variable name into out.
+   *
+   * @return True on success, false if missing or malformed.
+   **/
+  static bool read_size_from_environment(const char *name, size_t &out)
+  {
+    const char *str = ::std::getenv(name);
+    if (str == nullptr || *str == '\0') {
+      return false;
+    }
+    char *end = nullptr;
+    const auto val = ::std::strtoull(str, &end, 10);
+    if (*end != '\0') {
+      return false;
+    }
+    out = static_cast<size_t>(val);
+    return true;
+  }
+  void global_kernel_state_param_t::load_from_environment()
+  {
+    size_t val = 0;
+    if (read_size_from_environment("CGC1_NUM_GC_THREADS", val)) {
+      set_num_gc_threads(val);
+    }
+    if (read_size_from_environment("CGC1_MARK_STACK_SIZE", val)) {
+      set_mark_stack_size(val);
+    }
+    if (read_size_from_environment("CGC1_CONCURRENT_MARK", val)) {
+      set_concurrent_mark(val != 0);
+    }
+    if (read_size_from_environment("CGC1_DIRTY_PAGE_FALLBACK", val)) {
+      set_dirty_page_fallback(val != 0);
+    }
+    if (read_size_from_environment("CGC1_LAZY_SWEEP", val)) {
+      set_lazy_sweep(val != 0);
+    }
+    if (read_size_from_environment("CGC1_FREE_SPACE_DIVISOR", val)) {
+      set_free_space_divisor(val);
+    }
+    if (read_size_from_environment("CGC1_BACKGROUND_COLLECTION", val)) {
+      set_background_collection(val != 0);
+    }
+    if (read_size_from_environment("CGC1_SAFEPOINT_GRACE_PERIOD", val)) {
+      set_safepoint_grace_period(val);
+    }
+    if (read_size_from_environment("CGC1_MINOR_COLLECTIONS_PER_FULL", val)) {
+      set_minor_collections_per_full(val);
+    }
+    if (read_size_from_environment("CGC1_STICKY_MARK_BITS", val)) {
+      set_sticky_mark_bits(val != 0);
+    }
+    if (read_size_from_environment("CGC1_MINOR_SURVIVAL_PERCENT", val)) {
+      set_minor_survival_percent(val);
+    }
+    if (read_size_from_environment("CGC1_INCREMENTAL_MARK_BUDGET", val)) {
+      set_incremental_mark_budget(val);
+    }
+    if (read_size_from_environment("CGC1_FINALIZER_THREADS", val)) {
+      set_finalizer_threads(val);
+    }
+    if (read_size_from_environment("CGC1_FINALIZER_QUEUE_SIZE", val)) {
+      set_finalizer_queue_size(val);
+    }
+    if (read_size_from_environment("CGC1_NUMA", val)) {
+      set_numa(val != 0);
+    }
+  }
   void global_kernel_state_param_t::to_ptree(::boost::property_tree::ptree &ptree) const
   {
     ptree.put("slab_allocator_start_size", ::std::to_string(slab_allocator_start_size()));
@@ -64,5 +253,20 @@ namespace cgc1
     ptree.put("packed_allocator_expansion_size", ::std::to_string(packed_allocator_expansion_size()));
     ptree.put("internal_allocator_start_size", ::std::to_string(internal_allocator_start_size()));
     ptree.put("internal_allocator_expansion_size", ::std::to_string(internal_allocator_expansion_size()));
+    ptree.put("num_gc_threads", ::std::to_string(num_gc_threads()));
+    ptree.put("mark_stack_size", ::std::to_string(mark_stack_size()));
+    ptree.put("concurrent_mark", ::std::to_string(concurrent_mark()));
+    ptree.put("dirty_page_fallback", ::std::to_string(dirty_page_fallback()));
+    ptree.put("lazy_sweep", ::std::to_string(lazy_sweep()));
+    ptree.put("free_space_divisor", ::std::to_string(free_space_divisor()));
+    ptree.put("background_collection", ::std::to_string(background_collection()));
+    ptree.put("safepoint_grace_period", ::std::to_string(safepoint_grace_period()));
+    ptree.put("minor_collections_per_full", ::std::to_string(minor_collections_per_full()));
+    ptree.put("sticky_mark_bits", ::std::to_string(sticky_mark_bits()));
+    ptree.put("minor_survival_percent", ::std::to_string(minor_survival_percent()));
+    ptree.put("incremental_mark_budget", ::std::to_string(incremental_mark_budget()));
+    ptree.put("finalizer_threads", ::std::to_string(finalizer_threads()));
+    ptree.put("finalizer_queue_size", ::std::to_string(finalizer_queue_size()));
+    ptree.put("numa", ::std::to_string(numa()));
   }
 }
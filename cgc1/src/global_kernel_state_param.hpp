@@ -36,6 +36,93 @@ namespace cgc1
      * \brief Set expansion size of internal allocator.
      **/
     void set_internal_allocator_expansion_size(size_t sz);
+    /**
+     * \brief Set number of gc threads.
+     *
+     * Zero means one per hardware thread.
+     **/
+    void set_num_gc_threads(size_t num);
+    /**
+     * \brief Set number of objects each gc thread mark stack holds before overflowing.
+     **/
+    void set_mark_stack_size(size_t sz);
+    /**
+     * \brief Set if marking should run concurrently with mutators when supported.
+     **/
+    void set_concurrent_mark(bool concurrent);
+    /**
+     * \brief Set if every page in use should be treated as dirty instead of asking the dirty page tracker.
+     *
+     * Lets concurrent marking and minor collections run when the kernel can not track dirty pages.
+     **/
+    void set_dirty_page_fallback(bool fallback);
+    /**
+     * \brief Set if bitmap states should be swept by mutators on allocation instead of during collection.
+     **/
+    void set_lazy_sweep(bool lazy);
+    /**
+     * \brief Set free space divisor used to pace automatic collections.
+     *
+     * A collection is triggered once bytes allocated since the last one exceed live heap divided by this.
+     * Zero disables automatic collection.
+     **/
+    void set_free_space_divisor(size_t divisor);
+    /**
+     * \brief Set if automatic collections should run on a background thread instead of the allocating thread.
+     **/
+    void set_background_collection(bool background);
+    /**
+     * \brief Set microseconds to wait for threads to stop on their own at a safepoint before signalling them.
+     *
+     * Zero signals threads right away.
+     **/
+    void set_safepoint_grace_period(size_t microseconds);
+    /**
+     * \brief Set number of minor collections automatic collection may run between full collections.
+     *
+     * Minor collections only collect bitmap states created since the last collection.
+     * Zero disables generational collection.
+     **/
+    void set_minor_collections_per_full(size_t num);
+    /**
+     * \brief Set if minor collections should keep mark bits of survivors instead of skipping old bitmap states.
+     *
+     * Objects allocated into free slots of old states are then collected by minor collections too.
+     **/
+    void set_sticky_mark_bits(bool sticky);
+    /**
+     * \brief Set percent of bytes allocated between collections that may survive a minor collection.
+     *
+     * If more survive the next automatic collection is full.
+     * Zero disables this policy.
+     **/
+    void set_minor_survival_percent(size_t percent);
+    /**
+     * \brief Set microseconds each slice of incremental marking may run.
+     *
+     * Nonzero makes marking concurrent when supported, but tracing only runs in slices.
+     * Mutators run a slice when they allocate, the collecting thread runs one every budget otherwise.
+     * Zero disables incremental marking.
+     **/
+    void set_incremental_mark_budget(size_t microseconds);
+    /**
+     * \brief Set number of threads that run finalizers outside of collections.
+     *
+     * Zero runs finalizers on gc threads and user threads as before.
+     **/
+    void set_finalizer_threads(size_t num);
+    /**
+     * \brief Set number of finalizer tasks that may wait for a finalizer thread.
+     *
+     * Tasks that do not fit run on a user thread when it next does local finalization.
+     **/
+    void set_finalizer_queue_size(size_t size);
+    /**
+     * \brief Set if heaps are striped across NUMA nodes and gc threads pinned to nodes.
+     *
+     * Has no effect on systems with one node or without NUMA support.
+     **/
+    void set_numa(bool numa);
     /**
      * \brief Return size of slab allocator at start.
      **/
@@ -60,6 +147,84 @@ namespace cgc1
      * \brief Return expansion size of internal allocator.
      **/
     auto internal_allocator_expansion_size() const noexcept -> size_t;
+    /**
+     * \brief Return number of gc threads.
+     *
+     * Zero means one per hardware thread.
+     **/
+    auto num_gc_threads() const noexcept -> size_t;
+    /**
+     * \brief Return number of objects each gc thread mark stack holds before overflowing.
+     **/
+    auto mark_stack_size() const noexcept -> size_t;
+    /**
+     * \brief Return true if marking should run concurrently with mutators when supported.
+     **/
+    auto concurrent_mark() const noexcept -> bool;
+    /**
+     * \brief Return true if every page in use should be treated as dirty instead of asking the dirty page tracker.
+     **/
+    auto dirty_page_fallback() const noexcept -> bool;
+    /**
+     * \brief Return true if bitmap states should be swept by mutators on allocation instead of during collection.
+     **/
+    auto lazy_sweep() const noexcept -> bool;
+    /**
+     * \brief Return free space divisor used to pace automatic collections.
+     *
+     * Zero means automatic collection is disabled.
+     **/
+    auto free_space_divisor() const noexcept -> size_t;
+    /**
+     * \brief Return true if automatic collections should run on a background thread instead of the allocating thread.
+     **/
+    auto background_collection() const noexcept -> bool;
+    /**
+     * \brief Return microseconds to wait for threads to stop on their own at a safepoint before signalling them.
+     **/
+    auto safepoint_grace_period() const noexcept -> size_t;
+    /**
+     * \brief Return number of minor collections automatic collection may run between full collections.
+     *
+     * Zero means generational collection is disabled.
+     **/
+    auto minor_collections_per_full() const noexcept -> size_t;
+    /**
+     * \brief Return true if minor collections should keep mark bits of survivors instead of skipping old bitmap states.
+     **/
+    auto sticky_mark_bits() const noexcept -> bool;
+    /**
+     * \brief Return percent of bytes allocated between collections that may survive a minor collection.
+     *
+     * Zero means the policy is disabled.
+     **/
+    auto minor_survival_percent() const noexcept -> size_t;
+    /**
+     * \brief Return microseconds each slice of incremental marking may run.
+     *
+     * Zero means incremental marking is disabled.
+     **/
+    auto incremental_mark_budget() const noexcept -> size_t;
+    /**
+     * \brief Return number of threads that run finalizers outside of collections.
+     *
+     * Zero means finalizers run on gc threads and user threads.
+     **/
+    auto finalizer_threads() const noexcept -> size_t;
+    /**
+     * \brief Return number of finalizer tasks that may wait for a finalizer thread.
+     **/
+    auto finalizer_queue_size() const noexcept -> size_t;
+    /**
+     * \brief Return true if heaps are striped across NUMA nodes and gc threads pinned to nodes.
+     **/
+    auto numa() const noexcept -> bool;
+    /**
+     * \brief Override settings from CGC1_* environment variables if present.
+     *
+     * Variables that are missing or do not parse are ignored.
+     **/
+    void load_from_environment();
     /**
      * \brief Put settings into a property tree.
      **/
@@ -90,5 +255,65 @@ namespace cgc1
      * \brief Expansion size of internal allocator.
      **/
     size_t m_internal_allocator_expansion_size = ::mcpputil::pow2(33);
+    /**
+     * \brief Number of gc threads.
+     **/
+    size_t m_num_gc_threads = 0;
+    /**
+     * \brief Number of objects each gc thread mark stack holds before overflowing.
+     **/
+    size_t m_mark_stack_size = ::mcpputil::pow2(16);
+    /**
+     * \brief True if marking should run concurrently with mutators when supported.
+     **/
+    bool m_concurrent_mark = false;
+    /**
+     * \brief True if every page in use should be treated as dirty.
+     **/
+    bool m_dirty_page_fallback = false;
+    /**
+     * \brief True if bitmap states should be swept by mutators on allocation.
+     **/
+    bool m_lazy_sweep = false;
+    /**
+     * \brief Free space divisor used to pace automatic collections.
+     **/
+    size_t m_free_space_divisor = 0;
+    /**
+     * \brief True if automatic collections should run on a background thread.
+     **/
+    bool m_background_collection = false;
+    /**
+     * \brief Microseconds to wait for threads to stop on their own at a safepoint.
+     **/
+    size_t m_safepoint_grace_period = 0;
+    /**
+     * \brief Number of minor collections between full collections.
+     **/
+    size_t m_minor_collections_per_full = 0;
+    /**
+     * \brief True if minor collections keep mark bits of survivors.
+     **/
+    bool m_sticky_mark_bits = false;
+    /**
+     * \brief Percent of bytes allocated between collections that may survive a minor collection.
+     **/
+    size_t m_minor_survival_percent = 50;
+    /**
+     * \brief Microseconds each slice of incremental marking may run.
+     **/
+    size_t m_incremental_mark_budget = 0;
+    /**
+     * \brief Number of threads that run finalizers outside of collections.
+     **/
+    size_t m_finalizer_threads = 0;
+    /**
+     * \brief Number of finalizer tasks that may wait for a finalizer thread.
+     **/
+    size_t m_finalizer_queue_size = 1024;
+    /**
+     * \brief True if heaps are striped across NUMA nodes.
+     **/
+    bool m_numa = false;
   };
 }
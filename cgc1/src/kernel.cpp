@@ -3,6 +3,7 @@
 #include "global_kernel_state.hpp"
 #include "internal_declarations.hpp"
 #include "thread_local_kernel_state.hpp"
+#include <algorithm>
 #include <cgc1/cgc1.hpp>
 #include <cgc1/cgc1_dll.hpp>
 #include <cgc1/hide_pointer.hpp>
@@ -21,6 +22,7 @@ namespace cgc1
     {
       if (nullptr == details::g_gks) {
         global_kernel_state_param_t param;
+        param.load_from_environment();
         get_gks() = make_unique_malloc<details::global_kernel_state_t>(param);
         g_gks = get_gks().get();
         get_gks()->initialize();
@@ -52,6 +54,31 @@ namespace cgc1
     {
       return details::g_gks->gc_allocator().underlying_memory().memory_range().contains(addr);
     }
+    /**
+     * \brief Return memory range of allocation cache.
+     **/
+    static auto allocation_cache_range(thread_allocation_cache_t &cache) -> ::mcpputil::system_memory_range_t
+    {
+      const auto begin = reinterpret_cast<uint8_t *>(cache.m_objects.data());
+      return ::mcpputil::system_memory_range_t(begin, begin + sizeof(cache.m_objects));
+    }
+    CGC1_DLL_PUBLIC void *refill_thread_allocation_cache(thread_allocation_cache_t &cache, size_t size_class)
+    {
+      if (mcpputil_unlikely(!cache.m_registered)) {
+        cgc_add_range(allocation_cache_range(cache));
+        get_tlks()->add_allocation_cache(&cache);
+        cache.m_registered = true;
+      }
+      const auto object_size = thread_allocation_cache_t::object_size(size_class);
+      auto &objects = cache.m_objects[size_class];
+      // objects is a root, so it may be filled in one batch.
+      // this polls for safepoints and paces for the whole batch, which the inline path skips.
+      const auto count = static_cast<uint32_t>(g_gks->allocate_many(object_size, objects.size(), objects.data()));
+      // hand out lowest addresses first.
+      ::std::reverse(objects.begin(), objects.begin() + count);
+      cache.m_count[size_class] = count;
+      return g_gks->allocate(object_size).m_ptr;
+    }
   }
   namespace debug
   {
@@ -95,18 +122,89 @@ namespace cgc1
   {
     return ::cgc1::details::g_gks->allocate(sz);
   }
+  CGC1_DLL_PUBLIC size_t cgc_malloc_many(size_t sz, size_t count, void **out)
+  {
+    return ::cgc1::details::g_gks->allocate_many(sz, count, out);
+  }
+  CGC1_DLL_PUBLIC cgc_descriptor_t cgc_make_descriptor(const uint64_t *bitmap, size_t num_words)
+  {
+    return ::cgc1::details::g_gks->make_descriptor(bitmap, num_words);
+  }
+  CGC1_DLL_PUBLIC void *cgc_malloc_typed(size_t sz, cgc_descriptor_t descriptor)
+  {
+    return ::cgc1::details::g_gks->allocate_typed(sz, descriptor).m_ptr;
+  }
   CGC1_DLL_PUBLIC uintptr_t cgc_hidden_malloc(size_t sz)
   {
     void *addr = cgc_malloc(sz);
     return ::mcpputil::hide_pointer(addr);
   }
-  CGC1_DLL_PUBLIC void *cgc_realloc(void *v, size_t sz)
+  /**
+   * \brief Return user data of a sparse object start or nullptr if it has none.
+   **/
+  static auto sparse_user_data(void *object) -> details::gc_user_data_t *
   {
-    void *ret = cgc_malloc(sz);
-    if (nullptr != v) {
-      {
-        ::memcpy(ret, v, sz);
+    if (!details::is_sparse_allocator(object)) {
+      return nullptr;
+    }
+    details::gc_sparse_object_state_t *const os =
+        details::gc_sparse_object_state_t::template from_object_start<details::gc_sparse_object_state_t>(object);
+    return static_cast<details::gc_user_data_t *>(os->user_data());
+  }
+  /**
+   * \brief Allocate sz bytes of the same kind (atomic, typed, uncollectable) as object.
+   **/
+  static void *cgc_malloc_like(void *object, size_t sz)
+  {
+    if (details::is_bitmap_allocator(object)) {
+      const auto state = ::mcppalloc::bitmap_allocator::details::get_state(object);
+      if (state->type_id() == details::cs_bitmap_allocation_type_atomic) {
+        return cgc_malloc_atomic(sz);
+      }
+      if (state->type_id() == details::cs_bitmap_allocation_type_typed) {
+        return cgc_malloc_typed(sz, *details::bitmap_typed_descriptor(state, object));
       }
+      return cgc_malloc(sz);
+    }
+    details::gc_sparse_object_state_t *const os =
+        details::gc_sparse_object_state_t::template from_object_start<details::gc_sparse_object_state_t>(object);
+    if (details::is_atomic(os)) {
+      return cgc_malloc_atomic(sz);
+    }
+    const auto ud = sparse_user_data(object);
+    if (ud != nullptr && ud->is_uncollectable()) {
+      return cgc_malloc_uncollectable(sz);
+    }
+    if (ud != nullptr && ud->descriptor() != details::cs_conservative_descriptor) {
+      return cgc_malloc_typed(sz, ud->descriptor());
+    }
+    return cgc_malloc(sz);
+  }
+  CGC1_DLL_PUBLIC void *cgc_realloc(void *v, size_t sz)
+  {
+    if (nullptr == v) {
+      return cgc_malloc(sz);
+    }
+    // callers may be C, so report bad addresses through the return value like realloc.
+    if (mcpputil_unlikely(cgc_start(v) != v)) {
+      return nullptr;
+    }
+    if (sz == 0) {
+      cgc_free(v);
+      return nullptr;
+    }
+    const size_t old_size = cgc_size(v);
+    if (sz <= old_size) {
+      // still fits the bin or sparse object, clear the tail so it does not retain anything.
+      ::mcpputil::secure_zero(reinterpret_cast<uint8_t *>(v) + sz, old_size - sz);
+      return v;
+    }
+    void *const ret = cgc_malloc_like(v, sz);
+    ::memcpy(ret, v, old_size);
+    const auto ud = sparse_user_data(v);
+    if (ud != nullptr && ud->is_uncollectable()) {
+      // uncollectable objects are never collected, so the old copy must be freed here.
+      cgc_free(v);
     }
     return ret;
   }
@@ -157,6 +255,10 @@ namespace cgc1
     if (details::g_gks->_bitmap_allocator().underlying_memory().memory_range().contains(start)) {
       auto state = ::mcppalloc::bitmap_allocator::details::get_state(addr);
       if (state->has_valid_magic_numbers()) {
+        if (state->type_id() == details::cs_bitmap_allocation_type_typed) {
+          // do not hand out the descriptor slot.
+          return state->declared_entry_size() - sizeof(cgc_descriptor_t);
+        }
         return state->declared_entry_size();
       }
       return 0;
@@ -171,7 +273,7 @@ namespace cgc1
   CGC1_DLL_PUBLIC void cgc_add_root(void **v)
   {
     details::check_initialized();
-    details::g_gks->root_collection().add_root(v);
+    details::g_gks->add_root(v);
   }
   CGC1_DLL_PUBLIC void cgc_remove_root(void **v)
   {
@@ -180,7 +282,7 @@ namespace cgc1
         return;
       }
     }
-    details::g_gks->root_collection().remove_root(v);
+    details::g_gks->remove_root(v);
   }
   CGC1_DLL_PUBLIC bool cgc_has_root(void **v)
   {
@@ -227,6 +329,30 @@ namespace cgc1
   {
     return details::g_gks->enabled();
   }
+  CGC1_DLL_PUBLIC void cgc_set_free_space_divisor(size_t divisor)
+  {
+    details::g_gks->set_free_space_divisor(divisor);
+  }
+  CGC1_DLL_PUBLIC size_t cgc_free_space_divisor()
+  {
+    return details::g_gks->free_space_divisor();
+  }
+  CGC1_DLL_PUBLIC void cgc_set_minor_collections_per_full(size_t num)
+  {
+    details::g_gks->set_minor_collections_per_full(num);
+  }
+  CGC1_DLL_PUBLIC size_t cgc_minor_collections_per_full()
+  {
+    return details::g_gks->minor_collections_per_full();
+  }
+  CGC1_DLL_PUBLIC void cgc_set_sticky_mark_bits(bool sticky)
+  {
+    details::g_gks->set_sticky_mark_bits(sticky);
+  }
+  CGC1_DLL_PUBLIC bool cgc_sticky_mark_bits()
+  {
+    return details::g_gks->sticky_mark_bits();
+  }
   CGC1_DLL_PUBLIC void cgc_register_thread(void *top_of_stack)
   {
     details::check_initialized();
@@ -243,6 +369,10 @@ namespace cgc1
   {
     details::g_gks->force_collect(do_local_finalization);
   }
+  CGC1_DLL_PUBLIC void cgc_force_minor_collect(bool do_local_finalization)
+  {
+    details::g_gks->force_collect(do_local_finalization, true);
+  }
   CGC1_DLL_PUBLIC void cgc_wait_collect()
   {
     details::g_gks->wait_for_collection();
@@ -252,8 +382,17 @@ namespace cgc1
   {
     details::g_gks->wait_for_finalization(do_local_finalization);
   }
+  CGC1_DLL_PUBLIC void cgc_safepoint()
+  {
+    details::g_gks->safepoint();
+  }
   CGC1_DLL_PUBLIC void cgc_unregister_thread()
   {
+    // caches are thread local memory that goes away with the thread.
+    for (auto cache : details::get_tlks()->allocation_caches()) {
+      cgc_remove_range(details::allocation_cache_range(*cache));
+      *cache = details::thread_allocation_cache_t();
+    }
     details::g_gks->destroy_current_thread();
   }
   CGC1_DLL_PUBLIC void cgc_shutdown()
@@ -273,15 +412,15 @@ namespace cgc1
         }
       }
     }
-    const auto ba_user_data = details::bitmap_allocator_user_data(addr);
-    if (ba_user_data != nullptr) {
+    if (details::bitmap_user_data_state(addr) != nullptr) {
       const auto ba_state = ::mcppalloc::bitmap_allocator::details::get_state(addr);
       if (mcpputil_unlikely(!ba_state)) {
         {
           throw ::std::runtime_error("cgc1: could not find state to register finalizer: 47af381e-214d-4d4d-85e3-2f7ac93fc20d");
         }
       }
-      if (mcpputil_unlikely(ba_state->type_id() != 2)) {
+      if (mcpputil_unlikely(ba_state->type_id() != details::cs_bitmap_allocation_type_user_data &&
+                            ba_state->type_id() != details::cs_bitmap_allocation_type_typed)) {
         {
           throw ::std::runtime_error(
               "cgc1: tried to finalize wrong type of bitmap allocation: 1bfb19d0-014a-4811-b97e-07fb2720b72a");
@@ -301,6 +440,7 @@ namespace cgc1
       ba_state->user_bits_ref(details::cs_bitmap_allocation_user_bit_finalizeable).set_bit(index, true);
       ba_state->user_bits_ref(details::cs_bitmap_allocation_user_bit_finalizeable_arbitrary_thread)
           .set_bit(index, allow_arbitrary_finalizer_thread);
+      const auto ba_user_data = details::make_bitmap_allocator_user_data(addr);
       ba_user_data->gc_user_data_ref().set_is_default(false);
       ba_user_data->gc_user_data_ref().set_allow_arbitrary_finalizer_thread(allow_arbitrary_finalizer_thread);
       ba_user_data->gc_user_data_ref().m_finalizer = ::std::move(finalizer);
@@ -341,8 +481,8 @@ namespace cgc1
   }
   CGC1_DLL_PUBLIC void cgc_set_abort_on_collect(void *addr, bool abort_on_collect)
   {
-    const auto ba_user_data = details::bitmap_allocator_user_data(addr);
-    if (nullptr == ba_user_data) {
+    const auto ba_state = details::bitmap_user_data_state(addr);
+    if (nullptr == ba_state) {
       if (details::is_sparse_allocator(addr)) {
         throw ::std::runtime_error("cgc1: abort on collect not implemented for sparse allocator");
       } else if (details::is_bitmap_allocator(addr)) {
@@ -351,16 +491,32 @@ namespace cgc1
         throw ::std::runtime_error("cgc1: abort on collect not implemented for unknown allocator");
       }
     } else {
-      ba_user_data->set_abort_on_collect(abort_on_collect);
+      if (!abort_on_collect) {
+        const auto ba_user_data = details::bitmap_allocator_user_data(addr);
+        if (nullptr != ba_user_data) {
+          ba_user_data->set_abort_on_collect(false);
+        }
+        return;
+      }
+      // objects with user data must be visited by finalization so the entry is checked and removed.
+      ba_state->user_bits_ref(details::cs_bitmap_allocation_user_bit_finalizeable).set_bit(ba_state->get_index(addr), true);
+      details::make_bitmap_allocator_user_data(addr)->set_abort_on_collect(true);
     }
   }
+  CGC1_DLL_PUBLIC cgc_gc_stats_t cgc_gc_stats()
+  {
+    return details::g_gks->gc_stats().snapshot();
+  }
+  CGC1_DLL_PUBLIC cgc_finalizer_stats_t cgc_finalizer_stats()
+  {
+    return details::g_gks->finalizer_stats();
+  }
   CGC1_DLL_PUBLIC void cgc_set_uncollectable(void *const addr, const bool is_uncollectable)
   {
     if (nullptr == addr) {
       return;
     }
-    const auto ba_user_data = details::bitmap_allocator_user_data(addr);
-    if (nullptr != ba_user_data) {
+    if (nullptr != details::bitmap_user_data_state(addr)) {
       throw ::std::runtime_error("cgc1: set uncollectable: NOT IMPLEMENTED");
     } else if (details::is_sparse_allocator(addr)) {
       if (nullptr == addr) {
@@ -393,8 +549,7 @@ namespace cgc1
     if (nullptr == start) {
       return;
     }
-    const auto ba_user_data = details::bitmap_allocator_user_data(addr);
-    if (nullptr != ba_user_data) {
+    if (nullptr != details::bitmap_user_data_state(addr)) {
       throw ::std::runtime_error("NOT IMPLEMENTED");
     }
     if (!mcpputil_unlikely(details::is_sparse_allocator(addr))) {
@@ -418,6 +573,7 @@ namespace cgc1
 extern "C" {
 #include "../include/gc/gc_version.h"
 #include <cgc1/gc.h>
+#include <gc/gc_typed.h>
 CGC1_DLL_PUBLIC void *GC_realloc(void *old_object, ::std::size_t new_size)
 {
   return ::cgc1::cgc_realloc(old_object, new_size);
@@ -430,6 +586,27 @@ CGC1_DLL_PUBLIC void *GC_malloc_atomic(::std::size_t size_in_bytes)
 {
   return ::cgc1::cgc_malloc_atomic(size_in_bytes);
 }
+CGC1_DLL_PUBLIC GC_descr GC_make_descriptor(const GC_word *bm, size_t len)
+{
+  static_assert(sizeof(GC_word) == sizeof(uint64_t), "bitmap words must match cgc1 descriptor words");
+  return ::cgc1::cgc_make_descriptor(reinterpret_cast<const uint64_t *>(bm), len);
+}
+CGC1_DLL_PUBLIC void *GC_malloc_explicitly_typed(size_t size_in_bytes, GC_descr d)
+{
+  return ::cgc1::cgc_malloc_typed(size_in_bytes, d);
+}
+CGC1_DLL_PUBLIC void *GC_malloc_many(size_t size_in_bytes)
+{
+  // objects are linked through their first word.
+  const size_t size = ::std::max(size_in_bytes, sizeof(void *));
+  ::std::array<void *, 256> objects{};
+  const size_t count = ::std::min(objects.size(), ::std::max<size_t>(1, 4096 / size));
+  const size_t num_allocated = ::cgc1::cgc_malloc_many(size, count, objects.data());
+  for (size_t i = 0; i + 1 < num_allocated; ++i) {
+    GC_NEXT(objects[i]) = objects[i + 1];
+  }
+  return num_allocated ? objects[0] : nullptr;
+}
 CGC1_DLL_PUBLIC void *GC_malloc_uncollectable(::std::size_t size_in_bytes)
 {
   return ::cgc1::cgc_malloc_uncollectable(size_in_bytes);
@@ -493,7 +670,11 @@ CGC1_DLL_PUBLIC unsigned long GC_get_time_limit()
 }
 CGC1_DLL_PUBLIC long GC_get_free_space_divisor()
 {
-  return 1;
+  return static_cast<long>(::cgc1::cgc_free_space_divisor());
+}
+CGC1_DLL_PUBLIC void GC_set_free_space_divisor(long divisor)
+{
+  ::cgc1::cgc_set_free_space_divisor(static_cast<size_t>(::std::max(divisor, 0L)));
 }
 CGC1_DLL_PUBLIC long GC_get_all_interior_pointers()
 {
@@ -0,0 +1,210 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+namespace cgc1::details
+{
+  /**
+   * \brief Fixed capacity work stealing deque (Chase-Lev).
+   *
+   * The owning thread pushes and pops at the bottom, any other thread may steal from the top.
+   * The capacity is fixed at construction so that no memory reclamation is needed while thieves are active.
+   * @tparam T Trivially copyable element type.
+   * @tparam Allocator Allocator used for the ring buffer.
+   **/
+  template <typename T, typename Allocator>
+  class mark_deque_t
+  {
+  public:
+    static_assert(::std::is_trivially_copyable<T>::value, "Mark deque elements must be trivially copyable");
+    using value_type = T;
+    using slot_type = ::std::atomic<value_type>;
+    using allocator_type = typename ::std::allocator_traits<Allocator>::template rebind_alloc<slot_type>;
+    /**
+     * \brief Default capacity of a mark deque in elements.
+     **/
+    static constexpr const size_t cs_default_capacity = static_cast<size_t>(1) << 16;
+    /**
+     * \brief Constructor.
+     *
+     * @param capacity Number of elements, rounded up to a power of two.
+     **/
+    explicit mark_deque_t(size_t capacity = cs_default_capacity);
+    mark_deque_t(const mark_deque_t &) = delete;
+    mark_deque_t(mark_deque_t &&) = delete;
+    mark_deque_t &operator=(const mark_deque_t &) = delete;
+    mark_deque_t &operator=(mark_deque_t &&) = delete;
+    ~mark_deque_t();
+    /**
+     * \brief Push an element onto the bottom.
+     *
+     * Owner thread only.
+     * @return False if full.
+     **/
+    bool push(value_type value) noexcept;
+    /**
+     * \brief Pop an element from the bottom.
+     *
+     * Owner thread only.
+     * @return False if empty.
+     **/
+    bool pop(value_type &value) noexcept;
+    /**
+     * \brief Steal an element from the top.
+     *
+     * May be called from any thread.
+     * @return False if empty or if the steal lost a race.
+     **/
+    bool steal(value_type &value) noexcept;
+    /**
+     * \brief Return true if the deque appears empty.
+     *
+     * This is only a snapshot when other threads are active.
+     **/
+    bool empty() const noexcept;
+    /**
+     * \brief Return approximate number of elements.
+     **/
+    size_t size() const noexcept;
+    /**
+     * \brief Return capacity in elements.
+     **/
+    size_t capacity() const noexcept;
+    /**
+     * \brief Reset to empty.
+     *
+     * Must not be called while other threads may steal.
+     **/
+    void clear() noexcept;
+
+  private:
+    /**
+     * \brief Allocator for ring buffer.
+     **/
+    allocator_type m_allocator;
+    /**
+     * \brief Capacity minus one.
+     **/
+    const ::std::ptrdiff_t m_mask;
+    /**
+     * \brief Ring buffer.
+     **/
+    slot_type *m_buffer;
+    /**
+     * \brief Index thieves take from.
+     *
+     * Kept on its own cache line to avoid false sharing with the owner.
+     **/
+    alignas(64)::std::atomic<::std::ptrdiff_t> m_top{0};
+    /**
+     * \brief Index owner pushes and pops at.
+     **/
+    alignas(64)::std::atomic<::std::ptrdiff_t> m_bottom{0};
+  };
+  template <typename T, typename Allocator>
+  constexpr const size_t mark_deque_t<T, Allocator>::cs_default_capacity;
+  /**
+   * \brief Round up to next power of two.
+   **/
+  inline size_t mark_deque_capacity_pow2(size_t capacity) noexcept
+  {
+    size_t ret = 2;
+    while (ret < capacity) {
+      ret <<= 1;
+    }
+    return ret;
+  }
+  template <typename T, typename Allocator>
+  mark_deque_t<T, Allocator>::mark_deque_t(size_t capacity)
+      : m_mask(static_cast<::std::ptrdiff_t>(mark_deque_capacity_pow2(capacity)) - 1), m_buffer(nullptr)
+  {
+    const auto num_slots = static_cast<size_t>(m_mask) + 1;
+    m_buffer = m_allocator.allocate(num_slots);
+    for (size_t i = 0; i < num_slots; ++i) {
+      new (m_buffer + i) slot_type(value_type{});
+    }
+  }
+  template <typename T, typename Allocator>
+  mark_deque_t<T, Allocator>::~mark_deque_t()
+  {
+    const auto num_slots = static_cast<size_t>(m_mask) + 1;
+    for (size_t i = 0; i < num_slots; ++i) {
+      m_buffer[i].~slot_type();
+    }
+    m_allocator.deallocate(m_buffer, num_slots);
+  }
+  template <typename T, typename Allocator>
+  bool mark_deque_t<T, Allocator>::push(value_type value) noexcept
+  {
+    const auto bottom = m_bottom.load(::std::memory_order_relaxed);
+    const auto top = m_top.load(::std::memory_order_acquire);
+    if (bottom - top > m_mask) {
+      return false;
+    }
+    m_buffer[bottom & m_mask].store(value, ::std::memory_order_relaxed);
+    ::std::atomic_thread_fence(::std::memory_order_release);
+    m_bottom.store(bottom + 1, ::std::memory_order_relaxed);
+    return true;
+  }
+  template <typename T, typename Allocator>
+  bool mark_deque_t<T, Allocator>::pop(value_type &value) noexcept
+  {
+    const auto bottom = m_bottom.load(::std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, ::std::memory_order_relaxed);
+    ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    auto top = m_top.load(::std::memory_order_relaxed);
+    if (top > bottom) {
+      // empty, restore bottom.
+      m_bottom.store(bottom + 1, ::std::memory_order_relaxed);
+      return false;
+    }
+    value = m_buffer[bottom & m_mask].load(::std::memory_order_relaxed);
+    if (top != bottom) {
+      // more than one element, no race with thieves possible.
+      return true;
+    }
+    // last element, race against thieves for it.
+    const bool won = m_top.compare_exchange_strong(top, top + 1, ::std::memory_order_seq_cst, ::std::memory_order_relaxed);
+    m_bottom.store(bottom + 1, ::std::memory_order_relaxed);
+    return won;
+  }
+  template <typename T, typename Allocator>
+  bool mark_deque_t<T, Allocator>::steal(value_type &value) noexcept
+  {
+    auto top = m_top.load(::std::memory_order_acquire);
+    ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+    const auto bottom = m_bottom.load(::std::memory_order_acquire);
+    if (top >= bottom) {
+      return false;
+    }
+    value = m_buffer[top & m_mask].load(::std::memory_order_relaxed);
+    return m_top.compare_exchange_strong(top, top + 1, ::std::memory_order_seq_cst, ::std::memory_order_relaxed);
+  }
+  template <typename T, typename Allocator>
+  bool mark_deque_t<T, Allocator>::empty() const noexcept
+  {
+    return m_bottom.load(::std::memory_order_acquire) <= m_top.load(::std::memory_order_acquire);
+  }
+  template <typename T, typename Allocator>
+  size_t mark_deque_t<T, Allocator>::size() const noexcept
+  {
+    const auto bottom = m_bottom.load(::std::memory_order_acquire);
+    const auto top = m_top.load(::std::memory_order_acquire);
+    return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+  }
+  template <typename T, typename Allocator>
+  size_t mark_deque_t<T, Allocator>::capacity() const noexcept
+  {
+    return static_cast<size_t>(m_mask) + 1;
+  }
+  template <typename T, typename Allocator>
+  void mark_deque_t<T, Allocator>::clear() noexcept
+  {
+    m_top.store(0, ::std::memory_order_relaxed);
+    m_bottom.store(0, ::std::memory_order_relaxed);
+    ::std::atomic_thread_fence(::std::memory_order_release);
+  }
+}
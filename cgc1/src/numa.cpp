@@ -0,0 +1,130 @@
+#include "numa.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+namespace cgc1::details
+{
+#ifdef __linux__
+  /**
+   * \brief Memory policy preferring a node, falling back to others when it is full.
+   **/
+  static const constexpr int cs_mpol_preferred = 1;
+  /**
+   * \brief Read cpus listed like "0-3,8" from path into cpus.
+   *
+   * @return False if path could not be read.
+   **/
+  static bool read_cpu_list(const char *path, ::std::bitset<numa_topology_t::cs_max_cpus> &cpus) noexcept
+  {
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    ::std::array<char, 4096> buffer{};
+    const auto len = ::read(fd, buffer.data(), buffer.size() - 1);
+    ::close(fd);
+    if (len <= 0) {
+      return false;
+    }
+    const char *cur = buffer.data();
+    while (*cur >= '0' && *cur <= '9') {
+      char *next = nullptr;
+      const size_t first = ::std::strtoul(cur, &next, 10);
+      size_t last = first;
+      if (*next == '-') {
+        last = ::std::strtoul(next + 1, &next, 10);
+      }
+      for (size_t cpu = first; cpu <= last && cpu < cpus.size(); ++cpu) {
+        cpus.set(cpu);
+      }
+      cur = *next == ',' ? next + 1 : next;
+    }
+    return true;
+  }
+  numa_topology_t::numa_topology_t() noexcept
+  {
+    size_t num_nodes = 0;
+    for (size_t id = 0; id < cs_max_nodes; ++id) {
+      ::std::array<char, 64> path{};
+      ::snprintf(path.data(), path.size(), "/sys/devices/system/node/node%zu/cpulist", id);
+      auto &cpus = m_cpus[num_nodes];
+      // nodes with only memory have nothing to pin gc threads to.
+      if (read_cpu_list(path.data(), cpus) && cpus.any()) {
+        m_node_ids[num_nodes++] = id;
+      } else {
+        cpus.reset();
+      }
+    }
+    m_num_nodes = ::std::max(num_nodes, static_cast<size_t>(1));
+  }
+  bool numa_topology_t::pin_thread(details::native_thread_handle_type thread, size_t index) const noexcept
+  {
+    if (index >= m_num_nodes || m_cpus[index].none()) {
+      return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t cpu = 0; cpu < ::std::min(m_cpus[index].size(), static_cast<size_t>(CPU_SETSIZE)); ++cpu) {
+      if (m_cpus[index].test(cpu)) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    return ::pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+  }
+  bool numa_topology_t::bind_memory(void *begin, void *end, size_t index) const noexcept
+  {
+    if (index >= m_num_nodes || end <= begin) {
+      return false;
+    }
+    // kernel wants a mask with a bit per node id.
+    ::std::array<unsigned long, cs_max_nodes / (sizeof(unsigned long) * 8)> mask{};
+    const auto id = m_node_ids[index];
+    mask[id / (sizeof(unsigned long) * 8)] |= 1ul << (id % (sizeof(unsigned long) * 8));
+    const auto len = static_cast<size_t>(static_cast<uint8_t *>(end) - static_cast<uint8_t *>(begin));
+    return ::syscall(SYS_mbind, begin, len, cs_mpol_preferred, mask.data(), cs_max_nodes + 1, 0) == 0;
+  }
+#else
+  numa_topology_t::numa_topology_t() noexcept
+  {
+  }
+  bool numa_topology_t::pin_thread(details::native_thread_handle_type, size_t) const noexcept
+  {
+    return false;
+  }
+  bool numa_topology_t::bind_memory(void *, void *, size_t) const noexcept
+  {
+    return false;
+  }
+#endif
+  auto numa_topology_t::num_nodes() const noexcept -> size_t
+  {
+    return m_num_nodes;
+  }
+  auto numa_topology_t::node_id(size_t index) const noexcept -> size_t
+  {
+    return m_node_ids[index];
+  }
+  auto numa_topology() noexcept -> const numa_topology_t &
+  {
+    static const numa_topology_t s_topology;
+    return s_topology;
+  }
+  bool numa_stripe_heap(void *begin, void *end, size_t stripe_size) noexcept
+  {
+    const auto &topology = numa_topology();
+    bool ret = true;
+    auto stripe = static_cast<uint8_t *>(begin);
+    for (size_t i = 0; stripe < static_cast<uint8_t *>(end); ++i, stripe += stripe_size) {
+      auto stripe_end = ::std::min(stripe + stripe_size, static_cast<uint8_t *>(end));
+      ret = topology.bind_memory(stripe, stripe_end, i % topology.num_nodes()) && ret;
+    }
+    return ret;
+  }
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cgc1/allocated_thread.hpp>
+#include <cstddef>
+#include <cstdint>
+namespace cgc1::details
+{
+  /**
+   * \brief NUMA nodes of the running machine that have cpus.
+   *
+   * On Linux this is read from sysfs, elsewhere there is always one node.
+   **/
+  class numa_topology_t
+  {
+  public:
+    /**
+     * \brief Maximum number of nodes used.
+     **/
+    static const constexpr size_t cs_max_nodes = 64;
+    /**
+     * \brief Maximum number of cpus tracked per node.
+     **/
+    static const constexpr size_t cs_max_cpus = 1024;
+    /**
+     * \brief Return number of nodes, at least one.
+     **/
+    auto num_nodes() const noexcept -> size_t;
+    /**
+     * \brief Return kernel id of node with index.
+     **/
+    auto node_id(size_t index) const noexcept -> size_t;
+    /**
+     * \brief Restrict thread to cpus of node with index.
+     *
+     * @return False if not supported or the kernel refused.
+     **/
+    bool pin_thread(details::native_thread_handle_type thread, size_t index) const noexcept;
+    /**
+     * \brief Prefer allocating pages of [begin, end) on node with index.
+     *
+     * Pages already faulted in are not moved.
+     * @return False if not supported or the kernel refused.
+     **/
+    bool bind_memory(void *begin, void *end, size_t index) const noexcept;
+
+  private:
+    friend auto numa_topology() noexcept -> const numa_topology_t &;
+    numa_topology_t() noexcept;
+    /**
+     * \brief Number of nodes.
+     **/
+    size_t m_num_nodes{1};
+    /**
+     * \brief Kernel ids of nodes.
+     **/
+    ::std::array<size_t, cs_max_nodes> m_node_ids{};
+    /**
+     * \brief Cpus of nodes.
+     **/
+    ::std::array<::std::bitset<cs_max_cpus>, cs_max_nodes> m_cpus{};
+  };
+  /**
+   * \brief Return topology of the running machine.
+   *
+   * Probed once.
+   **/
+  auto numa_topology() noexcept -> const numa_topology_t &;
+  /**
+   * \brief Smallest stripe a heap is split into across nodes.
+   **/
+  static const constexpr size_t cs_min_numa_stripe_size = static_cast<size_t>(1) << 21;
+  /**
+   * \brief Maximum number of stripes per heap, every stripe is a separate kernel mapping.
+   **/
+  static const constexpr size_t cs_max_numa_stripes = 4096;
+  /**
+   * \brief Return size of stripes a heap of size is split into.
+   **/
+  inline auto numa_stripe_size(size_t heap_size) noexcept -> size_t
+  {
+    size_t ret = cs_min_numa_stripe_size;
+    while (ret * cs_max_numa_stripes < heap_size) {
+      ret *= 2;
+    }
+    return ret;
+  }
+  /**
+   * \brief Return index of node that stripe containing addr belongs to.
+   *
+   * Stripes of a heap starting at heap_begin go to nodes in turn.
+   **/
+  inline auto numa_node_of(const void *addr, const void *heap_begin, size_t stripe_size, size_t num_nodes) noexcept -> size_t
+  {
+    const auto offset = static_cast<size_t>(reinterpret_cast<uintptr_t>(addr) - reinterpret_cast<uintptr_t>(heap_begin));
+    return (offset / stripe_size) % num_nodes;
+  }
+  /**
+   * \brief Bind stripes of [begin, end) to nodes in turn.
+   *
+   * @return False if any stripe could not be bound.
+   **/
+  bool numa_stripe_heap(void *begin, void *end, size_t stripe_size) noexcept;
+}
@@ -0,0 +1,46 @@
+#include "parallel_mark_state.hpp"
+namespace cgc1::details
+{
+  constexpr const size_t parallel_mark_state_t::cs_num_mark_lock_stripes;
+  void parallel_mark_state_t::reset()
+  {
+    m_num_active.store(m_deques.size(), ::std::memory_order_release);
+  }
+  size_t parallel_mark_state_t::register_deque(mark_deque_type *deque)
+  {
+    m_deques.push_back(deque);
+    return m_deques.size() - 1;
+  }
+  void parallel_mark_state_t::clear()
+  {
+    m_deques.clear();
+    m_num_active.store(0, ::std::memory_order_release);
+  }
+  bool parallel_mark_state_t::is_parallel() const noexcept
+  {
+    return m_deques.size() > 1;
+  }
+  bool parallel_mark_state_t::_steal(size_t index, void *&addr)
+  {
+    const auto num_deques = m_deques.size();
+    // start with next thread so that thieves spread out over victims.
+    for (size_t i = 1; i < num_deques; ++i) {
+      auto victim = m_deques[(index + i) % num_deques];
+      if (!victim->empty() && victim->steal(addr)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  bool parallel_mark_state_t::find_work(size_t index, void *&addr)
+  {
+    return find_work(index, addr, []() { ::std::this_thread::yield(); });
+  }
+  auto parallel_mark_state_t::mark_lock(const void *state) noexcept -> ::mcpputil::spinlock_t &
+  {
+    // states are aligned so low bits carry no information.
+    const auto val = reinterpret_cast<uintptr_t>(state);
+    const auto hash = (val >> 12) ^ (val >> 18);
+    return m_mark_locks[hash % cs_num_mark_lock_stripes].m_lock;
+  }
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "mark_deque.hpp"
+#include <array>
+#include <atomic>
+#include <cgc1/cgc_internal_malloc_allocator.hpp>
+#include <mcpputil/mcpputil/concurrency.hpp>
+#include <thread>
+#include <vector>
+namespace cgc1::details
+{
+  /**
+   * \brief Work stealing mark stack of marked objects whose contents still need to be scanned.
+   **/
+  using mark_deque_type = mark_deque_t<void *, cgc_internal_malloc_allocator_t<void *>>;
+  /**
+   * \brief State shared between all gc threads during a parallel mark.
+   *
+   * Owns nothing but the termination counter and bitmap mark locks, deques are owned by the gc threads.
+   **/
+  class parallel_mark_state_t
+  {
+  public:
+    /**
+     * \brief Number of stripes for bitmap mark locks.
+     **/
+    static constexpr const size_t cs_num_mark_lock_stripes = 64;
+    parallel_mark_state_t() = default;
+    parallel_mark_state_t(const parallel_mark_state_t &) = delete;
+    parallel_mark_state_t(parallel_mark_state_t &&) = delete;
+    parallel_mark_state_t &operator=(const parallel_mark_state_t &) = delete;
+    parallel_mark_state_t &operator=(parallel_mark_state_t &&) = delete;
+    ~parallel_mark_state_t() = default;
+    /**
+     * \brief Reset for a new mark phase.
+     *
+     * Must be called before any gc thread starts marking.
+     * All gc threads with a registered deque participate.
+     **/
+    void reset();
+    /**
+     * \brief Register the deque of a gc thread.
+     *
+     * @return Index of gc thread in state.
+     **/
+    size_t register_deque(mark_deque_type *deque);
+    /**
+     * \brief Unregister all deques.
+     *
+     * Gc threads must be reregistered before the next mark phase.
+     **/
+    void clear();
+    /**
+     * \brief Return true if more than one gc thread participates in marking.
+     **/
+    bool is_parallel() const noexcept;
+    /**
+     * \brief Called by a gc thread that ran out of local work.
+     *
+     * Tries to steal from other gc threads until either work is found or all threads are out of work.
+     * @param index Index of calling gc thread.
+     * @param addr Stolen address on success.
+     * @return True if work was stolen, false if marking is finished.
+     **/
+    bool find_work(size_t index, void *&addr);
+    /**
+     * \brief Like find_work, but call idle() instead of yielding while waiting for work.
+     **/
+    template <typename Idle>
+    bool find_work(size_t index, void *&addr, Idle &&idle);
+    /**
+     * \brief Return lock protecting mark bits of given bitmap state or sparse object state.
+     **/
+    auto mark_lock(const void *state) noexcept -> ::mcpputil::spinlock_t &;
+
+  private:
+    /**
+     * \brief Try to steal one address from any other gc thread.
+     **/
+    bool _steal(size_t index, void *&addr);
+    /**
+     * \brief Spinlock padded to own cache line.
+     **/
+    struct alignas(64) padded_spinlock_t {
+      ::mcpputil::spinlock_t m_lock;
+    };
+    /**
+     * \brief Deques of all participating gc threads.
+     **/
+    ::std::vector<mark_deque_type *, cgc_internal_malloc_allocator_t<mark_deque_type *>> m_deques;
+    /**
+     * \brief Number of gc threads that are not looking for work.
+     **/
+    alignas(64)::std::atomic<size_t> m_num_active{0};
+    /**
+     * \brief Striped locks for bitmap mark bits.
+     *
+     * Mark bits of different objects share words so setting them is not atomic.
+     **/
+    ::std::array<padded_spinlock_t, cs_num_mark_lock_stripes> m_mark_locks;
+  };
+  template <typename Idle>
+  bool parallel_mark_state_t::find_work(size_t index, void *&addr, Idle &&idle)
+  {
+    if (!is_parallel()) {
+      return false;
+    }
+    // this thread is now idle.
+    m_num_active.fetch_sub(1, ::std::memory_order_acq_rel);
+    while (true) {
+      bool work_visible = false;
+      for (auto deque : m_deques) {
+        if (!deque->empty()) {
+          work_visible = true;
+          break;
+        }
+      }
+      if (work_visible) {
+        // must be active before stealing so that others can not observe termination while we hold work.
+        m_num_active.fetch_add(1, ::std::memory_order_acq_rel);
+        if (_steal(index, addr)) {
+          return true;
+        }
+        m_num_active.fetch_sub(1, ::std::memory_order_acq_rel);
+      }
+      // all threads idle with no visible work means marking is done.
+      if (m_num_active.load(::std::memory_order_acquire) == 0) {
+        return false;
+      }
+      idle();
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#include "pending_sweep_set.hpp"
+#include <algorithm>
+namespace cgc1::details
+{
+  void pending_sweep_set_t::reset(cgc_internal_vector_t<state_type *> states)
+  {
+    ::std::sort(states.begin(), states.end());
+    // reuse storage where possible, a mutator interrupted by the pause may still be reading it.
+    m_states.assign(states.begin(), states.end());
+    if (m_claimed.size() < m_states.size()) {
+      m_claimed = cgc_internal_vector_t<::std::atomic<bool>>(m_states.size());
+    }
+    for (auto &claimed : m_claimed) {
+      claimed.store(false, ::std::memory_order_relaxed);
+    }
+    m_num_pending.store(m_states.size(), ::std::memory_order_release);
+    m_epoch.fetch_add(1, ::std::memory_order_acq_rel);
+  }
+  void pending_sweep_set_t::clear()
+  {
+    m_states.clear();
+    m_num_pending.store(0, ::std::memory_order_release);
+  }
+  auto pending_sweep_set_t::take_unclaimed() -> cgc_internal_vector_t<state_type *>
+  {
+    cgc_internal_vector_t<state_type *> ret;
+    claim_all([&ret](state_type *state) { ret.push_back(state); });
+    clear();
+    return ret;
+  }
+  bool pending_sweep_set_t::empty() const noexcept
+  {
+    return m_num_pending.load(::std::memory_order_acquire) == 0;
+  }
+  bool pending_sweep_set_t::pending(state_type *state) const noexcept
+  {
+    const auto index = _find(state);
+    return index != m_states.size() && !m_claimed[index].load(::std::memory_order_acquire);
+  }
+  size_t pending_sweep_set_t::epoch() const noexcept
+  {
+    return m_epoch.load(::std::memory_order_acquire);
+  }
+  size_t pending_sweep_set_t::_find(state_type *state) const noexcept
+  {
+    const auto it = ::std::lower_bound(m_states.begin(), m_states.end(), state);
+    if (it == m_states.end() || *it != state) {
+      return m_states.size();
+    }
+    return static_cast<size_t>(it - m_states.begin());
+  }
+  bool pending_sweep_set_t::claim(state_type *state) noexcept
+  {
+    const auto index = _find(state);
+    if (index == m_states.size()) {
+      return false;
+    }
+    if (m_claimed[index].load(::std::memory_order_relaxed) || m_claimed[index].exchange(true, ::std::memory_order_acq_rel)) {
+      return false;
+    }
+    m_num_pending.fetch_sub(1, ::std::memory_order_acq_rel);
+    return true;
+  }
+}
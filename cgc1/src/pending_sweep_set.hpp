@@ -0,0 +1,98 @@
+#pragma once
+#include "internal_allocator.hpp"
+#include <atomic>
+#include <mcppalloc/mcppalloc_bitmap_allocator/bitmap_state.hpp>
+namespace cgc1::details
+{
+  /**
+   * \brief Set of bitmap states that were marked but not yet swept.
+   *
+   * Filled while the world is stopped, afterwards states are claimed exactly once by whoever sweeps them.
+   **/
+  class pending_sweep_set_t
+  {
+  public:
+    using state_type = ::mcppalloc::bitmap_allocator::details::bitmap_state_t;
+    pending_sweep_set_t() = default;
+    pending_sweep_set_t(const pending_sweep_set_t &) = delete;
+    pending_sweep_set_t(pending_sweep_set_t &&) = delete;
+    pending_sweep_set_t &operator=(const pending_sweep_set_t &) = delete;
+    pending_sweep_set_t &operator=(pending_sweep_set_t &&) = delete;
+    ~pending_sweep_set_t() = default;
+    /**
+     * \brief Replace contents with given states.
+     *
+     * World must be stopped.
+     **/
+    void reset(cgc_internal_vector_t<state_type *> states);
+    /**
+     * \brief Remove all states.
+     *
+     * World must be stopped.
+     **/
+    void clear();
+    /**
+     * \brief Claim all remaining states, clear, and return the claimed states sorted by address.
+     *
+     * World must be stopped.
+     **/
+    auto take_unclaimed() -> cgc_internal_vector_t<state_type *>;
+    /**
+     * \brief Return true if no states are waiting to be swept.
+     **/
+    bool empty() const noexcept;
+    /**
+     * \brief Return true if state is waiting to be swept and nobody claimed it yet.
+     **/
+    bool pending(state_type *state) const noexcept;
+    /**
+     * \brief Return number of times the set was reset.
+     *
+     * Used to invalidate per thread caches.
+     **/
+    size_t epoch() const noexcept;
+    /**
+     * \brief Try to take responsibility for sweeping a state.
+     *
+     * @return True if state was pending and the caller must now sweep it.
+     **/
+    bool claim(state_type *state) noexcept;
+    /**
+     * \brief Claim every remaining state and call f on it.
+     **/
+    template <typename F>
+    void claim_all(F &&f);
+
+  private:
+    /**
+     * \brief Return index of state or size of set if not present.
+     **/
+    size_t _find(state_type *state) const noexcept;
+    /**
+     * \brief States sorted by address.
+     **/
+    cgc_internal_vector_t<state_type *> m_states;
+    /**
+     * \brief True if state at same index was claimed.
+     **/
+    cgc_internal_vector_t<::std::atomic<bool>> m_claimed;
+    /**
+     * \brief Number of unclaimed states.
+     **/
+    ::std::atomic<size_t> m_num_pending{0};
+    /**
+     * \brief Number of resets.
+     **/
+    ::std::atomic<size_t> m_epoch{0};
+  };
+  template <typename F>
+  void pending_sweep_set_t::claim_all(F &&f)
+  {
+    for (size_t i = 0; i < m_states.size(); ++i) {
+      if (!m_claimed[i].exchange(true, ::std::memory_order_acq_rel)) {
+        m_num_pending.fetch_sub(1, ::std::memory_order_acq_rel);
+        f(m_states[i]);
+      }
+    }
+  }
+}
@@ -19,6 +19,11 @@ namespace cgc1
       last_collect.put("total_time", ::std::to_string(state.total_collect_time_span().count()));
       ptree.put_child("last_collect", last_collect);
     }
+    {
+      ::boost::property_tree::ptree gc_stats;
+      state.gc_stats().to_ptree(gc_stats);
+      ptree.put_child("gc_stats", gc_stats);
+    }
     {
       ::boost::property_tree::ptree slab_allocator;
       state._internal_slab_allocator().to_ptree(slab_allocator, level);
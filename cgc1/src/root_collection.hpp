@@ -1,6 +1,13 @@
 #pragma once
+#include "root_log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <gsl/gsl>
+#include <mcpputil/mcpputil/concurrency.hpp>
 #include <mcpputil/mcpputil/memory_range.hpp>
+#include <memory>
+#include <unordered_map>
 namespace cgc1
 {
   /**
@@ -15,6 +22,10 @@ namespace cgc1
   };
   /**
    * \brief Class that stores root pointers for a garbage collector.
+   *
+   * Roots are kept dense for cheap partitioning, with a hash index from root to position so updates are O(1).
+   * Removal moves the last root into the hole, so order is not preserved.
+   * Threads may instead log single root changes in their own root_log_t, which are merged while the lock is held.
    **/
   template <typename Policy>
   class root_collection_t
@@ -24,10 +35,10 @@ namespace cgc1
     using lock_type = typename policy_type::lock_type;
     using allocator_type = typename policy_type::allocator_type;
     root_collection_t(lock_type &lock, allocator_type allocator);
-    root_collection_t(const root_collection_t &) = default;
-    root_collection_t(root_collection_t &&) noexcept = default;
-    root_collection_t &operator=(const root_collection_t &) = default;
-    root_collection_t &operator=(root_collection_t &&) noexcept = default;
+    root_collection_t(const root_collection_t &) = delete;
+    root_collection_t(root_collection_t &&) noexcept;
+    root_collection_t &operator=(const root_collection_t &) = delete;
+    root_collection_t &operator=(root_collection_t &&) = delete;
     /**
      * \brief Add root to root collection.
      *
@@ -38,6 +49,19 @@ namespace cgc1
      * \brief Remove single root from root collection if present.
      **/
     void remove_root(void **r) NO_THREAD_SAFETY_ANALYSIS;
+    /**
+     * \brief Add root to root collection through log of calling thread.
+     *
+     * Only takes lock if log is full.
+     **/
+    void add_root(root_log_t &log, void **r) NO_THREAD_SAFETY_ANALYSIS;
+    /**
+     * \brief Remove single root from root collection through log of calling thread.
+     *
+     * Only takes lock if log is full.
+     * The root may still be scanned until the next merge.
+     **/
+    void remove_root(root_log_t &log, void **r) NO_THREAD_SAFETY_ANALYSIS;
     /**
      * \brief Return if single root is in root collection.
      **/
@@ -60,6 +84,24 @@ namespace cgc1
      * \brief Clear all roots.
      **/
     void clear() NO_THREAD_SAFETY_ANALYSIS;
+    /**
+     * \brief Start merging changes from log.
+     *
+     * Does not need the lock, so threads can start while it is held for a collection.
+     **/
+    void register_log(root_log_t &log) REQUIRES(!m_logs_mutex);
+    /**
+     * \brief Stop merging changes from log, changes already in it are kept.
+     *
+     * Lock must be held.
+     **/
+    void _u_unregister_log(root_log_t &log) REQUIRES(!m_logs_mutex);
+    /**
+     * \brief Apply changes from all logs.
+     *
+     * Lock must be held, roots and ranges are only current after this.
+     **/
+    void _u_merge_logs() REQUIRES(!m_logs_mutex);
     /**
      * \brief Return single roots.
      **/
@@ -78,15 +120,71 @@ namespace cgc1
     ::gsl::span<mcpputil::system_memory_range_t> ranges() const;
 
   private:
+    /**
+     * \brief Hash of a root range.
+     **/
+    struct range_hash_t {
+      size_t operator()(const mcpputil::system_memory_range_t &range) const noexcept
+      {
+        const ::std::hash<const void *> hash;
+        return hash(range.begin()) ^ (hash(range.end()) << 1);
+      }
+    };
+    template <typename T>
+    using rebind_allocator_t = typename ::std::allocator_traits<allocator_type>::template rebind_alloc<T>;
+    /**
+     * \brief Map from element to its position in a dense vector.
+     **/
+    template <typename Key, typename Hash>
+    using index_map_t =
+        ::std::unordered_map<Key, size_t, Hash, ::std::equal_to<Key>, rebind_allocator_t<::std::pair<const Key, size_t>>>;
+    /**
+     * \brief Add value to dense vector and index if not present.
+     **/
+    template <typename Vector, typename Index>
+    static void _add(Vector &values, Index &index, const typename Vector::value_type &value);
+    /**
+     * \brief Remove value from dense vector and index if present.
+     **/
+    template <typename Vector, typename Index>
+    static void _remove(Vector &values, Index &index, const typename Vector::value_type &value);
+    /**
+     * \brief Append change to log, merging all logs while it is full.
+     **/
+    void _push(root_log_t &log, root_log_t::op_t op, void **r) NO_THREAD_SAFETY_ANALYSIS;
     lock_type &m_lock;
     /**
      * \brief Vector of pointers to roots.
      **/
     ::mcpputil::rebind_vector_t<void **, allocator_type> m_roots;
+    /**
+     * \brief Position of each root in m_roots.
+     **/
+    index_map_t<void **, ::std::hash<void **>> m_root_index;
     /**
      * \brief Vector of pointers to ranges.
      **/
     ::mcpputil::rebind_vector_t<mcpputil::system_memory_range_t, allocator_type> m_ranges;
+    /**
+     * \brief Position of each range in m_ranges.
+     **/
+    index_map_t<mcpputil::system_memory_range_t, range_hash_t> m_range_index;
+    /**
+     * \brief Source of sequence numbers of logged changes.
+     **/
+    ::std::atomic<uint64_t> m_sequence{0};
+    /**
+     * \brief Logs to merge.
+     **/
+    ::mcpputil::rebind_vector_t<root_log_t *, allocator_type> m_logs GUARDED_BY(m_logs_mutex);
+    /**
+     * \brief Protects logs, which threads register without the lock.
+     **/
+    ::mcpputil::mutex_t m_logs_mutex;
+    /**
+     * \brief Logged changes consumed but not yet applied.
+     **/
+    ::mcpputil::rebind_vector_t<root_log_t::entry_t, allocator_type> m_pending;
     /**
      * \brief Allocator to be used.
      **/
@@ -94,70 +192,156 @@ namespace cgc1
   };
   template <typename Policy>
   root_collection_t<Policy>::root_collection_t(lock_type &lock, allocator_type allocator)
-      : m_lock(lock), m_roots(allocator), m_allocator(::std::move(allocator))
+      : m_lock(lock), m_roots(allocator), m_root_index(0, ::std::hash<void **>(), ::std::equal_to<void **>(), allocator),
+        m_ranges(allocator), m_range_index(0, range_hash_t(), ::std::equal_to<mcpputil::system_memory_range_t>(), allocator),
+        m_logs(allocator), m_pending(allocator), m_allocator(::std::move(allocator))
   {
   }
   template <typename Policy>
+  root_collection_t<Policy>::root_collection_t(root_collection_t &&other) noexcept
+      : m_lock(other.m_lock), m_roots(::std::move(other.m_roots)), m_root_index(::std::move(other.m_root_index)),
+        m_ranges(::std::move(other.m_ranges)), m_range_index(::std::move(other.m_range_index)),
+        m_sequence(other.m_sequence.load()), m_logs(::std::move(other.m_logs)), m_pending(::std::move(other.m_pending)),
+        m_allocator(::std::move(other.m_allocator))
+  {
+  }
+  template <typename Policy>
+  template <typename Vector, typename Index>
+  void root_collection_t<Policy>::_add(Vector &values, Index &index, const typename Vector::value_type &value)
+  {
+    if (index.emplace(value, values.size()).second) {
+      values.push_back(value);
+    }
+  }
+  template <typename Policy>
+  template <typename Vector, typename Index>
+  void root_collection_t<Policy>::_remove(Vector &values, Index &index, const typename Vector::value_type &value)
+  {
+    const auto it = index.find(value);
+    if (it == index.end()) {
+      return;
+    }
+    const size_t position = it->second;
+    index.erase(it);
+    // fill the hole with the last element instead of shifting everything after it.
+    if (position + 1 != values.size()) {
+      values[position] = values.back();
+      index[values[position]] = position;
+    }
+    values.pop_back();
+  }
+  template <typename Policy>
   void root_collection_t<Policy>::add_root(void **r)
   {
     MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
-    // make sure not already a root.
-    const auto it = find(m_roots.begin(), m_roots.end(), r);
-    if (it == m_roots.end()) {
-      m_roots.push_back(r);
-    }
+    _u_merge_logs();
+    _add(m_roots, m_root_index, r);
   }
   template <typename Policy>
   void root_collection_t<Policy>::remove_root(void **r)
   {
     MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
-    // find root and erase.
-    auto it = find(m_roots.begin(), m_roots.end(), r);
-    if (it != m_roots.end()) {
-      m_roots.erase(it);
+    _u_merge_logs();
+    _remove(m_roots, m_root_index, r);
+  }
+  template <typename Policy>
+  void root_collection_t<Policy>::_push(root_log_t &log, root_log_t::op_t op, void **r)
+  {
+    while (!log.try_push(m_sequence, op, r)) {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
+      _u_merge_logs();
     }
   }
   template <typename Policy>
+  void root_collection_t<Policy>::add_root(root_log_t &log, void **r)
+  {
+    _push(log, root_log_t::op_t::add, r);
+  }
+  template <typename Policy>
+  void root_collection_t<Policy>::remove_root(root_log_t &log, void **r)
+  {
+    _push(log, root_log_t::op_t::remove, r);
+  }
+  template <typename Policy>
   bool root_collection_t<Policy>::has_root(void **r)
   {
     MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
-    // find root
-    auto it = find(m_roots.begin(), m_roots.end(), r);
-    return it != m_roots.end();
+    _u_merge_logs();
+    return m_root_index.find(r) != m_root_index.end();
   }
   template <typename Policy>
   void root_collection_t<Policy>::add_range(mcpputil::system_memory_range_t range)
   {
     MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
-    // make sure not already a root.
-    const auto it = find(m_ranges.begin(), m_ranges.end(), range);
-    if (it == m_ranges.end()) {
-      m_ranges.push_back(range);
-    }
+    _add(m_ranges, m_range_index, range);
   }
   template <typename Policy>
   void root_collection_t<Policy>::remove_range(mcpputil::system_memory_range_t range)
   {
     MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
-    auto it = find(m_ranges.begin(), m_ranges.end(), range);
-    if (it != m_ranges.end()) {
-      m_ranges.erase(it);
-    }
+    _remove(m_ranges, m_range_index, range);
   }
   template <typename Policy>
   bool root_collection_t<Policy>::has_range(mcpputil::system_memory_range_t range)
   {
     MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
-    // find root
-    auto it = find(m_ranges.begin(), m_ranges.end(), range);
-    return it != m_ranges.end();
+    return m_range_index.find(range) != m_range_index.end();
   }
   template <typename Policy>
   void root_collection_t<Policy>::clear()
   {
     MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_lock);
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_logs_mutex);
+      for (auto log : m_logs) {
+        log->consume([](const root_log_t::entry_t &) {});
+      }
+    }
+    m_pending.clear();
     m_roots.clear();
+    m_root_index.clear();
     m_ranges.clear();
+    m_range_index.clear();
+  }
+  template <typename Policy>
+  void root_collection_t<Policy>::register_log(root_log_t &log)
+  {
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_logs_mutex);
+    m_logs.push_back(&log);
+  }
+  template <typename Policy>
+  void root_collection_t<Policy>::_u_unregister_log(root_log_t &log)
+  {
+    log.consume([this](const root_log_t::entry_t &entry) { m_pending.push_back(entry); });
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_logs_mutex);
+    m_logs.erase(::std::remove(m_logs.begin(), m_logs.end(), &log), m_logs.end());
+  }
+  template <typename Policy>
+  void root_collection_t<Policy>::_u_merge_logs()
+  {
+    // a change numbered after this may have been appended to a log already read while one numbered before it was not.
+    // such changes overlap in time so either order is valid, but they must wait for the next merge to keep it.
+    const uint64_t end = m_sequence.load();
+    {
+      MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_logs_mutex);
+      for (auto log : m_logs) {
+        log->consume([this](const root_log_t::entry_t &entry) { m_pending.push_back(entry); });
+      }
+    }
+    if (m_pending.empty()) {
+      return;
+    }
+    ::std::sort(m_pending.begin(), m_pending.end(),
+                [](const root_log_t::entry_t &a, const root_log_t::entry_t &b) { return a.m_sequence < b.m_sequence; });
+    auto it = m_pending.begin();
+    for (; it != m_pending.end() && it->m_sequence < end; ++it) {
+      if (it->m_op == root_log_t::op_t::add) {
+        _add(m_roots, m_root_index, it->m_root);
+      } else {
+        _remove(m_roots, m_root_index, it->m_root);
+      }
+    }
+    m_pending.erase(m_pending.begin(), it);
   }
   template <typename Policy>
   ::gsl::span<void **> root_collection_t<Policy>::roots()
@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+namespace cgc1
+{
+  /**
+   * \brief Root changes of one thread that a root collection has not seen yet.
+   *
+   * Single producer single consumer ring.
+   * The owning thread appends without locking, the root collection consumes while holding its lock.
+   * Nothing is locked on append, so a thread stopped in the middle of one can not block a collection.
+   **/
+  class root_log_t
+  {
+  public:
+    /**
+     * \brief Kind of root change.
+     **/
+    enum class op_t : uint8_t { add, remove };
+    /**
+     * \brief Single root change.
+     **/
+    struct entry_t {
+      /**
+       * \brief Position of change among changes of all threads.
+       **/
+      uint64_t m_sequence;
+      /**
+       * \brief Root that changed.
+       **/
+      void **m_root;
+      /**
+       * \brief Kind of change.
+       **/
+      op_t m_op;
+    };
+    /**
+     * \brief Number of changes that can be waiting.
+     **/
+    static const constexpr size_t cs_capacity = 256;
+    root_log_t() = default;
+    root_log_t(const root_log_t &) = delete;
+    root_log_t(root_log_t &&) = delete;
+    root_log_t &operator=(const root_log_t &) = delete;
+    root_log_t &operator=(root_log_t &&) = delete;
+    ~root_log_t() = default;
+    /**
+     * \brief Append change numbered by sequence.
+     *
+     * Only called by owning thread.
+     * @return False if log is full.
+     **/
+    bool try_push(::std::atomic<uint64_t> &sequence, op_t op, void **root) noexcept
+    {
+      const size_t tail = m_tail.load(::std::memory_order_relaxed);
+      if (tail - m_head.load(::std::memory_order_acquire) == cs_capacity) {
+        return false;
+      }
+      auto &entry = m_entries[tail % cs_capacity];
+      entry.m_sequence = sequence.fetch_add(1);
+      entry.m_root = root;
+      entry.m_op = op;
+      m_tail.store(tail + 1, ::std::memory_order_release);
+      return true;
+    }
+    /**
+     * \brief Call f(entry) for every appended change and remove them.
+     *
+     * Only one thread may consume at a time.
+     **/
+    template <typename F>
+    void consume(F &&f)
+    {
+      const size_t head = m_head.load(::std::memory_order_relaxed);
+      const size_t tail = m_tail.load(::std::memory_order_acquire);
+      for (size_t i = head; i != tail; ++i) {
+        f(m_entries[i % cs_capacity]);
+      }
+      m_head.store(tail, ::std::memory_order_release);
+    }
+
+  private:
+    /**
+     * \brief Ring of changes.
+     **/
+    ::std::array<entry_t, cs_capacity> m_entries{};
+    /**
+     * \brief Index of first change not consumed.
+     **/
+    ::std::atomic<size_t> m_head{0};
+    /**
+     * \brief Index one past last appended change.
+     **/
+    ::std::atomic<size_t> m_tail{0};
+  };
+}
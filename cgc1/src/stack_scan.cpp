@@ -0,0 +1,95 @@
+#include "stack_scan.hpp"
+#include "cpu_features.hpp"
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CGC1_STACK_SCAN_X86 1
+#include <immintrin.h>
+#endif
+namespace cgc1::details
+{
+  /**
+   * \brief Return true if value is in range.
+   *
+   * Unsigned wrap around makes this a single compare.
+   **/
+  static inline bool in_scan_range(uintptr_t value, scan_range_t range) noexcept
+  {
+    return value - range.m_begin < range.m_size;
+  }
+  static size_t scan_words_in_ranges_scalar(uint8_t **begin, uint8_t **end, scan_range_t range0, scan_range_t range1,
+                                            uint8_t ***out) noexcept
+  {
+    size_t num_found = 0;
+    for (auto v = begin; v != end; ++v) {
+      const auto value = reinterpret_cast<uintptr_t>(*v);
+      if (in_scan_range(value, range0) || in_scan_range(value, range1)) {
+        out[num_found++] = v;
+      }
+    }
+    return num_found;
+  }
+#ifdef CGC1_STACK_SCAN_X86
+  __attribute__((target("avx2"))) static size_t
+  scan_words_in_ranges_avx2(uint8_t **begin, uint8_t **end, scan_range_t range0, scan_range_t range1, uint8_t ***out) noexcept
+  {
+    // avx2 only has signed compares, so flip sign bits to compare unsigned.
+    const auto sign = _mm256_set1_epi64x(static_cast<int64_t>(static_cast<uint64_t>(1) << 63));
+    const auto begin0 = _mm256_set1_epi64x(static_cast<int64_t>(range0.m_begin));
+    const auto size0 = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(range0.m_size)), sign);
+    const auto begin1 = _mm256_set1_epi64x(static_cast<int64_t>(range1.m_begin));
+    const auto size1 = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(range1.m_size)), sign);
+    size_t num_found = 0;
+    auto v = begin;
+    for (; end - v >= 4; v += 4) {
+      const auto words = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(v));
+      const auto offset0 = _mm256_xor_si256(_mm256_sub_epi64(words, begin0), sign);
+      const auto offset1 = _mm256_xor_si256(_mm256_sub_epi64(words, begin1), sign);
+      const auto hit = _mm256_or_si256(_mm256_cmpgt_epi64(size0, offset0), _mm256_cmpgt_epi64(size1, offset1));
+      auto mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(hit)));
+      while (mask) {
+        out[num_found++] = v + __builtin_ctz(mask);
+        mask &= mask - 1;
+      }
+    }
+    return num_found + scan_words_in_ranges_scalar(v, end, range0, range1, out + num_found);
+  }
+  __attribute__((target("avx512f"))) static size_t
+  scan_words_in_ranges_avx512(uint8_t **begin, uint8_t **end, scan_range_t range0, scan_range_t range1, uint8_t ***out) noexcept
+  {
+    const auto begin0 = _mm512_set1_epi64(static_cast<int64_t>(range0.m_begin));
+    const auto size0 = _mm512_set1_epi64(static_cast<int64_t>(range0.m_size));
+    const auto begin1 = _mm512_set1_epi64(static_cast<int64_t>(range1.m_begin));
+    const auto size1 = _mm512_set1_epi64(static_cast<int64_t>(range1.m_size));
+    size_t num_found = 0;
+    auto v = begin;
+    for (; end - v >= 8; v += 8) {
+      const auto words = _mm512_loadu_si512(v);
+      auto mask = static_cast<unsigned>(_mm512_cmplt_epu64_mask(_mm512_sub_epi64(words, begin0), size0) |
+                                        _mm512_cmplt_epu64_mask(_mm512_sub_epi64(words, begin1), size1));
+      while (mask) {
+        out[num_found++] = v + __builtin_ctz(mask);
+        mask &= mask - 1;
+      }
+    }
+    return num_found + scan_words_in_ranges_scalar(v, end, range0, range1, out + num_found);
+  }
+#endif
+  using scan_words_in_ranges_function_t = size_t (*)(uint8_t **, uint8_t **, scan_range_t, scan_range_t, uint8_t ***) noexcept;
+  static scan_words_in_ranges_function_t select_scan_words_in_ranges() noexcept
+  {
+#ifdef CGC1_STACK_SCAN_X86
+    const auto &features = cpu_features();
+    if (features.m_avx512f) {
+      return &scan_words_in_ranges_avx512;
+    }
+    if (features.m_avx2) {
+      return &scan_words_in_ranges_avx2;
+    }
+#endif
+    return &scan_words_in_ranges_scalar;
+  }
+  size_t scan_words_in_ranges(uint8_t **begin, uint8_t **end, scan_range_t range0, scan_range_t range1, uint8_t ***out) noexcept
+  {
+    static const auto s_scan = select_scan_words_in_ranges();
+    return s_scan(begin, end, range0, range1, out);
+  }
+}
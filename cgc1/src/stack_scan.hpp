@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+namespace cgc1::details
+{
+  /**
+   * \brief Half open address range [m_begin, m_begin + m_size) tested by scan_words_in_ranges.
+   **/
+  struct scan_range_t {
+    uintptr_t m_begin;
+    uintptr_t m_size;
+  };
+  /**
+   * \brief Find words in [begin, end) whose value falls in either range.
+   *
+   * Writes the location of each matching word to out in address order.
+   * Uses AVX-512 or AVX2 when available to test several words per iteration.
+   * @param out Must have room for end - begin entries.
+   * @return Number of entries written to out.
+   **/
+  size_t scan_words_in_ranges(uint8_t **begin, uint8_t **end, scan_range_t range0, scan_range_t range1, uint8_t ***out) noexcept;
+}
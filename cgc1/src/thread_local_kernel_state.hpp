@@ -2,6 +2,8 @@
 #include "gc_allocator.hpp"
 #include "internal_allocator.hpp"
 #include "internal_declarations.hpp"
+#include "root_log.hpp"
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <cgc1/declarations.hpp>
@@ -12,6 +14,7 @@ namespace cgc1
 {
   namespace details
   {
+    struct thread_allocation_cache_t;
     /**
      * \brief Store thread local gc kernel state.
      **/
@@ -114,8 +117,92 @@ namespace cgc1
        * \brief Set bitmap thread allocator.
        **/
       void set_bitmap_thread_allocator(bitmap_thread_allocator_type *allocator);
+      /**
+       * \brief Return true if state was already checked for lazy sweeping in the given sweep epoch.
+       **/
+      bool lazy_sweep_checked(const void *state, size_t epoch) const noexcept;
+      /**
+       * \brief Remember that state was checked for lazy sweeping in the given sweep epoch.
+       **/
+      void set_lazy_sweep_checked(const void *state, size_t epoch) noexcept;
+      /**
+       * \brief Return sweep epoch in which all pending states of this thread's bitmap allocator were last swept.
+       **/
+      size_t own_states_swept_epoch() const noexcept;
+      /**
+       * \brief Remember that all pending states of this thread's bitmap allocator were swept in the given sweep epoch.
+       **/
+      void set_own_states_swept_epoch(size_t epoch) noexcept;
+      /**
+       * \brief Set if this thread is looking up or sweeping a pending bitmap state.
+       **/
+      void set_in_lazy_sweep(bool in_lazy_sweep) noexcept;
+      /**
+       * \brief Return true if this thread is looking up or sweeping a pending bitmap state.
+       *
+       * Only meaningful while the thread is stopped.
+       **/
+      bool in_lazy_sweep() const noexcept;
+      /**
+       * \brief Add to bytes allocated by this thread that gks has not seen yet.
+       *
+       * @return True if at least flush_size bytes are waiting to be taken.
+       **/
+      bool add_bytes_allocated(size_t sz, size_t flush_size) noexcept;
+      /**
+       * \brief Return bytes allocated by this thread that gks has not seen yet and reset them.
+       **/
+      size_t take_bytes_allocated() noexcept;
+      /**
+       * \brief Try to become the one who stops this thread for the current safepoint.
+       *
+       * Both the thread itself and a signalling collector race for this, so a thread is never stopped twice.
+       * @return True if caller must stop the thread.
+       **/
+      bool try_claim_stop() noexcept;
+      /**
+       * \brief Allow this thread to be stopped at the next safepoint.
+       **/
+      void release_stop() noexcept;
+      /**
+       * \brief Remember an allocation cache registered as a root range by this thread.
+       **/
+      void add_allocation_cache(thread_allocation_cache_t *cache);
+      /**
+       * \brief Return allocation caches registered by this thread.
+       *
+       * There is one per module that inlined the allocation fast path.
+       **/
+      auto allocation_caches() const noexcept -> const cgc_internal_vector_t<thread_allocation_cache_t *> &;
+      /**
+       * \brief Return log of root changes made by this thread.
+       **/
+      auto root_log() noexcept -> root_log_t &;
+      /**
+       * \brief Return slot of this thread in thread registry.
+       **/
+      auto registry_slot() const noexcept -> size_t;
+      /**
+       * \brief Set slot of this thread in thread registry.
+       **/
+      void set_registry_slot(size_t slot) noexcept;
 
     private:
+      /**
+       * \brief Number of entries in lazy sweep cache.
+       **/
+      static const constexpr size_t cs_lazy_sweep_cache_size = 8;
+      /**
+       * \brief Entry of lazy sweep cache.
+       **/
+      struct lazy_sweep_cache_entry_t {
+        const void *m_state;
+        size_t m_epoch;
+      };
+      /**
+       * \brief Return cache entry for state.
+       **/
+      static size_t _lazy_sweep_cache_index(const void *state) noexcept;
       /**
        * \brief Cached sparse thread allocator.
        **/
@@ -150,6 +237,42 @@ namespace cgc1
        * This is typically used to hold registers on machines that do not push them onto the stack.
        **/
       cgc_internal_vector_t<void *> m_potential_roots;
+      /**
+       * \brief Direct mapped cache of bitmap states already checked for lazy sweeping.
+       *
+       * Avoids a search of the pending sweep set on every allocation.
+       **/
+      ::std::array<lazy_sweep_cache_entry_t, cs_lazy_sweep_cache_size> m_lazy_sweep_cache{};
+      /**
+       * \brief Sweep epoch in which all pending states of this thread's bitmap allocator were last swept.
+       **/
+      size_t m_own_states_swept_epoch{0};
+      /**
+       * \brief True if looking up or sweeping a pending bitmap state.
+       **/
+      ::std::atomic<bool> m_in_lazy_sweep{false};
+      /**
+       * \brief Bytes allocated by this thread not yet added to gks allocation count.
+       *
+       * Only touched by owning thread so allocation does not contend on a shared counter.
+       **/
+      size_t m_bytes_allocated{0};
+      /**
+       * \brief True from being claimed for a safepoint until resumed.
+       **/
+      ::std::atomic<bool> m_stop_claimed{false};
+      /**
+       * \brief Allocation caches registered by this thread.
+       **/
+      cgc_internal_vector_t<thread_allocation_cache_t *> m_allocation_caches;
+      /**
+       * \brief Root changes made by this thread not yet merged into root collection.
+       **/
+      root_log_t m_root_log;
+      /**
+       * \brief Slot of this thread in thread registry.
+       **/
+      size_t m_registry_slot{0};
     };
   }
 }
@@ -1,6 +1,9 @@
 #pragma once
 #include "gc_allocator.hpp"
+#include "stack_scan.hpp"
 #include "thread_local_kernel_state.hpp"
+#include <algorithm>
+#include <array>
 #include <mcppalloc/object_state.hpp>
 namespace cgc1
 {
@@ -69,6 +72,76 @@ namespace cgc1
     {
       return m_in_signal_handler;
     }
+    inline size_t thread_local_kernel_state_t::_lazy_sweep_cache_index(const void *state) noexcept
+    {
+      // states start their blocks so low bits carry no information.
+      return (reinterpret_cast<uintptr_t>(state) >> 12) % cs_lazy_sweep_cache_size;
+    }
+    inline bool thread_local_kernel_state_t::lazy_sweep_checked(const void *state, size_t epoch) const noexcept
+    {
+      const auto &entry = m_lazy_sweep_cache[_lazy_sweep_cache_index(state)];
+      return entry.m_state == state && entry.m_epoch == epoch;
+    }
+    inline void thread_local_kernel_state_t::set_lazy_sweep_checked(const void *state, size_t epoch) noexcept
+    {
+      m_lazy_sweep_cache[_lazy_sweep_cache_index(state)] = {state, epoch};
+    }
+    inline size_t thread_local_kernel_state_t::own_states_swept_epoch() const noexcept
+    {
+      return m_own_states_swept_epoch;
+    }
+    inline void thread_local_kernel_state_t::set_own_states_swept_epoch(size_t epoch) noexcept
+    {
+      m_own_states_swept_epoch = epoch;
+    }
+    inline void thread_local_kernel_state_t::set_in_lazy_sweep(bool in_lazy_sweep) noexcept
+    {
+      m_in_lazy_sweep.store(in_lazy_sweep, ::std::memory_order_release);
+    }
+    inline bool thread_local_kernel_state_t::in_lazy_sweep() const noexcept
+    {
+      return m_in_lazy_sweep.load(::std::memory_order_acquire);
+    }
+    inline bool thread_local_kernel_state_t::add_bytes_allocated(size_t sz, size_t flush_size) noexcept
+    {
+      m_bytes_allocated += sz;
+      return m_bytes_allocated >= flush_size;
+    }
+    inline size_t thread_local_kernel_state_t::take_bytes_allocated() noexcept
+    {
+      const auto ret = m_bytes_allocated;
+      m_bytes_allocated = 0;
+      return ret;
+    }
+    inline bool thread_local_kernel_state_t::try_claim_stop() noexcept
+    {
+      return !m_stop_claimed.load(::std::memory_order_relaxed) && !m_stop_claimed.exchange(true, ::std::memory_order_acq_rel);
+    }
+    inline void thread_local_kernel_state_t::release_stop() noexcept
+    {
+      m_stop_claimed.store(false, ::std::memory_order_release);
+    }
+    inline void thread_local_kernel_state_t::add_allocation_cache(thread_allocation_cache_t *cache)
+    {
+      m_allocation_caches.push_back(cache);
+    }
+    inline auto thread_local_kernel_state_t::allocation_caches() const noexcept
+        -> const cgc_internal_vector_t<thread_allocation_cache_t *> &
+    {
+      return m_allocation_caches;
+    }
+    inline auto thread_local_kernel_state_t::root_log() noexcept -> root_log_t &
+    {
+      return m_root_log;
+    }
+    inline auto thread_local_kernel_state_t::registry_slot() const noexcept -> size_t
+    {
+      return m_registry_slot;
+    }
+    inline void thread_local_kernel_state_t::set_registry_slot(size_t slot) noexcept
+    {
+      m_registry_slot = slot;
+    }
     inline ::std::thread::native_handle_type thread_local_kernel_state_t::thread_handle() const
     {
       return m_thread_handle;
@@ -121,14 +194,19 @@ namespace cgc1
       uint8_t **unaligned = reinterpret_cast<uint8_t **>(m_stack_ptr.load());
       uint8_t **stack_ptr = ::mcpputil::align_pow2(unaligned, 3);
       assert(unaligned == stack_ptr);
-      // crawl stack looking for addresses between begin and end.
-      for (uint8_t **v = stack_ptr; v != reinterpret_cast<uint8_t **>(m_top_of_stack); ++v) {
-        void *os = gc_sparse_object_state_t::from_object_start(*v);
-        if (os >= begin && os < end) {
-          container.emplace_back(v);
-        } else if (*v >= fast_slab_begin && *v < fast_slab_end) {
-          container.emplace_back(v);
-        }
+      // a word is a sparse candidate if its object state is between begin and end, so shift range by header size.
+      const scan_range_t sparse_range{reinterpret_cast<uintptr_t>(begin) + cs_sparse_object_header_size,
+                                      static_cast<uintptr_t>(end - begin)};
+      const scan_range_t bitmap_range{reinterpret_cast<uintptr_t>(fast_slab_begin),
+                                      static_cast<uintptr_t>(fast_slab_end - fast_slab_begin)};
+      // crawl stack in chunks so hits are appended in bulk rather than one at a time.
+      ::std::array<uint8_t **, 512> found;
+      const auto top = reinterpret_cast<uint8_t **>(m_top_of_stack);
+      for (uint8_t **v = stack_ptr; v != top;) {
+        const auto chunk_end = v + ::std::min<ptrdiff_t>(static_cast<ptrdiff_t>(found.size()), top - v);
+        const auto num_found = scan_words_in_ranges(v, chunk_end, sparse_range, bitmap_range, found.data());
+        container.insert(container.end(), found.begin(), found.begin() + static_cast<ptrdiff_t>(num_found));
+        v = chunk_end;
       }
     }
   }
@@ -0,0 +1,120 @@
+#include "thread_registry.hpp"
+#include "thread_local_kernel_state.hpp"
+#include <cgc1/cgc_internal_malloc_allocator.hpp>
+namespace cgc1::details
+{
+  thread_registry_t::read_guard_t::read_guard_t(const thread_registry_t &registry) noexcept : m_registry(registry)
+  {
+    m_registry.m_num_readers.fetch_add(1);
+  }
+  thread_registry_t::read_guard_t::~read_guard_t()
+  {
+    m_registry.m_num_readers.fetch_sub(1);
+  }
+  thread_registry_t::~thread_registry_t()
+  {
+    auto chunk = m_first_chunk.m_next.load(::std::memory_order_acquire);
+    while (chunk != nullptr) {
+      const auto next = chunk->m_next.load(::std::memory_order_acquire);
+      unique_ptr_malloc_t<chunk_t> deleter(chunk);
+      chunk = next;
+    }
+  }
+  auto thread_registry_t::add(thread_local_kernel_state_t *tlks) -> size_t
+  {
+    _enter();
+    size_t base = 0;
+    for (auto chunk = &m_first_chunk;; base += cs_chunk_size) {
+      for (size_t i = 0; i < cs_chunk_size; ++i) {
+        uintptr_t expected = 0;
+        if (chunk->m_slots[i].compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(tlks))) {
+          m_size.fetch_add(1);
+          _leave();
+          return base + i;
+        }
+      }
+      auto next = chunk->m_next.load(::std::memory_order_acquire);
+      if (next == nullptr) {
+        auto fresh = make_unique_malloc<chunk_t>();
+        // another joining thread may have appended a chunk first.
+        if (chunk->m_next.compare_exchange_strong(next, fresh.get())) {
+          next = fresh.release();
+        }
+      }
+      chunk = next;
+    }
+  }
+  void thread_registry_t::remove(size_t slot) noexcept
+  {
+    _enter();
+    _slot(slot).fetch_or(cs_retired_bit);
+    m_size.fetch_sub(1);
+    _leave();
+  }
+  void thread_registry_t::close() noexcept
+  {
+    m_gate.fetch_or(cs_closed_bit);
+    // joining and leaving only take a few atomic operations, so spinning is short.
+    while (m_gate.load() != cs_closed_bit) {
+      ::std::this_thread::yield();
+    }
+  }
+  void thread_registry_t::open() noexcept
+  {
+    m_gate.fetch_and(~cs_closed_bit);
+    m_opened.notify_all();
+  }
+  auto thread_registry_t::size() const noexcept -> size_t
+  {
+    return m_size.load();
+  }
+  auto thread_registry_t::num_retired() const noexcept -> size_t
+  {
+    size_t ret = 0;
+    for (auto chunk = &m_first_chunk; chunk != nullptr; chunk = chunk->m_next.load(::std::memory_order_acquire)) {
+      for (auto &slot : chunk->m_slots) {
+        if ((slot.load() & cs_retired_bit) != 0) {
+          ++ret;
+        }
+      }
+    }
+    return ret;
+  }
+  auto thread_registry_t::find(::std::thread::id id) const noexcept -> thread_local_kernel_state_t *
+  {
+    thread_local_kernel_state_t *ret = nullptr;
+    for_each([&ret, id](thread_local_kernel_state_t *tlks) {
+      if (tlks->thread_id() == id) {
+        ret = tlks;
+      }
+    });
+    return ret;
+  }
+  void thread_registry_t::_enter() noexcept
+  {
+    while (true) {
+      // read before checking, so an open in between is not missed.
+      const auto epoch = m_opened.epoch();
+      auto gate = m_gate.load();
+      if ((gate & cs_closed_bit) != 0) {
+        m_opened.wait(epoch);
+        continue;
+      }
+      if (m_gate.compare_exchange_weak(gate, gate + 2)) {
+        return;
+      }
+    }
+  }
+  void thread_registry_t::_leave() noexcept
+  {
+    m_gate.fetch_sub(2);
+  }
+  auto thread_registry_t::_slot(size_t index) noexcept -> ::std::atomic<uintptr_t> &
+  {
+    auto chunk = &m_first_chunk;
+    for (; index >= cs_chunk_size; index -= cs_chunk_size) {
+      chunk = chunk->m_next.load(::std::memory_order_acquire);
+    }
+    return chunk->m_slots[index];
+  }
+}
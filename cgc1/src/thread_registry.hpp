@@ -0,0 +1,181 @@
+#pragma once
+#include "epoch_event.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+namespace cgc1::details
+{
+  class thread_local_kernel_state_t;
+  /**
+   * \brief Registry of threads known to the kernel that threads join and leave without taking a lock.
+   *
+   * A collection closes the registry while it stops threads, so the threads it stops can not change under it.
+   * Joining or leaving only waits while the registry is closed, not for the rest of a collection.
+   * States of threads that left stay in their slot marked as retired until no reader can still see them.
+   **/
+  class thread_registry_t
+  {
+  public:
+    /**
+     * \brief Number of slots allocated at once.
+     **/
+    static const constexpr size_t cs_chunk_size = 64;
+    /**
+     * \brief Keeps states read from the registry from being reclaimed while it exists.
+     **/
+    class read_guard_t
+    {
+    public:
+      explicit read_guard_t(const thread_registry_t &registry) noexcept;
+      read_guard_t(const read_guard_t &) = delete;
+      read_guard_t(read_guard_t &&) = delete;
+      read_guard_t &operator=(const read_guard_t &) = delete;
+      read_guard_t &operator=(read_guard_t &&) = delete;
+      ~read_guard_t();
+
+    private:
+      const thread_registry_t &m_registry;
+    };
+    thread_registry_t() = default;
+    thread_registry_t(const thread_registry_t &) = delete;
+    thread_registry_t(thread_registry_t &&) = delete;
+    thread_registry_t &operator=(const thread_registry_t &) = delete;
+    thread_registry_t &operator=(thread_registry_t &&) = delete;
+    ~thread_registry_t();
+    /**
+     * \brief Add state, waiting while the registry is closed.
+     *
+     * @return Slot of state, needed to remove it.
+     **/
+    auto add(thread_local_kernel_state_t *tlks) -> size_t;
+    /**
+     * \brief Retire state in slot, waiting while the registry is closed.
+     *
+     * The state is no longer visited, but must not be freed until reclaimed.
+     **/
+    void remove(size_t slot) noexcept;
+    /**
+     * \brief Wait until no thread is joining or leaving, then keep threads from doing so until open.
+     *
+     * Only one thread may close the registry at a time.
+     **/
+    void close() noexcept;
+    /**
+     * \brief Let threads join and leave again.
+     **/
+    void open() noexcept;
+    /**
+     * \brief Return number of registered threads.
+     *
+     * Only exact while closed.
+     **/
+    auto size() const noexcept -> size_t;
+    /**
+     * \brief Return number of retired states not reclaimed yet.
+     *
+     * Only exact while closed.
+     **/
+    auto num_retired() const noexcept -> size_t;
+    /**
+     * \brief Call f(tlks) for every registered thread.
+     *
+     * Must be closed or hold a read guard.
+     **/
+    template <typename F>
+    void for_each(F &&f) const;
+    /**
+     * \brief Return state of thread with id or nullptr.
+     *
+     * Must be closed or hold a read guard.
+     **/
+    auto find(::std::thread::id id) const noexcept -> thread_local_kernel_state_t *;
+    /**
+     * \brief Call f(tlks) for every retired state no reader can see and free its slot.
+     *
+     * Only one thread may reclaim at a time.
+     **/
+    template <typename F>
+    void reclaim(F &&f);
+
+  private:
+    /**
+     * \brief Fixed block of slots, chunks are never freed while the registry exists.
+     **/
+    struct chunk_t {
+      ::std::array<::std::atomic<uintptr_t>, cs_chunk_size> m_slots{};
+      ::std::atomic<chunk_t *> m_next{nullptr};
+    };
+    /**
+     * \brief Bit set in a slot whose state was retired.
+     **/
+    static const constexpr uintptr_t cs_retired_bit = 1;
+    /**
+     * \brief Bit of m_gate set while closed.
+     **/
+    static const constexpr size_t cs_closed_bit = 1;
+    /**
+     * \brief Wait until open, then count this thread as joining or leaving.
+     **/
+    void _enter() noexcept;
+    /**
+     * \brief Stop counting this thread as joining or leaving.
+     **/
+    void _leave() noexcept;
+    /**
+     * \brief Return slot with index.
+     **/
+    auto _slot(size_t index) noexcept -> ::std::atomic<uintptr_t> &;
+    /**
+     * \brief First chunk, others are appended as needed.
+     **/
+    chunk_t m_first_chunk;
+    /**
+     * \brief Closed bit, plus two for every thread joining or leaving.
+     **/
+    ::std::atomic<size_t> m_gate{0};
+    /**
+     * \brief Woken when opened.
+     **/
+    epoch_event_t m_opened;
+    /**
+     * \brief Number of registered threads.
+     **/
+    ::std::atomic<size_t> m_size{0};
+    /**
+     * \brief Number of read guards.
+     **/
+    mutable ::std::atomic<size_t> m_num_readers{0};
+  };
+  template <typename F>
+  void thread_registry_t::for_each(F &&f) const
+  {
+    for (auto chunk = &m_first_chunk; chunk != nullptr; chunk = chunk->m_next.load(::std::memory_order_acquire)) {
+      for (auto &slot : chunk->m_slots) {
+        const auto value = slot.load();
+        if (value != 0 && (value & cs_retired_bit) == 0) {
+          f(reinterpret_cast<thread_local_kernel_state_t *>(value));
+        }
+      }
+    }
+  }
+  template <typename F>
+  void thread_registry_t::reclaim(F &&f)
+  {
+    for (auto chunk = &m_first_chunk; chunk != nullptr; chunk = chunk->m_next.load(::std::memory_order_acquire)) {
+      for (auto &slot : chunk->m_slots) {
+        const auto value = slot.load();
+        if ((value & cs_retired_bit) == 0) {
+          continue;
+        }
+        // a reader that saw the state before it was retired is still counted.
+        if (m_num_readers.load() != 0) {
+          return;
+        }
+        f(reinterpret_cast<thread_local_kernel_state_t *>(value & ~cs_retired_bit));
+        slot.store(0);
+      }
+    }
+  }
+}
@@ -0,0 +1,33 @@
+#include "typed_descriptor.hpp"
+namespace cgc1::details
+{
+  auto typed_layout_registry_t::make_descriptor(const uint64_t *bitmap, size_t num_words) -> cgc_descriptor_t
+  {
+    // words after the last pointer need not be described.
+    size_t used_words = 0;
+    bitmap_for_set_bits(bitmap, num_words, [&used_words](size_t i) { used_words = i + 1; });
+    if (used_words == 0) {
+      return cs_pointer_free_descriptor;
+    }
+    const size_t num_bitmap_words = (used_words + 63) / 64;
+    cgc_internal_vector_t<uint64_t> bits(bitmap, bitmap + num_bitmap_words);
+    if (used_words % 64) {
+      bits.back() &= (static_cast<uint64_t>(1) << (used_words % 64)) - 1;
+    }
+    if (used_words <= cs_inline_descriptor_words) {
+      return static_cast<cgc_descriptor_t>(bits.front() << 1) | cs_inline_descriptor_tag;
+    }
+    MCPPALLOC_CONCURRENCY_LOCK_GUARD(m_mutex);
+    for (const auto &layout : m_layouts) {
+      if (layout->m_num_words == used_words && layout->m_bits == bits) {
+        return reinterpret_cast<cgc_descriptor_t>(layout.get());
+      }
+    }
+    auto layout = ::mcpputil::make_unique_allocator<typed_layout_t, cgc_internal_allocator_t<void>>();
+    layout->m_num_words = used_words;
+    layout->m_bits = ::std::move(bits);
+    const auto ret = reinterpret_cast<cgc_descriptor_t>(layout.get());
+    m_layouts.emplace_back(::std::move(layout));
+    return ret;
+  }
+}
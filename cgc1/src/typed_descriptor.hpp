@@ -0,0 +1,90 @@
+#pragma once
+#include "bitmap_kernels.hpp"
+#include "internal_allocator.hpp"
+#include <algorithm>
+#include <cgc1/declarations.hpp>
+#include <mcpputil/mcpputil/concurrency.hpp>
+namespace cgc1::details
+{
+  /**
+   * \brief Descriptor of objects that are scanned word by word.
+   **/
+  static const constexpr cgc_descriptor_t cs_conservative_descriptor{0};
+  /**
+   * \brief Tag bit of descriptors that hold their pointer bitmap inline.
+   **/
+  static const constexpr cgc_descriptor_t cs_inline_descriptor_tag{1};
+  /**
+   * \brief Descriptor of objects without pointers.
+   **/
+  static const constexpr cgc_descriptor_t cs_pointer_free_descriptor{cs_inline_descriptor_tag};
+  /**
+   * \brief Number of words an inline descriptor describes.
+   **/
+  static const constexpr size_t cs_inline_descriptor_words = sizeof(cgc_descriptor_t) * 8 - 1;
+  /**
+   * \brief Pointer layout too long for an inline descriptor.
+   *
+   * Descriptors pointing at a layout hold its address, which is aligned so the inline tag is clear.
+   **/
+  struct typed_layout_t {
+    /**
+     * \brief Number of words described, words past it hold no pointers.
+     **/
+    size_t m_num_words{0};
+    /**
+     * \brief Bit i is set if word i holds a pointer.
+     **/
+    cgc_internal_vector_t<uint64_t> m_bits;
+  };
+  /**
+   * \brief Call f(slot) for every pointer slot in [begin, end) according to descriptor.
+   **/
+  template <typename F>
+  void for_each_pointer_slot(cgc_descriptor_t descriptor, void **begin, void **end, F &&f)
+  {
+    const auto num_words = static_cast<size_t>(end - begin);
+    if (descriptor & cs_inline_descriptor_tag) {
+      const uint64_t bits = descriptor >> 1;
+      bitmap_for_set_bits(&bits, ::std::min(num_words, cs_inline_descriptor_words), [&](size_t i) { f(begin + i); });
+    } else if (descriptor == cs_conservative_descriptor) {
+      for (void **it = begin; it != end; ++it) {
+        f(it);
+      }
+    } else {
+      const auto layout = reinterpret_cast<const typed_layout_t *>(descriptor);
+      bitmap_for_set_bits(layout->m_bits.data(), ::std::min(num_words, layout->m_num_words), [&](size_t i) { f(begin + i); });
+    }
+  }
+  /**
+   * \brief Owner of layouts of descriptors that do not fit inline.
+   *
+   * Layouts live until the registry is destroyed, identical layouts are shared.
+   **/
+  class typed_layout_registry_t
+  {
+  public:
+    typed_layout_registry_t() = default;
+    typed_layout_registry_t(const typed_layout_registry_t &) = delete;
+    typed_layout_registry_t(typed_layout_registry_t &&) = delete;
+    typed_layout_registry_t &operator=(const typed_layout_registry_t &) = delete;
+    typed_layout_registry_t &operator=(typed_layout_registry_t &&) = delete;
+    ~typed_layout_registry_t() = default;
+    /**
+     * \brief Return descriptor for an object whose first num_words words are described by bitmap.
+     *
+     * Bit i of bitmap (bit i % 64 of bitmap[i / 64]) is set if word i holds a pointer.
+     **/
+    auto make_descriptor(const uint64_t *bitmap, size_t num_words) -> cgc_descriptor_t REQUIRES(!m_mutex);
+
+  private:
+    /**
+     * \brief Mutex protecting layouts.
+     **/
+    ::mcpputil::mutex_t m_mutex;
+    /**
+     * \brief All layouts handed out.
+     **/
+    cgc_internal_vector_t<cgc_internal_unique_ptr_t<typed_layout_t>> m_layouts GUARDED_BY(m_mutex);
+  };
+}
@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <cgc1/cgc1.hpp>
+#include <cgc1/gc.h>
+
+static const size_t num_roots = 50000;
+static const size_t num_rounds = 10;
+
+int main()
+{
+  using hrc = ::std::chrono::high_resolution_clock;
+  CGC1_INITIALIZE_THREAD();
+  ::std::vector<void *> slots(num_roots);
+  ::std::vector<size_t> order(num_roots);
+  for (size_t i = 0; i < num_roots; ++i) {
+    order[i] = i;
+  }
+  ::std::mt19937 generator(5489u);
+  hrc::time_point t1 = hrc::now();
+  // register everything, then unregister in random order, which was quadratic with linear search and erase.
+  for (size_t round = 0; round < num_rounds; ++round) {
+    for (auto &slot : slots) {
+      cgc1::cgc_add_root(&slot);
+    }
+    ::std::shuffle(order.begin(), order.end(), generator);
+    for (auto i : order) {
+      cgc1::cgc_remove_root(&slots[i]);
+    }
+  }
+  hrc::time_point t2 = hrc::now();
+  // short lived root pointers on top of many long lived ones.
+  for (auto &slot : slots) {
+    cgc1::cgc_add_root(&slot);
+  }
+  for (size_t i = 0; i < num_roots * num_rounds; ++i) {
+    auto root = ::std::make_unique<cgc1::cgc_root_pointer_t<uint8_t>>();
+    (void)root;
+  }
+  for (auto &slot : slots) {
+    cgc1::cgc_remove_root(&slot);
+  }
+  hrc::time_point t3 = hrc::now();
+  ::std::chrono::duration<double> bulk = ::std::chrono::duration_cast<::std::chrono::duration<double>>(t2 - t1);
+  ::std::chrono::duration<double> churn = ::std::chrono::duration_cast<::std::chrono::duration<double>>(t3 - t2);
+  ::std::cout << "Bulk add/remove time elapsed: " << bulk.count() << ::std::endl;
+  ::std::cout << "Root pointer churn time elapsed: " << churn.count() << ::std::endl;
+  ::cgc1::cgc_shutdown();
+  return 0;
+}
@@ -1,16 +1,30 @@
 #include "../cgc1/include/gc/gc.h"
+#include "../cgc1/src/bitmap_kernels.hpp"
+#include "../cgc1/src/dirty_page_tracker.hpp"
 #include "../cgc1/src/global_kernel_state.hpp"
 #include "../cgc1/src/internal_declarations.hpp"
 #include <cgc1/cgc1.hpp>
 #include <cgc1/hide_pointer.hpp>
 #include <mcppalloc/mcppalloc_bitmap_allocator/bitmap_allocator.hpp>
 #include <mcpputil/mcpputil/bandit.hpp>
+#include <thread>
 
 using namespace ::bandit;
 using namespace ::snowhouse;
 // alias
 static auto &gks = ::cgc1::details::g_gks;
 using namespace ::mcpputil::literals;
+namespace
+{
+  /**
+   * \brief Object with one pointer and one scalar word for typed allocation tests.
+   **/
+  struct typed_node_t {
+    void *m_next;
+    uintptr_t m_scalar;
+  };
+}
+CGC1_POINTER_LAYOUT(typed_node_t, offsetof(typed_node_t, m_next))
 
 /**
  * \brief Setup for root test.
@@ -242,6 +256,333 @@ static void gc_repeat_alloc_test()
   gks->wait_for_finalization();
 }
 
+static void bitmap_kernels_test()
+{
+  // odd word count so vector and scalar tails are both used.
+  const size_t num_words = 37;
+  const size_t num_bits = num_words * 64 - 5;
+  ::std::vector<uint64_t> a(num_words), b(num_words);
+  for (size_t i = 0; i < num_words; ++i) {
+    a[i] = (i % 3 == 0) ? ~static_cast<uint64_t>(0) : (0x9e3779b97f4a7c15ull * (i + 1));
+    b[i] = (i % 5 == 0) ? 0 : (0xc2b2ae3d27d4eb4full * (i + 7));
+  }
+  auto c = a;
+  ::cgc1::details::bitmap_and(c.data(), b.data(), num_words);
+  for (size_t i = 0; i < num_words; ++i) {
+    AssertThat(c[i], Equals(a[i] & b[i]));
+  }
+  c = a;
+  ::cgc1::details::bitmap_andnot(c.data(), b.data(), num_words);
+  for (size_t i = 0; i < num_words; ++i) {
+    AssertThat(c[i], Equals(a[i] & ~b[i]));
+  }
+  AssertThat(::cgc1::details::bitmap_any_and(a.data(), b.data(), num_words), IsTrue());
+  AssertThat(::cgc1::details::bitmap_any_and(c.data(), b.data(), num_words), IsFalse());
+  const auto is_set = [&a](size_t i) { return ((a[i / 64] >> (i % 64)) & 1) != 0; };
+  size_t num_set = 0;
+  ::cgc1::details::bitmap_for_set_bits(a.data(), num_bits, [&](size_t i) {
+    AssertThat(is_set(i), IsTrue());
+    ++num_set;
+  });
+  size_t num_in_runs = 0;
+  ::cgc1::details::bitmap_for_set_runs(a.data(), num_bits, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      AssertThat(is_set(i), IsTrue());
+    }
+    if (end < num_bits) {
+      AssertThat(is_set(end), IsFalse());
+    }
+    num_in_runs += end - begin;
+  });
+  size_t expected = 0;
+  for (size_t i = 0; i < num_bits; ++i) {
+    expected += is_set(i);
+  }
+  AssertThat(num_set, Equals(expected));
+  AssertThat(num_in_runs, Equals(expected));
+  AssertThat(::cgc1::details::bitmap_popcount(a.data(), num_words), Equals(expected + 5));
+}
+
+static void gc_stats_test()
+{
+  const auto before = ::cgc1::cgc_gc_stats();
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  const auto after = ::cgc1::cgc_gc_stats();
+  AssertThat(after.m_num_collections, Equals(before.m_num_collections + 1));
+  AssertThat(after.m_total.m_count, Equals(before.m_total.m_count + 1));
+  AssertThat(after.m_time_to_safepoint.m_count, IsGreaterThan(before.m_time_to_safepoint.m_count));
+  AssertThat(after.m_total.m_p50, IsLessThanOrEqualTo(after.m_total.m_max));
+  AssertThat(after.m_total.m_p999, IsLessThanOrEqualTo(after.m_total.m_max));
+  AssertThat(after.m_bytes_marked_total, IsGreaterThanOrEqualTo(before.m_bytes_marked_total));
+}
+
+static void gc_pacer_test()
+{
+  const auto old_divisor = ::cgc1::cgc_free_space_divisor();
+  ::cgc1::cgc_set_free_space_divisor(1);
+  const auto num_collections = cgc1::debug::num_gc_collections();
+  // more than any live heap left by earlier tests, so the pacer must trigger.
+  for (size_t i = 0; i < 262144; ++i) {
+    ::cgc1::cgc_malloc(256);
+  }
+  gks->wait_for_finalization();
+  ::cgc1::cgc_set_free_space_divisor(old_divisor);
+  AssertThat(cgc1::debug::num_gc_collections(), IsGreaterThan(num_collections));
+}
+
+static void background_collector_test()
+{
+  ::cgc1::details::background_collector_t collector;
+  collector.start();
+  const auto num_collections = cgc1::debug::num_gc_collections();
+  collector.wait_for_collection(collector.request_collection());
+  AssertThat(collector.num_finished(), Equals(1_sz));
+  AssertThat(cgc1::debug::num_gc_collections(), IsGreaterThan(num_collections));
+  collector.shutdown();
+  AssertThat(collector.running(), IsFalse());
+  gks->wait_for_finalization();
+}
+
+static void thread_allocation_cache_test()
+{
+  ::std::vector<void *> v;
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t sz = 1; sz <= ::cgc1::details::thread_allocation_cache_t::cs_max_size + 1; ++sz) {
+      const auto ptr = ::cgc1::cgc_malloc_fast(sz);
+      AssertThat(ptr != nullptr, IsTrue());
+      AssertThat(reinterpret_cast<uintptr_t>(ptr) % 16, Equals(0_sz));
+      AssertThat(::cgc1::cgc_size(ptr), IsGreaterThanOrEqualTo(sz));
+      v.push_back(ptr);
+    }
+  }
+  ::std::sort(v.begin(), v.end());
+  AssertThat(::std::adjacent_find(v.begin(), v.end()), Equals(v.end()));
+  AssertThat(::cgc1::details::t_allocation_cache.m_registered, IsTrue());
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+}
+
+static void bitmap_user_data_table_test()
+{
+  auto &table = gks->_bitmap_user_data();
+  const auto num_entries = table.size();
+  // plain objects keep their true size and have no user data.
+  void *const memory = ::cgc1::cgc_malloc(64);
+  AssertThat(::cgc1::cgc_size(memory), Equals(64_sz));
+  AssertThat(table.size(), Equals(num_entries));
+  bool finalized = false;
+  ::cgc1::cgc_register_finalizer(memory, [&finalized](void *) { finalized = true; });
+  AssertThat(table.size(), Equals(num_entries + 1));
+  ::cgc1::cgc_set_abort_on_collect(memory, true);
+  AssertThat(table.size(), Equals(num_entries + 1));
+  // explicit free drops the entry without finalizing.
+  ::cgc1::cgc_free(memory);
+  AssertThat(table.size(), Equals(num_entries));
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(finalized, IsFalse());
+}
+
+/**
+ * \brief Setup for typed allocation test.
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE void typed_allocation_test__setup(typed_node_t *&node, uintptr_t &next, uintptr_t &scalar)
+{
+  node = ::cgc1::cgc_make<typed_node_t>();
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&node));
+  void *const next_memory = ::cgc1::cgc_malloc(32);
+  void *const scalar_memory = ::cgc1::cgc_malloc(32);
+  node->m_next = next_memory;
+  // looks like a pointer, but the layout says it is not one.
+  node->m_scalar = reinterpret_cast<uintptr_t>(scalar_memory);
+  next = ::mcpputil::hide_pointer(next_memory);
+  scalar = ::mcpputil::hide_pointer(scalar_memory);
+}
+
+static void typed_allocation_test()
+{
+  typed_node_t *node = nullptr;
+  uintptr_t next = 0;
+  uintptr_t scalar = 0;
+  typed_allocation_test__setup(node, next, scalar);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  AssertThat(mcppalloc::bitmap_allocator::details::get_state(node)->type_id(), Equals(3_sz));
+  AssertThat(::cgc1::cgc_size(node), IsGreaterThanOrEqualTo(sizeof(typed_node_t)));
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(cgc1::debug::_cgc_hidden_packed_marked(next), IsTrue());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_marked(scalar), IsFalse());
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&node));
+  // layouts without pointers are atomic and long layouts are shared.
+  AssertThat(::cgc1::cgc_make_descriptor(nullptr, 0), Equals(::cgc1::details::cs_pointer_free_descriptor));
+  ::std::array<uint64_t, 2> bitmap{{1, 1}};
+  const auto descriptor = ::cgc1::cgc_make_descriptor(bitmap.data(), 128);
+  AssertThat(descriptor & ::cgc1::details::cs_inline_descriptor_tag, Equals(0_sz));
+  AssertThat(::cgc1::cgc_make_descriptor(bitmap.data(), 128), Equals(descriptor));
+  AssertThat(::cgc1::cgc_malloc_typed(4096, descriptor) != nullptr, IsTrue());
+}
+
+static void realloc_test()
+{
+  auto memory = reinterpret_cast<uint8_t *>(::cgc1::cgc_malloc(20));
+  const auto size = ::cgc1::cgc_size(memory);
+  ::mcpputil::put_unique_seeded_random(memory, size);
+  // fits the bin, so nothing moves.
+  AssertThat(::cgc1::cgc_realloc(memory, size), Equals(static_cast<void *>(memory)));
+  AssertThat(is_unique_seeded_random(memory, size), IsTrue());
+  auto grown = reinterpret_cast<uint8_t *>(::cgc1::cgc_realloc(memory, size + 1));
+  AssertThat(grown != memory, IsTrue());
+  AssertThat(is_unique_seeded_random(grown, size), IsTrue());
+  // shrinking clears the tail.
+  AssertThat(::cgc1::cgc_realloc(grown, 4), Equals(static_cast<void *>(grown)));
+  AssertThat(::mcpputil::is_zero(grown + 4, size - 4), IsTrue());
+  // kind of object is kept.
+  void *const atomic = ::cgc1::cgc_realloc(::cgc1::cgc_malloc_atomic(16), 100);
+  AssertThat(::mcppalloc::bitmap_allocator::details::get_state(atomic)->type_id(), Equals(1_sz));
+  // interior pointers are refused without touching the object.
+  AssertThat(::cgc1::cgc_realloc(grown + 16, 100) == nullptr, IsTrue());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(::mcpputil::hide_pointer(grown)), IsFalse());
+  // zero size frees.
+  const auto freed = ::mcpputil::hide_pointer(grown);
+  AssertThat(::cgc1::cgc_realloc(grown, 0) == nullptr, IsTrue());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(freed), IsTrue());
+}
+
+static void malloc_many_test()
+{
+  ::std::array<void *, 100> objects{};
+  AssertThat(::cgc1::cgc_malloc_many(48, objects.size(), objects.data()), Equals(objects.size()));
+  for (auto object : objects) {
+    AssertThat(::cgc1::cgc_size(object), IsGreaterThanOrEqualTo(48_sz));
+  }
+  ::std::sort(objects.begin(), objects.end());
+  AssertThat(::std::adjacent_find(objects.begin(), objects.end()), Equals(objects.end()));
+  const auto many = ::cgc1::make_cgc_many<size_t>(10);
+  AssertThat(many.size(), Equals(10_sz));
+  size_t list_length = 0;
+  for (void *object = GC_malloc_many(32); object; object = GC_NEXT(object)) {
+    ++list_length;
+  }
+  AssertThat(list_length, IsGreaterThan(1_sz));
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+}
+
+static MCPPALLOC_NO_INLINE void generational_test__setup(void **holder, uintptr_t &live, uintptr_t &dead)
+{
+  // objects in states created since the last collection are young.
+  const auto allocate_young = []() {
+    void *memory = nullptr;
+    do {
+      memory = ::cgc1::cgc_malloc(64);
+    } while (gks->_d_in_old_generation(memory));
+    return memory;
+  };
+  void *const live_memory = allocate_young();
+  void *const dead_memory = allocate_young();
+  // only an old object references this, so it must be found through a remembered page.
+  *holder = live_memory;
+  live = ::mcpputil::hide_pointer(live_memory);
+  dead = ::mcpputil::hide_pointer(dead_memory);
+}
+
+/**
+ * \brief Check a minor collection finds a young object referenced only by an old one.
+ *
+ * @param remembered True if written pages can be found, otherwise the minor collection must fall back to a full one.
+ **/
+static void generational_test__run(bool remembered)
+{
+  ::cgc1::cgc_set_minor_collections_per_full(4);
+  void **holder = reinterpret_cast<void **>(::cgc1::cgc_malloc(64));
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&holder));
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(gks->_d_in_old_generation(holder), Equals(remembered));
+  uintptr_t live = 0;
+  uintptr_t dead = 0;
+  generational_test__setup(holder, live, dead);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  const auto num_minor = gks->gc_stats().snapshot().m_num_minor_collections;
+  const auto num_collections = cgc1::debug::num_gc_collections();
+  ::cgc1::cgc_force_minor_collect();
+  gks->wait_for_finalization();
+  AssertThat(cgc1::debug::num_gc_collections(), Equals(num_collections + 1));
+  AssertThat(gks->gc_stats().snapshot().m_num_minor_collections, Equals(num_minor + (remembered ? 1 : 0)));
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(live), IsFalse());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(dead), IsTrue());
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&holder));
+  ::cgc1::cgc_set_minor_collections_per_full(0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+}
+
+static void generational_test()
+{
+  generational_test__run(::cgc1::details::dirty_page_tracker_t::is_supported());
+}
+
+static void remembered_page_fallback_test()
+{
+  // every page in use is remembered, so minor collections work without soft dirty pages.
+  gks->set_dirty_page_fallback(true);
+  generational_test__run(true);
+  gks->set_dirty_page_fallback(false);
+}
+
+static MCPPALLOC_NO_INLINE void sticky_mark_bits_test__setup(void **holder, uintptr_t &live, uintptr_t &dead)
+{
+  // objects in free slots of old states are only collected by minor collections with sticky mark bits.
+  const auto allocate_old = []() {
+    void *memory = nullptr;
+    for (size_t i = 0; i < 10000; ++i) {
+      memory = ::cgc1::cgc_malloc(64);
+      if (gks->_d_in_old_generation(memory)) {
+        break;
+      }
+    }
+    return memory;
+  };
+  void *const live_memory = allocate_old();
+  void *const dead_memory = allocate_old();
+  *holder = live_memory;
+  live = ::mcpputil::hide_pointer(live_memory);
+  dead = ::mcpputil::hide_pointer(dead_memory);
+}
+
+static void sticky_mark_bits_test()
+{
+  // without remembered pages the minor collection falls back to a full one, which must free the same objects.
+  const bool remembered = ::cgc1::details::dirty_page_tracker_t::is_supported();
+  ::cgc1::cgc_set_minor_collections_per_full(4);
+  ::cgc1::cgc_set_sticky_mark_bits(true);
+  void **holder = reinterpret_cast<void **>(::cgc1::cgc_malloc(64));
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&holder));
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  uintptr_t live = 0;
+  uintptr_t dead = 0;
+  sticky_mark_bits_test__setup(holder, live, dead);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  AssertThat(cgc1::debug::_cgc_hidden_packed_marked(live), IsFalse());
+  const auto num_minor = gks->gc_stats().snapshot().m_num_minor_collections;
+  const auto num_collections = cgc1::debug::num_gc_collections();
+  ::cgc1::cgc_force_minor_collect();
+  gks->wait_for_finalization();
+  AssertThat(cgc1::debug::num_gc_collections(), Equals(num_collections + 1));
+  AssertThat(gks->gc_stats().snapshot().m_num_minor_collections, Equals(num_minor + (remembered ? 1 : 0)));
+  // survivors stay marked, so they are old from now on.
+  AssertThat(cgc1::debug::_cgc_hidden_packed_marked(live), IsTrue());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(dead), IsTrue());
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&holder));
+  ::cgc1::cgc_set_sticky_mark_bits(false);
+  ::cgc1::cgc_set_minor_collections_per_full(0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+}
+
 void gc_bitmap_tests()
 {
   describe("GC", []() {
@@ -249,5 +590,17 @@ void gc_bitmap_tests()
     it("packed_linked_list_test", []() { packed_linked_list_test(); });
     it("packed_allocator_test", []() { packed_allocator_test(); });
     it("gc_repeat_alloc_test", []() { gc_repeat_alloc_test(); });
+    it("bitmap_kernels_test", []() { bitmap_kernels_test(); });
+    it("gc_stats_test", []() { gc_stats_test(); });
+    it("gc_pacer_test", []() { gc_pacer_test(); });
+    it("background_collector_test", []() { background_collector_test(); });
+    it("thread_allocation_cache_test", []() { thread_allocation_cache_test(); });
+    it("bitmap_user_data_table_test", []() { bitmap_user_data_table_test(); });
+    it("typed_allocation_test", []() { typed_allocation_test(); });
+    it("realloc_test", []() { realloc_test(); });
+    it("malloc_many_test", []() { malloc_many_test(); });
+    it("generational_test", []() { generational_test(); });
+    it("remembered_page_fallback_test", []() { remembered_page_fallback_test(); });
+    it("sticky_mark_bits_test", []() { sticky_mark_bits_test(); });
   });
 }
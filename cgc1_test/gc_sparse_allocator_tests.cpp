@@ -10,6 +10,7 @@
 #include <cstring>
 #include <mcppalloc/mcppalloc_sparse/allocator.hpp>
 #include <mcpputil/mcpputil/bandit.hpp>
+#include <set>
 #include <thread>
 static ::std::vector<size_t> locations;
 static ::mcpputil::spinlock_t debug_mutex;
@@ -700,6 +701,54 @@ static MCPPALLOC_NO_INLINE void return_to_global_test2()
   ::mcpputil::secure_zero(&end, sizeof(end));
   ::cgc1::clean_stack(0, 0, 0, 0, 0);
 }
+static ::std::atomic<size_t> s_block_destroy_test_finalized{0};
+/**
+ * \brief Setup for block destroy test.
+ *
+ * Allocates far more than fits in one block, with a finalizer on every other object.
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE void block_destroy_test__setup(size_t num_objects, size_t object_size, ::std::set<uintptr_t> &objects)
+{
+  auto &ta = gks->gc_allocator().initialize_thread();
+  for (size_t i = 0; i < num_objects; ++i) {
+    void *memory = ta.allocate(object_size).m_ptr;
+    if (i % 2 == 0) {
+      cgc1::cgc_register_finalizer(memory, [](void *) { ++s_block_destroy_test_finalized; }, true);
+    }
+    objects.insert(::mcpputil::hide_pointer(memory));
+    ::mcpputil::secure_zero_pointer(memory);
+  }
+}
+/**
+ * \brief Test that objects freed across several blocks are finalized and can be allocated again.
+ **/
+static void block_destroy_test()
+{
+  const size_t num_objects = 4096;
+  const size_t object_size = 500;
+  ::std::set<uintptr_t> objects;
+  const auto num_finalized = s_block_destroy_test_finalized.load();
+  block_destroy_test__setup(num_objects, object_size, objects);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(gks->num_freed_in_last_collection(), IsGreaterThanOrEqualTo(num_objects));
+  AssertThat(s_block_destroy_test_finalized.load(), Equals(num_finalized + num_objects / 2));
+  // freed memory must be handed back to the allocator, not just finalized.
+  auto &ta = gks->gc_allocator().initialize_thread();
+  size_t num_reused = 0;
+  for (size_t i = 0; i < num_objects; ++i) {
+    void *memory = ta.allocate(object_size).m_ptr;
+    AssertThat(memory != nullptr, IsTrue());
+    if (objects.count(::mcpputil::hide_pointer(memory)) != 0) {
+      ++num_reused;
+    }
+    ::mcpputil::secure_zero_pointer(memory);
+  }
+  AssertThat(num_reused, IsGreaterThan(0_sz));
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+}
 /**
  * \brief Test various APIs.
  **/
@@ -779,6 +828,11 @@ void gc_bandit_tests()
       uncollectable_test();
       ::cgc1::clean_stack(0, 0, 0, 0, 0);
     });
+    it("block_destroy_test", []() {
+      ::cgc1::clean_stack(0, 0, 0, 0, 0);
+      block_destroy_test();
+      ::cgc1::clean_stack(0, 0, 0, 0, 0);
+    });
     it("api_tests", []() {
       ::cgc1::clean_stack(0, 0, 0, 0, 0);
       api_tests();
@@ -0,0 +1,714 @@
+#include "../cgc1/src/global_kernel_state.hpp"
+#include "../cgc1/src/internal_declarations.hpp"
+#include "../cgc1/src/numa.hpp"
+#include "../cgc1/src/stack_scan.hpp"
+#include <cgc1/cgc1.hpp>
+#include <cgc1/hide_pointer.hpp>
+#include <mcppalloc/mcppalloc_bitmap_allocator/bitmap_allocator.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <mcpputil/mcpputil/bandit.hpp>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace ::bandit;
+using namespace ::snowhouse;
+// alias
+static auto &gks = ::cgc1::details::g_gks;
+using namespace ::mcpputil::literals;
+
+/**
+ * \brief Restore gc threads the kernel was initialized with.
+ **/
+static void restore_gc_threads(size_t num_gc_threads)
+{
+  gks->_d_set_gc_threads(num_gc_threads, gks->initialization_parameters_ref().mark_stack_size());
+}
+
+/**
+ * \brief Setup for parallel mark test.
+ *
+ * One root holds num_lists lists, so other gc threads only get work by stealing.
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE void parallel_mark_test__setup(void **&root,
+                                                          size_t num_lists,
+                                                          size_t list_length,
+                                                          ::std::vector<uintptr_t> &live,
+                                                          ::std::vector<uintptr_t> &dead)
+{
+  root = reinterpret_cast<void **>(::cgc1::cgc_malloc(num_lists * sizeof(void *)));
+  for (size_t i = 0; i < num_lists; ++i) {
+    void *list = nullptr;
+    for (size_t j = 0; j < list_length; ++j) {
+      void **node = reinterpret_cast<void **>(::cgc1::cgc_malloc(2 * sizeof(void *)));
+      node[0] = list;
+      list = node;
+      live.push_back(::mcpputil::hide_pointer(node));
+      dead.push_back(::mcpputil::hide_pointer(::cgc1::cgc_malloc(2 * sizeof(void *))));
+    }
+    root[i] = list;
+  }
+}
+
+static void parallel_mark_test()
+{
+  const auto num_gc_threads = gks->_d_num_gc_threads();
+  gks->_d_set_gc_threads(4, gks->initialization_parameters_ref().mark_stack_size());
+  AssertThat(gks->_d_num_gc_threads(), Equals(4_sz));
+  void **root = nullptr;
+  ::std::vector<uintptr_t> live;
+  ::std::vector<uintptr_t> dead;
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&root));
+  parallel_mark_test__setup(root, 64, 256, live, dead);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  for (auto hidden : live) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsFalse());
+  }
+  for (auto hidden : dead) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsTrue());
+  }
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&root));
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  for (auto hidden : live) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsTrue());
+  }
+  restore_gc_threads(num_gc_threads);
+}
+
+/**
+ * \brief Setup for parallel sparse mark test.
+ *
+ * Every parent points at all children, so gc threads race to mark each child.
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE void parallel_sparse_mark_test__setup(void **&root, size_t num_parents, size_t num_children)
+{
+  auto &ta = gks->gc_allocator().initialize_thread();
+  void **children = reinterpret_cast<void **>(ta.allocate(num_children * sizeof(void *)).m_ptr);
+  for (size_t i = 0; i < num_children; ++i) {
+    children[i] = ta.allocate(64).m_ptr;
+  }
+  root = reinterpret_cast<void **>(ta.allocate(num_parents * sizeof(void *)).m_ptr);
+  for (size_t i = 0; i < num_parents; ++i) {
+    void **parent = reinterpret_cast<void **>(ta.allocate(num_children * sizeof(void *)).m_ptr);
+    ::std::copy(children, children + num_children, parent);
+    root[i] = parent;
+  }
+  ::mcpputil::secure_zero_pointer(children);
+}
+
+static void parallel_sparse_mark_test()
+{
+  const auto num_gc_threads = gks->_d_num_gc_threads();
+  gks->_d_set_gc_threads(1, gks->initialization_parameters_ref().mark_stack_size());
+  void **root = nullptr;
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&root));
+  parallel_sparse_mark_test__setup(root, 256, 64);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  // the first collection also frees anything earlier tests left, so both measure the same heap.
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  const auto serial_bytes_marked = ::cgc1::cgc_gc_stats().m_bytes_marked_last;
+  gks->_d_set_gc_threads(4, gks->initialization_parameters_ref().mark_stack_size());
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  // a child marked by two gc threads would be counted twice.
+  AssertThat(::cgc1::cgc_gc_stats().m_bytes_marked_last, Equals(serial_bytes_marked));
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&root));
+  restore_gc_threads(num_gc_threads);
+}
+
+/**
+ * \brief Allocate a tree of given depth where every node holds width children, recording hidden nodes.
+ **/
+static MCPPALLOC_NO_INLINE void *mark_stack_overflow_test__tree(size_t depth, size_t width, ::std::vector<uintptr_t> &nodes)
+{
+  void **node = reinterpret_cast<void **>(::cgc1::cgc_malloc(width * sizeof(void *)));
+  nodes.push_back(::mcpputil::hide_pointer(node));
+  if (depth != 0) {
+    for (size_t i = 0; i < width; ++i) {
+      node[i] = mark_stack_overflow_test__tree(depth - 1, width, nodes);
+    }
+  }
+  return node;
+}
+
+static void mark_stack_overflow_test()
+{
+  const auto num_gc_threads = gks->_d_num_gc_threads();
+  // every interior node has more children than fit on the mark stack.
+  gks->_d_set_gc_threads(1, 4);
+  void *root = nullptr;
+  ::std::vector<uintptr_t> nodes;
+  cgc1::cgc_add_root(&root);
+  root = mark_stack_overflow_test__tree(4, 8, nodes);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  for (auto hidden : nodes) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsFalse());
+  }
+  cgc1::cgc_remove_root(&root);
+  restore_gc_threads(num_gc_threads);
+}
+
+/**
+ * \brief Number of sparse objects of concurrent mark test collected.
+ *
+ * Static since finalizers may run after the test.
+ **/
+static ::std::atomic<size_t> s_concurrent_mark_test_finalized{0};
+
+/**
+ * \brief Setup for concurrent mark test.
+ *
+ * Fills from with bitmap objects and interior pointers into sparse objects.
+ **/
+static MCPPALLOC_NO_INLINE void concurrent_mark_test__setup(void **from, size_t num_slots, ::std::vector<uintptr_t> &bitmap_objects)
+{
+  auto &sparse_allocator = gks->gc_allocator().initialize_thread();
+  for (size_t i = 0; i < num_slots; ++i) {
+    if (i % 2 == 0) {
+      from[i] = ::cgc1::cgc_malloc(32);
+      bitmap_objects.push_back(::mcpputil::hide_pointer(from[i]));
+    } else {
+      void *const memory = sparse_allocator.allocate(64).m_ptr;
+      ::cgc1::cgc_register_finalizer(memory, [](void *) { s_concurrent_mark_test_finalized++; }, true);
+      from[i] = reinterpret_cast<uint8_t *>(memory) + sizeof(void *);
+    }
+  }
+}
+
+static void concurrent_mark_test()
+{
+  // without soft dirty pages the fallback rescans the whole heap at remark, which is enough to exercise it.
+  gks->set_concurrent_mark(true);
+  gks->set_dirty_page_fallback(true);
+  const size_t num_slots = 256;
+  void **from = reinterpret_cast<void **>(::cgc1::cgc_malloc(num_slots * sizeof(void *)));
+  void **to = reinterpret_cast<void **>(::cgc1::cgc_malloc(num_slots * sizeof(void *)));
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&from));
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&to));
+  ::std::vector<uintptr_t> bitmap_objects;
+  const auto num_finalized = s_concurrent_mark_test_finalized.load();
+  concurrent_mark_test__setup(from, num_slots, bitmap_objects);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  const auto num_remarks = ::cgc1::cgc_gc_stats().m_remark.m_count;
+  ::std::atomic<bool> keep_going{true};
+  // move every object between the arrays so that a mark that sees neither copy loses it.
+  ::std::thread mutator([&keep_going, from, to, num_slots]() {
+    CGC1_INITIALIZE_THREAD();
+    void **src = from;
+    void **dst = to;
+    while (keep_going) {
+      for (size_t i = 0; i < num_slots; ++i) {
+        dst[i] = src[i];
+        src[i] = nullptr;
+      }
+      ::std::swap(src, dst);
+    }
+    cgc1::cgc_unregister_thread();
+  });
+  for (size_t i = 0; i < 10; ++i) {
+    cgc1::cgc_force_collect();
+    gks->wait_for_finalization();
+  }
+  keep_going = false;
+  mutator.join();
+  AssertThat(::cgc1::cgc_gc_stats().m_remark.m_count, IsGreaterThanOrEqualTo(num_remarks + 10));
+  for (auto hidden : bitmap_objects) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsFalse());
+  }
+  AssertThat(s_concurrent_mark_test_finalized.load(), Equals(num_finalized));
+  gks->set_concurrent_mark(false);
+  gks->set_dirty_page_fallback(false);
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&from));
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&to));
+}
+
+/**
+ * \brief Allocate objects of 64 bytes until one lands in state, returning nullptr if none did.
+ **/
+static MCPPALLOC_NO_INLINE void *allocate_in_state(::mcppalloc::bitmap_allocator::details::bitmap_state_t *state)
+{
+  for (size_t i = 0; i < 100000; ++i) {
+    void *const memory = ::cgc1::cgc_malloc(64);
+    if (::mcppalloc::bitmap_allocator::details::get_state(memory) == state) {
+      return memory;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * \brief Setup for lazy sweep test.
+ *
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE void lazy_sweep_test__setup(void *&live, uintptr_t &dead)
+{
+  live = ::cgc1::cgc_malloc(64);
+  void *const dead_memory = allocate_in_state(::mcppalloc::bitmap_allocator::details::get_state(live));
+  AssertThat(dead_memory != nullptr, IsTrue());
+  dead = ::mcpputil::hide_pointer(dead_memory);
+}
+
+static void lazy_sweep_test()
+{
+  gks->set_lazy_sweep(true);
+  void *live = nullptr;
+  uintptr_t dead = 0;
+  cgc1::cgc_add_root(&live);
+  lazy_sweep_test__setup(live, dead);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  // the state was marked, but nobody swept it yet.
+  const auto state = ::mcppalloc::bitmap_allocator::details::get_state(live);
+  AssertThat(gks->_d_sweep_pending(live), IsTrue());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(dead), IsFalse());
+  // allocating from the state sweeps it first.
+  const auto fresh = ::mcpputil::hide_pointer(allocate_in_state(state));
+  AssertThat(fresh != ::mcpputil::hide_pointer(nullptr), IsTrue());
+  AssertThat(gks->_d_sweep_pending(live), IsFalse());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(dead), IsTrue());
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(::mcpputil::hide_pointer(live)), IsFalse());
+  // the sweep must not free what was allocated after marking.
+  AssertThat(cgc1::debug::_cgc_hidden_packed_free(fresh), IsFalse());
+  cgc1::cgc_remove_root(&live);
+  gks->set_lazy_sweep(false);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+}
+
+/**
+ * \brief Setup for lazy sweep garbage state test.
+ *
+ * Fills the state of the first object with garbage, returning the state.
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE ::mcppalloc::bitmap_allocator::details::bitmap_state_t *lazy_sweep_garbage_state_test__setup()
+{
+  const auto state = ::mcppalloc::bitmap_allocator::details::get_state(::cgc1::cgc_malloc(64));
+  for (size_t i = 0; i < 100000; ++i) {
+    // the allocator only moves on once the state is full.
+    if (::mcppalloc::bitmap_allocator::details::get_state(::cgc1::cgc_malloc(64)) != state) {
+      return state;
+    }
+  }
+  return nullptr;
+}
+
+static void lazy_sweep_garbage_state_test()
+{
+  gks->set_lazy_sweep(true);
+  // collections between allocations would sweep the state eagerly.
+  const auto free_space_divisor = ::cgc1::cgc_free_space_divisor();
+  ::cgc1::cgc_set_free_space_divisor(0);
+  const auto state = lazy_sweep_garbage_state_test__setup();
+  AssertThat(state != nullptr, IsTrue());
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(gks->_d_sweep_pending(state), IsTrue());
+  const auto num_collections = cgc1::debug::num_gc_collections();
+  // the state has no free slot, so only sweeping it when the allocator moves on makes it usable.
+  AssertThat(allocate_in_state(state) != nullptr, IsTrue());
+  AssertThat(gks->_d_sweep_pending(state), IsFalse());
+  AssertThat(cgc1::debug::num_gc_collections(), Equals(num_collections));
+  ::cgc1::cgc_set_free_space_divisor(free_space_divisor);
+  gks->set_lazy_sweep(false);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+}
+
+/**
+ * \brief Setup for parallel sweep test.
+ *
+ * Allocates objects of several sizes, keeping every other one in live.
+ **/
+static MCPPALLOC_NO_INLINE void parallel_sweep_test__setup(void **live,
+                                                           size_t num_objects,
+                                                           ::std::vector<uintptr_t> &live_objects,
+                                                           ::std::vector<uintptr_t> &dead_objects,
+                                                           size_t &num_states)
+{
+  ::std::set<void *> states;
+  for (size_t i = 0; i < 2 * num_objects; ++i) {
+    void *const memory = ::cgc1::cgc_malloc(static_cast<size_t>(32) << (i % 4));
+    states.insert(::mcppalloc::bitmap_allocator::details::get_state(memory));
+    if (i % 2 == 0) {
+      live[i / 2] = memory;
+      live_objects.push_back(::mcpputil::hide_pointer(memory));
+    } else {
+      dead_objects.push_back(::mcpputil::hide_pointer(memory));
+    }
+  }
+  num_states = states.size();
+}
+
+static void parallel_sweep_test()
+{
+  const auto num_gc_threads = gks->_d_num_gc_threads();
+  gks->_d_set_gc_threads(4, gks->initialization_parameters_ref().mark_stack_size());
+  const size_t num_objects = 8192;
+  void **live = reinterpret_cast<void **>(::cgc1::cgc_malloc(num_objects * sizeof(void *)));
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&live));
+  ::std::vector<uintptr_t> live_objects;
+  ::std::vector<uintptr_t> dead_objects;
+  size_t num_states = 0;
+  parallel_sweep_test__setup(live, num_objects, live_objects, dead_objects, num_states);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  // every gc thread gets several states to clear and sweep.
+  AssertThat(num_states, IsGreaterThan(2 * gks->_d_num_gc_threads()));
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(::cgc1::cgc_gc_stats().m_bitmap_objects_freed_last, IsGreaterThanOrEqualTo(dead_objects.size()));
+  for (auto hidden : live_objects) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsFalse());
+  }
+  for (auto hidden : dead_objects) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsTrue());
+  }
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&live));
+  restore_gc_threads(num_gc_threads);
+}
+
+static void incremental_mark_test()
+{
+  // without soft dirty pages the fallback rescans the whole heap at remark, which is enough to exercise it.
+  gks->set_dirty_page_fallback(true);
+  // small enough that the budget runs out after every check.
+  gks->set_incremental_mark_budget(1);
+  const size_t num_objects = 16384;
+  void **live = reinterpret_cast<void **>(::cgc1::cgc_malloc(num_objects * sizeof(void *)));
+  cgc1::cgc_add_root(reinterpret_cast<void **>(&live));
+  ::std::vector<uintptr_t> live_objects;
+  ::std::vector<uintptr_t> dead_objects;
+  size_t num_states = 0;
+  parallel_sweep_test__setup(live, num_objects, live_objects, dead_objects, num_states);
+  ::cgc1::clean_stack(0, 0, 0, 0, 0);
+  const auto num_slices = ::cgc1::cgc_gc_stats().m_mark_slice.m_count;
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(::cgc1::cgc_gc_stats().m_mark_slice.m_count, IsGreaterThan(num_slices + 1));
+  for (auto hidden : live_objects) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsFalse());
+  }
+  for (auto hidden : dead_objects) {
+    AssertThat(cgc1::debug::_cgc_hidden_packed_free(hidden), IsTrue());
+  }
+  gks->set_incremental_mark_budget(0);
+  gks->set_dirty_page_fallback(false);
+  cgc1::cgc_remove_root(reinterpret_cast<void **>(&live));
+}
+
+static void sparse_object_header_size_test()
+{
+  using namespace ::cgc1::details;
+  alignas(64) static uint8_t object[64];
+  const auto os = gc_sparse_object_state_t::template from_object_start<gc_sparse_object_state_t>(object + 32);
+  AssertThat(static_cast<size_t>(object + 32 - reinterpret_cast<uint8_t *>(os)), Equals(cs_sparse_object_header_size));
+}
+
+static void scan_words_in_ranges_test()
+{
+  using namespace ::cgc1::details;
+  // ranges that do not start or end on a word boundary.
+  const scan_range_t range0{0x10003, 0x1001};
+  const scan_range_t range1{0x7fff0005, 0x33};
+  const ::std::array<uintptr_t, 12> values{{0x10002, 0x10003, 0x10004, 0x11003, 0x11004, 0x7fff0004, 0x7fff0005, 0x7fff0037,
+                                            0x7fff0038, 0, ::std::numeric_limits<uintptr_t>::max(), 0x10003 + 0x800}};
+  const auto in_range = [](uintptr_t value, scan_range_t range) {
+    return value >= range.m_begin && value < range.m_begin + range.m_size;
+  };
+  ::std::array<uint8_t *, 67> words;
+  for (size_t i = 0; i < words.size(); ++i) {
+    words[i] = reinterpret_cast<uint8_t *>(values[(i * 5) % values.size()]);
+  }
+  ::std::array<uint8_t **, 67> found;
+  // every length, so vector loops end on every possible tail.
+  for (size_t len = 0; len <= words.size(); ++len) {
+    for (size_t offset = 0; offset < 3 && offset <= len; ++offset) {
+      const auto num_found = scan_words_in_ranges(words.data() + offset, words.data() + len, range0, range1, found.data());
+      size_t expected = 0;
+      for (size_t i = offset; i < len; ++i) {
+        const auto value = reinterpret_cast<uintptr_t>(words[i]);
+        if (in_range(value, range0) || in_range(value, range1)) {
+          AssertThat(expected < num_found, IsTrue());
+          AssertThat(found[expected] == words.data() + i, IsTrue());
+          ++expected;
+        }
+      }
+      AssertThat(num_found, Equals(expected));
+    }
+  }
+}
+
+static void safepoint_test()
+{
+  ::std::atomic<bool> keep_going{true};
+  ::std::atomic<bool> started{false};
+  ::std::thread t1([&keep_going, &started]() {
+    CGC1_INITIALIZE_THREAD();
+    started = true;
+    while (keep_going) {
+      cgc1::cgc_safepoint();
+    }
+    cgc1::cgc_unregister_thread();
+  });
+  while (!started) {
+    ::std::this_thread::yield();
+  }
+  const auto num_collections = cgc1::debug::num_gc_collections();
+  for (size_t i = 0; i < 10; ++i) {
+    cgc1::cgc_force_collect();
+    gks->wait_for_finalization();
+  }
+  keep_going = false;
+  t1.join();
+  AssertThat(cgc1::debug::num_gc_collections(), Equals(num_collections + 10));
+}
+
+static void root_log_test()
+{
+  // more changes than a thread root log holds, so it fills and is merged along the way.
+  ::std::array<void *, 1000> slots{};
+  for (auto &slot : slots) {
+    cgc1::cgc_add_root(&slot);
+  }
+  for (size_t i = 0; i < slots.size(); i += 2) {
+    cgc1::cgc_remove_root(&slots[i]);
+  }
+  for (size_t i = 0; i < slots.size(); ++i) {
+    AssertThat(cgc1::cgc_has_root(&slots[i]), Equals(i % 2 == 1));
+  }
+  // a root added by one thread can be removed by another.
+  void *shared = nullptr;
+  ::std::thread thread([&shared]() {
+    CGC1_INITIALIZE_THREAD();
+    cgc1::cgc_add_root(&shared);
+    cgc1::cgc_unregister_thread();
+  });
+  thread.join();
+  AssertThat(cgc1::cgc_has_root(&shared), IsTrue());
+  cgc1::cgc_remove_root(&shared);
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(cgc1::cgc_has_root(&shared), IsFalse());
+  for (size_t i = 1; i < slots.size(); i += 2) {
+    cgc1::cgc_remove_root(&slots[i]);
+  }
+}
+
+static void finalizer_executor_test()
+{
+  ::cgc1::details::finalizer_executor_t executor;
+  executor.start(1, 2);
+  ::std::atomic<bool> started{false};
+  ::std::atomic<bool> gate{false};
+  ::std::atomic<size_t> num_run{0};
+  executor.submit([&started, &gate]() {
+    started = true;
+    while (!gate) {
+      ::std::this_thread::yield();
+    }
+  });
+  while (!started) {
+    ::std::this_thread::yield();
+  }
+  // two fit in the queue, the third runs on this thread.
+  for (size_t i = 0; i < 3; ++i) {
+    executor.submit([&num_run]() { ++num_run; });
+  }
+  AssertThat(num_run.load(), Equals(1_sz));
+  // a full queue leaves the task with the caller instead of running it.
+  ::cgc1::details::finalizer_executor_t::task_type task = [&num_run]() { ++num_run; };
+  AssertThat(executor.try_submit(::std::move(task)), IsFalse());
+  AssertThat(static_cast<bool>(task), IsTrue());
+  AssertThat(num_run.load(), Equals(1_sz));
+  gate = true;
+  executor.wait_until_idle();
+  AssertThat(num_run.load(), Equals(3_sz));
+  AssertThat(executor.try_submit(::std::move(task)), IsTrue());
+  executor.wait_until_idle();
+  AssertThat(num_run.load(), Equals(4_sz));
+  const auto stats = executor.stats();
+  AssertThat(stats.m_num_submitted, Equals(5_sz));
+  AssertThat(stats.m_num_completed, Equals(5_sz));
+  AssertThat(stats.m_num_run_inline, Equals(1_sz));
+  AssertThat(stats.m_peak_queue_depth, Equals(2_sz));
+  executor.shutdown();
+  AssertThat(executor.running(), IsFalse());
+  gks->wait_for_finalization();
+}
+
+static ::std::atomic<size_t> s_finalizer_queue_full_test_finalized{0};
+static ::std::atomic<size_t> s_finalizer_queue_full_test_wrong_thread{0};
+static ::std::thread::id s_finalizer_queue_full_test_user_thread;
+/**
+ * \brief Setup for finalizer queue full test.
+ *
+ * Half of the finalizers may run on any thread, the other half are restricted.
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE void finalizer_queue_full_test__setup(size_t num_objects)
+{
+  for (size_t i = 0; i < num_objects; ++i) {
+    void *const memory = ::cgc1::cgc_malloc(64);
+    ::cgc1::cgc_register_finalizer(memory,
+                                   [](void *) {
+                                     if (::std::this_thread::get_id() != s_finalizer_queue_full_test_user_thread &&
+                                         !::cgc1::details::finalizer_executor_t::is_executor_thread()) {
+                                       ++s_finalizer_queue_full_test_wrong_thread;
+                                     }
+                                     ++s_finalizer_queue_full_test_finalized;
+                                   },
+                                   i % 2 == 0);
+  }
+}
+
+static void finalizer_queue_full_test()
+{
+  static constexpr const size_t num_objects = 100;
+  s_finalizer_queue_full_test_user_thread = ::std::this_thread::get_id();
+  auto &executor = gks->_finalizer_executor();
+  executor.start(1, 1);
+  ::std::atomic<bool> started{false};
+  ::std::atomic<bool> gate{false};
+  ::cgc1::details::finalizer_executor_t::task_type blocker = [&started, &gate]() {
+    started = true;
+    while (!gate) {
+      ::std::this_thread::yield();
+    }
+  };
+  AssertThat(executor.try_submit(::std::move(blocker)), IsTrue());
+  while (!started) {
+    ::std::this_thread::yield();
+  }
+  ::cgc1::details::finalizer_executor_t::task_type filler = []() {};
+  AssertThat(executor.try_submit(::std::move(filler)), IsTrue());
+  finalizer_queue_full_test__setup(num_objects);
+  ::cgc1::cgc_force_collect();
+  // the executor is blocked, so only wait for gc threads.
+  gks->wait_for_finalization(false);
+  // no gc thread ran a finalizer in place of the full queue.
+  AssertThat(s_finalizer_queue_full_test_finalized.load(), Equals(0_sz));
+  AssertThat(executor.stats().m_num_run_inline, Equals(0_sz));
+  gks->local_thread_finalization();
+  AssertThat(s_finalizer_queue_full_test_finalized.load(), Equals(num_objects));
+  AssertThat(s_finalizer_queue_full_test_wrong_thread.load(), Equals(0_sz));
+  gate = true;
+  executor.wait_until_idle();
+  executor.shutdown();
+  ::cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+}
+
+/**
+ * \brief Allocate an object, pass a safepoint, then return true if the object survived.
+ *
+ * A collection that missed this thread would not see the object on its stack.
+ * This must be a separate funciton to make sure the compiler does not hide pointers somewhere.
+ **/
+static MCPPALLOC_NO_INLINE bool thread_registry_test__survives_safepoint()
+{
+  void *volatile memory = ::cgc1::cgc_malloc(64);
+  cgc1::cgc_safepoint();
+  return !cgc1::debug::_cgc_hidden_packed_free(::mcpputil::hide_pointer(memory));
+}
+
+static void thread_registry_test()
+{
+  const auto num_threads = gks->_d_num_threads();
+  ::std::atomic<bool> keep_going{true};
+  ::std::atomic<size_t> num_registered{0};
+  ::std::atomic<size_t> num_lost{0};
+  ::std::vector<::std::thread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    threads.emplace_back([&keep_going, &num_registered, &num_lost]() {
+      // threads join and leave while collections run.
+      while (keep_going) {
+        CGC1_INITIALIZE_THREAD();
+        ++num_registered;
+        if (!thread_registry_test__survives_safepoint()) {
+          ++num_lost;
+        }
+        cgc1::cgc_unregister_thread();
+      }
+    });
+  }
+  // stopping a thread twice terminates in suspension, so getting through every collection covers that.
+  for (size_t i = 0; i < 10; ++i) {
+    cgc1::cgc_force_collect();
+    gks->wait_for_finalization();
+  }
+  keep_going = false;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  AssertThat(num_registered.load(), IsGreaterThan(0_sz));
+  AssertThat(num_lost.load(), Equals(0_sz));
+  AssertThat(gks->_d_num_threads(), Equals(num_threads));
+  // retired states of the threads are freed by this collection.
+  cgc1::cgc_force_collect();
+  gks->wait_for_finalization();
+  AssertThat(gks->_d_num_retired_threads(), Equals(0_sz));
+}
+
+static void numa_test()
+{
+  using namespace ::cgc1::details;
+  AssertThat(numa_topology().num_nodes(), IsGreaterThanOrEqualTo(1_sz));
+  // stripes never get smaller than the minimum, and a heap never has more stripes than the maximum.
+  AssertThat(numa_stripe_size(1), Equals(cs_min_numa_stripe_size));
+  AssertThat(numa_stripe_size(static_cast<size_t>(1) << 33), Equals(cs_min_numa_stripe_size));
+  AssertThat(numa_stripe_size(static_cast<size_t>(1) << 36) * cs_max_numa_stripes, Equals(static_cast<size_t>(1) << 36));
+  // stripes go to nodes in turn.
+  alignas(64) static uint8_t heap[64];
+  AssertThat(numa_node_of(heap + 3, heap, 16, 2), Equals(0_sz));
+  AssertThat(numa_node_of(heap + 16, heap, 16, 2), Equals(1_sz));
+  AssertThat(numa_node_of(heap + 47, heap, 16, 2), Equals(0_sz));
+  AssertThat(numa_node_of(heap + 63, heap, 16, 3), Equals(0_sz));
+}
+
+void gc_tests()
+{
+  describe("GC_stack_scan", []() {
+    it("sparse_object_header_size_test", []() { sparse_object_header_size_test(); });
+    it("scan_words_in_ranges_test", []() { scan_words_in_ranges_test(); });
+  });
+  describe("GC_mark", []() {
+    it("parallel_mark_test", []() { parallel_mark_test(); });
+    it("parallel_sparse_mark_test", []() { parallel_sparse_mark_test(); });
+    it("mark_stack_overflow_test", []() { mark_stack_overflow_test(); });
+    it("concurrent_mark_test", []() { concurrent_mark_test(); });
+    it("incremental_mark_test", []() { incremental_mark_test(); });
+  });
+  describe("GC_sweep", []() {
+    it("lazy_sweep_test", []() { lazy_sweep_test(); });
+    it("lazy_sweep_garbage_state_test", []() { lazy_sweep_garbage_state_test(); });
+    it("parallel_sweep_test", []() { parallel_sweep_test(); });
+  });
+  describe("GC_threads", []() {
+    it("safepoint_test", []() { safepoint_test(); });
+    it("thread_registry_test", []() { thread_registry_test(); });
+  });
+  describe("GC_roots", []() { it("root_log_test", []() { root_log_test(); }); });
+  describe("GC_finalizers", []() {
+    it("finalizer_executor_test", []() { finalizer_executor_test(); });
+    it("finalizer_queue_full_test", []() { finalizer_queue_full_test(); });
+  });
+  describe("GC_numa", []() { it("numa_test", []() { numa_test(); }); });
+}
@@ -5,10 +5,12 @@
 using namespace bandit;
 extern void gc_bandit_tests();
 extern void gc_bitmap_tests();
+extern void gc_tests();
 
 go_bandit([]() {
   gc_bitmap_tests();
   gc_bandit_tests();
+  gc_tests();
 });
 
 int main(int argc, char *argv[])